@@ -2,9 +2,6 @@
 
 #include <driver.h>
 
-// @Cleanup
-extern "C" double strtod(const char *str, char **endptr);
-
 [[nodiscard("Leak")]] token_stream tokenize(string s) {
     token_stream stream;
     make_dynamic(&stream.Tokens, 20);
@@ -20,13 +17,10 @@ extern "C" double strtod(const char *str, char **endptr);
         if (!s) break;
 
         if (is_digit(s[0])) {
-            auto *ch = string_to_c_string(s);
-            char *end;
-
-            f64 fltValue = strtod(ch, &end);  // @DependencyCleanup
+            auto [fltValue, status, rest] = parse_float<f64>(s);
 
-            auto str = substring(s, 0, end - ch);
-            s        = substring(s, end - ch, string_length(s));
+            auto str = string(s.Data, rest.Data - s.Data);
+            s        = rest;
 
             add(&stream.Tokens, token{token::NUMBER, str, fltValue});
         } else if (is_op(s[0])) {
@@ -64,6 +64,14 @@ template <typename T>
 concept is_array_like =
     should_array_be_treated_as_array_like<T>() && has_array_members<T>;
 
+// Arrays which start with their _Data_ pointing to a buffer inside the object
+// (e.g. small_array). reserve() must not realloc/free that buffer.
+template <typename T>
+concept has_inline_storage = requires(T t) {
+  {t.INLINE_CAPACITY};
+  {t.Inline};
+};
+
 template <typename T>
 concept is_dynamic_array_like =
     should_array_be_treated_as_array_like<T>() && has_dynamic_array_members<T>;
@@ -402,6 +410,9 @@ void check_debug_memory(any_dynamic_array_like auto no_copy arr) {
   // Caution! This container is not thread-safe!
   //
   assert(arr.Allocated);
+  if constexpr (internal::has_inline_storage<remove_cvref_t<decltype(arr)>>) {
+    if ((void *)arr.Data == (void *)arr.Inline) return;
+  }
 #if defined DEBUG_MEMORY
   assert(debug_memory_list_contains((allocation_header *)arr.Data - 1));
 #endif
@@ -415,6 +426,19 @@ void reserve(any_dynamic_array_like auto ref arr, s64 n, allocator alloc) {
 
   using T = remove_pointer_t<decltype(arr.Data)>;
 
+  if constexpr (internal::has_inline_storage<remove_cvref_t<decltype(arr)>>) {
+    if ((void *)arr.Data == (void *)arr.Inline) {
+      // Still in the inline buffer, move to the heap only when it doesn't fit
+      if (n <= arr.INLINE_CAPACITY) return;
+
+      auto *newData = malloc<T>({.Count = n, .Alloc = alloc});
+      memcpy(newData, arr.Data, arr.Count * sizeof(T));
+      arr.Data = newData;
+      arr.Allocated = n;
+      return;
+    }
+  }
+
   auto *oldData = arr.Data;
   if (arr.Allocated) {
     arr.Data = realloc(arr.Data, {.NewCount = n});
@@ -627,4 +651,16 @@ requires(is_same<array_data_t<Arr>, array_data_t<Arr2>> &&is_same<
   }
 }
 
+// Sorts the elements in place, see sort() in qsort.h
+template <any_array_like Arr>
+void sort(Arr ref arr) {
+  sort(arr.Data, arr.Count);
+}
+
+// _less_ is called as less(a, b) and returns true if _a_ should go before _b_
+template <any_array_like Arr, typename Less>
+void sort(Arr ref arr, Less less) {
+  sort(arr.Data, arr.Count, less);
+}
+
 LSTD_END_NAMESPACE
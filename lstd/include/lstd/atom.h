@@ -0,0 +1,217 @@
+#pragma once
+
+#include "hash.h"
+#include "os.h"
+
+LSTD_BEGIN_NAMESPACE
+
+//
+// String interning.
+//
+// intern() returns a 32 bit handle (an atom) which is the same for strings
+// with the same bytes. Comparing atoms is an integer compare and the hash of
+// the string is computed once, when the string is interned for the first time.
+// Use them for identifiers, asset names, keys in tables, etc.
+//
+//      atom a = intern("albedo");
+//      if (a == intern(name)) { ... }
+//      string s = atom_string(a);  // Valid until the end of the program
+//
+// The pool is global and thread-safe. Interned strings are never freed,
+// their bytes live in big blocks taken from the platform persistent allocator,
+// so a string returned by atom_string() stays valid (and its pointer stable)
+// for the lifetime of the program. Don't intern unbounded user input.
+//
+// atom_hash(a) == get_hash(atom_string(a)), so an atom's hash can be passed to
+// the *_prehashed functions of a hash table with string keys.
+//
+struct atom {
+  u32 ID = 0;  // 0 is the null atom (returned for empty strings)
+
+  explicit operator bool() const { return ID; }
+};
+
+inline bool operator==(atom a, atom b) { return a.ID == b.ID; }
+inline bool operator!=(atom a, atom b) { return a.ID != b.ID; }
+
+// Returns the atom for _s_, adding a copy of _s_ to the pool if it's not there.
+atom intern(string s);
+
+// Returns the atom for _s_ only if it was already interned, null atom otherwise.
+atom find_atom(string s);
+
+string atom_string(atom a);
+u64 atom_hash(atom a);
+
+// So atoms can be used as keys in hash tables.
+inline u64 get_hash(atom a) { return atom_hash(a); }
+
+namespace internal {
+struct atom_entry {
+  const char *Data;
+  s64 Count;
+  u64 Hash;
+};
+
+struct atom_pool {
+  // Entries are stored in fixed size blocks which never move, so readers
+  // don't need to lock (an atom is handed out only after its entry is written).
+  static const s64 ENTRIES_PER_BLOCK = 4096;
+  static const s64 MAX_BLOCKS = 1024;
+
+  static const s64 STRING_BLOCK_SIZE = 64_KiB;
+
+  fast_mutex Mutex;
+
+  atom_entry *Blocks[MAX_BLOCKS];
+  s64 Count;
+
+  // Open addressing table which maps hashes to atom IDs (0 means empty slot)
+  u32 *Slots;
+  s64 SlotsAllocated;
+
+  // Bump allocator for the bytes of the interned strings
+  char *StringBlock;
+  s64 StringBlockUsed;
+};
+
+inline atom_pool AtomPool;
+
+inline atom_entry *atom_get_entry(u32 id) {
+  u32 index = id - 1;
+  return AtomPool.Blocks[index / atom_pool::ENTRIES_PER_BLOCK] +
+         index % atom_pool::ENTRIES_PER_BLOCK;
+}
+
+// Returns the slot index which holds the atom for _s_ or the empty slot where
+// it should go. Caller must hold the lock.
+inline s64 atom_find_slot(string s, u64 hash) {
+  auto *p = &AtomPool;
+
+  s64 mask = p->SlotsAllocated - 1;
+  s64 index = hash & mask;
+  while (true) {
+    u32 id = p->Slots[index];
+    if (!id) return index;
+
+    auto *e = atom_get_entry(id);
+    if (e->Hash == hash && e->Count == s.Count &&
+        bytes_mismatch(e->Data, s.Data, s.Count) == -1) {
+      return index;
+    }
+    index = (index + 1) & mask;
+  }
+}
+
+inline void atom_grow_slots() {
+  auto *p = &AtomPool;
+
+  s64 newAllocated = p->SlotsAllocated ? p->SlotsAllocated * 2 : 1024;
+  u32 *newSlots =
+      malloc<u32>({.Count = newAllocated,
+                   .Alloc = platform_get_persistent_allocator(),
+                   .Options = LEAK});
+  memset(newSlots, 0, newAllocated * sizeof(u32));
+
+  For(range(p->SlotsAllocated)) {
+    u32 id = p->Slots[it];
+    if (!id) continue;
+
+    s64 index = atom_get_entry(id)->Hash & (newAllocated - 1);
+    while (newSlots[index]) index = (index + 1) & (newAllocated - 1);
+    newSlots[index] = id;
+  }
+
+  if (p->Slots) free(p->Slots);
+  p->Slots = newSlots;
+  p->SlotsAllocated = newAllocated;
+}
+
+inline const char *atom_store_string(string s) {
+  auto *p = &AtomPool;
+
+  if (s.Count > atom_pool::STRING_BLOCK_SIZE / 4) {
+    // Big strings get their own allocation so we don't waste the block
+    auto *data = malloc<char>({.Count = s.Count,
+                               .Alloc = platform_get_persistent_allocator(),
+                               .Options = LEAK});
+    memcpy(data, s.Data, s.Count);
+    return data;
+  }
+
+  if (!p->StringBlock ||
+      p->StringBlockUsed + s.Count > atom_pool::STRING_BLOCK_SIZE) {
+    p->StringBlock = malloc<char>({.Count = atom_pool::STRING_BLOCK_SIZE,
+                                   .Alloc = platform_get_persistent_allocator(),
+                                   .Options = LEAK});
+    p->StringBlockUsed = 0;
+  }
+
+  auto *data = p->StringBlock + p->StringBlockUsed;
+  memcpy(data, s.Data, s.Count);
+  p->StringBlockUsed += s.Count;
+  return data;
+}
+}  // namespace internal
+
+inline atom find_atom(string s) {
+  if (!s.Count) return {};
+
+  auto *p = &internal::AtomPool;
+  u64 hash = get_hash(s);
+
+  lock(&p->Mutex);
+  defer(unlock(&p->Mutex));
+
+  if (!p->SlotsAllocated) return {};
+  return {p->Slots[internal::atom_find_slot(s, hash)]};
+}
+
+inline atom intern(string s) {
+  if (!s.Count) return {};
+
+  auto *p = &internal::AtomPool;
+  u64 hash = get_hash(s);
+
+  lock(&p->Mutex);
+  defer(unlock(&p->Mutex));
+
+  // Keep the table at most half full
+  if ((p->Count + 1) * 2 > p->SlotsAllocated) internal::atom_grow_slots();
+
+  s64 slot = internal::atom_find_slot(s, hash);
+  if (p->Slots[slot]) return {p->Slots[slot]};
+
+  s64 index = p->Count;
+  s64 block = index / internal::atom_pool::ENTRIES_PER_BLOCK;
+  assert(block < internal::atom_pool::MAX_BLOCKS && "Too many atoms");
+
+  if (!p->Blocks[block]) {
+    p->Blocks[block] = malloc<internal::atom_entry>(
+        {.Count = internal::atom_pool::ENTRIES_PER_BLOCK,
+         .Alloc = platform_get_persistent_allocator(),
+         .Options = LEAK});
+  }
+
+  auto *e = p->Blocks[block] + index % internal::atom_pool::ENTRIES_PER_BLOCK;
+  *e = {internal::atom_store_string(s), s.Count, hash};
+
+  p->Count += 1;
+
+  u32 id = (u32)(index + 1);
+  p->Slots[slot] = id;
+  return {id};
+}
+
+inline string atom_string(atom a) {
+  if (!a.ID) return {};
+  auto *e = internal::atom_get_entry(a.ID);
+  return string(e->Data, e->Count);
+}
+
+inline u64 atom_hash(atom a) {
+  if (!a.ID) return get_hash(string());
+  return internal::atom_get_entry(a.ID)->Hash;
+}
+
+LSTD_END_NAMESPACE
@@ -4,7 +4,7 @@
 
 //
 // Atomic operations: atomic_inc, atomic_add, atomic_swap,
-// atomic_compare_and_swap
+// atomic_compare_and_swap, atomic_load, atomic_store, atomic_fence
 //
 
 LSTD_BEGIN_NAMESPACE
@@ -33,6 +33,8 @@ long __cdecl _InterlockedExchange(long volatile *_Target, long _Value);
 long long __cdecl _InterlockedExchange64(long long volatile *_Target,
                                          long long _Value);
 
+void _ReadWriteBarrier(void);
+
 short __cdecl _InterlockedCompareExchange16(short volatile *_Destination,
                                             short _Exchange, short _Comparand);
 long __cdecl _InterlockedCompareExchange(long volatile *_Destination,
@@ -158,4 +160,44 @@ T atomic_compare_and_swap(T *ptr, T oldValue, T newValue) {
 }
 #endif
 
+// Reads the value so it isn't torn, cached in a register or reordered with
+// other atomic operations. Cheaper than atomic_compare_and_swap(&value, 0, 0).
+template <appropriate_for_atomic T>
+T atomic_load(T *ptr) {
+#if COMPILER == MSVC
+  // Aligned loads are atomic on x86/x64 and aren't reordered with other loads
+  // or with locked instructions, we only need to stop the compiler.
+  T result = *(volatile T *)ptr;
+  _ReadWriteBarrier();
+  return result;
+#else
+  return __atomic_load_n(ptr, __ATOMIC_SEQ_CST);
+#endif
+}
+
+// Stores the value, other threads see it after all writes before it.
+// Sequentially consistent: loads after it aren't moved before it either.
+template <appropriate_for_atomic T>
+void atomic_store(T *ptr, T value) {
+#if COMPILER == MSVC
+  // Exchange is a locked instruction, i.e. a full barrier
+  atomic_swap(ptr, value);
+#else
+  // Not __sync_lock_test_and_set (atomic_swap), which is only an acquire
+  // barrier
+  __atomic_store_n(ptr, value, __ATOMIC_SEQ_CST);
+#endif
+}
+
+// Full memory barrier: no load or store is moved across it, in either
+// direction (including a store followed by a load).
+inline void atomic_fence() {
+#if COMPILER == MSVC
+  long dummy = 0;
+  _InterlockedExchange(&dummy, 0);
+#else
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+#endif
+}
+
 LSTD_END_NAMESPACE
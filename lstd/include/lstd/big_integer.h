@@ -45,10 +45,20 @@ const digit MASK = BASE - 1;
 // sign in a bit that can be used to encode more numbers.
 // (and as we said big integers have practically unlimited range).
 //
-// When doing arithmetic operations we allocate a new big_integer (we don't do
-// the work in place). This is because: 1. for most operations we need to
-// allocate a seperate buffer to store the result anyway; 2. sometimes you don't
-// want to discard the old result.
+// The operators allocate a new big_integer for the result. This is because:
+// 1. for most operations we need to allocate a seperate buffer to store the
+// result anyway; 2. sometimes you don't want to discard the old result.
+//
+// For loops which update the same numbers over and over (factorials, series,
+// modular exponentiation) there are in-place versions: add_assign, sub_assign,
+// mul_assign, fma_assign, div_assign and mod_assign (see below). They reuse
+// the storage of the first argument and take temporaries from a
+// big_integer_scratch, so once the numbers stop growing they don't allocate.
+//
+// Note: Copying a big_integer (=, passing by value) copies the pointer to the
+// digits, not the digits. An in-place operation changes the value of all
+// copies which share the digits (or leaves them dangling if it had to grow).
+// To make a separate copy assign() to an empty big_integer.
 //
 // To free the big_integer (if it has allocated any memory) use: free(b);
 // Note: We don't expect you to be freeing big integers very often, because:
@@ -93,7 +103,7 @@ big_integer rshift(big_integer lhs, s64 n);  // >> operator is overloaded too
 // if a > b, returns 1
 s32 compare(big_integer a, big_integer b);
 
-// We don't support ++/-- and assignment operators.
+// We don't support ++/-- and assignment operators, see add_assign() etc.
 
 inline bool operator==(big_integer lhs, big_integer rhs) {
   return compare(lhs, rhs) == 0;
@@ -159,9 +169,103 @@ div_result divmod(big_integer lhs, big_integer rhs);
 
 inline void free(big_integer ref b) {
   if (b.Digits) free(b.Digits);
+  b.Digits = null;
   b.Size = 0;
+  b.SmallDigits[0] = b.SmallDigits[1] = 0;
+}
+
+// Copies the digits of _v_ into _b_ (reusing _b_'s storage)
+bool assign(big_integer ref b, big_integer v);
+
+//
+// Scratch memory for the in-place operations. Products, quotients and the
+// temporaries of the multiplication algorithms are taken from here like from
+// a stack and given back when the operation returns. Pass the same scratch to
+// every operation in a loop, it grows to what the largest operation needs
+// and after that nothing is allocated:
+//
+//      big_integer_scratch scratch;
+//      defer(free(scratch));
+//
+//      // b^e mod m
+//      big_integer result = make_big(1);
+//      while (e) {
+//          if (e & 1) {
+//              mul_assign(result, b, &scratch);
+//              mod_assign(result, m, &scratch);
+//          }
+//          mul_assign(b, b, &scratch);
+//          mod_assign(b, m, &scratch);
+//          e >>= 1;
+//      }
+//
+// If no scratch is passed (null) the operation allocates one and frees it at
+// the end. Operations with a small integer argument that fits in a digit
+// (e.g. factorials: mul_assign(f, i)) don't need scratch at all.
+//
+struct big_integer_scratch {
+  digit *Data = null;
+  s64 Used = 0;
+  s64 Allocated = 0;
+
+  // The allocator used for the scratch digits. This value is null until
+  // this object allocates memory (in which case it sets it to the Context's
+  // allocator) or the user sets it manually.
+  allocator Alloc;
+};
+
+inline void free(big_integer_scratch ref s) {
+  if (s.Data) free(s.Data);
+  s.Data = null;
+  s.Used = s.Allocated = 0;
 }
 
+// a += b
+void add_assign(big_integer ref a, big_integer b);
+void add_assign(big_integer ref a, is_integral auto b);
+
+// a -= b
+void sub_assign(big_integer ref a, big_integer b);
+void sub_assign(big_integer ref a, is_integral auto b);
+
+// a *= b
+void mul_assign(big_integer ref a, big_integer b,
+                big_integer_scratch *scratch = null);
+void mul_assign(big_integer ref a, is_integral auto b,
+                big_integer_scratch *scratch = null);
+
+// a += b * c, without a temporary for the product when _c_ fits in a digit
+void fma_assign(big_integer ref a, big_integer b, big_integer c,
+                big_integer_scratch *scratch = null);
+void fma_assign(big_integer ref a, big_integer b, is_integral auto c,
+                big_integer_scratch *scratch = null);
+
+// a /= b (truncates, like operator /)
+void div_assign(big_integer ref a, big_integer b,
+                big_integer_scratch *scratch = null);
+
+// a /= b (truncates) and returns the remainder (with the sign of a)
+s64 div_assign(big_integer ref a, is_integral auto b,
+               big_integer_scratch *scratch = null);
+
+// a %= b (the result has the sign of b, like operator %)
+void mod_assign(big_integer ref a, big_integer b,
+                big_integer_scratch *scratch = null);
+
+// Upper bound of how many characters to_chars() writes for _b_ in _base_
+s64 to_chars_size(big_integer b, u32 base = 10);
+
+// Writes _b_ in _base_ (2 to 36) to _out_, which must have space for
+// to_chars_size() characters. Returns how many characters were written.
+// Negative numbers start with '-', there is no prefix. Digits above 9 are
+// lowercase letters unless _upperCase_.
+//
+// Bases which are powers of 2 take linear time. Otherwise the number is split
+// in halves by dividing by powers of the base, so large numbers take about as
+// long as a few multiplications instead of quadratic time.
+s64 to_chars(char *out, big_integer b, u32 base = 10, bool upperCase = false,
+             big_integer_scratch *scratch = null);
+
 //
 // Now some low-level operations which are also useful for tweaking:
 //
@@ -290,7 +394,7 @@ inline bool assign(big_integer ref b, is_integral auto v) {
     auto binaryDigits = count_digits<1>(
         abs(v));  // How many bits do we need to store the value in _v_
 
-    auto digits = binaryDigits / BASE + (binaryDigits % BASE != 0);
+    auto digits = binaryDigits / SHIFT + (binaryDigits % SHIFT != 0);
     ensure_digits(b, digits);
 
     s64 size = 0, sign = 1;
@@ -326,7 +430,7 @@ inline bool assign(big_integer ref b, is_integral auto v) {
 // x[0:m] and y[0:n] are digit vectors, LSD first, m >= n required.  x[0:n]
 // is modified in place, by adding y to it. Carries are propagated as far as
 // x[m-1], and the remaining carry (0 or 1) is returned.
-inline digit v_iadd(digit *x, s64 m, digit *y, s64 n) {
+inline digit v_iadd(digit *x, s64 m, const digit *y, s64 n) {
   assert(m >= n);
 
   digit carry = 0;
@@ -355,7 +459,7 @@ inline digit v_iadd(digit *x, s64 m, digit *y, s64 n) {
 // x[0:m] and y[0:n] are digit vectors, LSD first, m >= n required.  x[0:n]
 // is modified in place, by subtracting y from it. Borrows are propagated as
 // far as x[m-1], and the remaining borrow (0 or 1) is returned.
-inline digit v_isub(digit *x, s64 m, digit *y, s64 n) {
+inline digit v_isub(digit *x, s64 m, const digit *y, s64 n) {
   assert(m >= n);
 
   digit borrow = 0;
@@ -472,327 +576,650 @@ inline big_integer x_sub(big_integer *a, big_integer *b) {
   return result;
 }
 
-// Grade-school algorithm.
-inline big_integer x_mul(big_integer lhs, big_integer rhs) {
-  s64 sizea = abs(lhs.Size), sizeb = abs(rhs.Size);
+namespace internal {
+// Makes sure _s_ has at least _n_ digits. Called by the top-level operations
+// before they take anything, so the block can be moved.
+inline void scratch_reserve(big_integer_scratch *s, s64 n) {
+  assert(!s->Used);
+  if (s->Allocated >= n) return;
 
-  auto result = make_big_integer_and_set_size(sizea + sizeb);
-  if (lhs == rhs) {
-    // Efficient squaring per HAC, Algorithm 14.16:
-    // http://www.cacr.math.uwaterloo.ca/hac/about/chap14.pdf
-    // Gives slightly less than a 2x speedup when a == b,
-    // via exploiting that each entry in the multiplication
-    // pyramid appears twice (except for the sizea squares).
+  if (s->Data) free(s->Data);
+  if (!s->Alloc) s->Alloc = Context.Alloc;
 
-    For(range(sizea)) {
-      double_digit f = get_digit(lhs, it);
+  s64 size = max(n, s->Allocated * 2);
+  s->Data = malloc<digit>({.Count = size, .Alloc = s->Alloc});
+  s->Allocated = size;
+}
 
-      auto *pz = get_digits(result) + (it << 1);
-      auto *pa = get_digits(lhs) + it + 1;
-      auto *paend = get_digits(lhs) + sizea;
+inline digit *scratch_take(big_integer_scratch *s, s64 n) {
+  assert(s->Used + n <= s->Allocated && "Not enough scratch reserved");
+  digit *result = s->Data + s->Used;
+  s->Used += n;
+  return result;
+}
+}  // namespace internal
 
-      double_digit carry = *pz + f * f;
+// z[0:max(m, n) + 1] = x[0:m] + y[0:n]
+inline void v_add(digit *z, const digit *x, s64 m, const digit *y, s64 n) {
+  if (m < n) {
+    swap(x, y);
+    swap(m, n);
+  }
 
-      *pz++ = (digit)(carry & MASK);
+  digit carry = 0;
+
+  s64 i = 0;
+  for (; i < n; ++i) {
+    carry += x[i] + y[i];
+    z[i] = carry & MASK;
+    carry >>= SHIFT;
+  }
+  for (; i < m; ++i) {
+    carry += x[i];
+    z[i] = carry & MASK;
+    carry >>= SHIFT;
+  }
+  z[i] = carry;
+}
+
+// x[0:n] = y[0:n] - x[0:n], y must be >= x
+inline void v_rsub(digit *x, const digit *y, s64 n) {
+  digit borrow = 0;
+  For(range(n)) {
+    borrow = y[it] - x[it] - borrow;
+    x[it] = borrow & MASK;
+    borrow >>= SHIFT;
+    borrow &= 1;  // Keep only one sign bit
+  }
+  assert(borrow == 0);
+}
+
+// Compares x[0:m] and y[0:n] which don't have leading zeros
+inline s32 v_compare(const digit *x, s64 m, const digit *y, s64 n) {
+  if (m != n) return m < n ? -1 : 1;
+
+  s64 i = m;
+  while (--i >= 0) {
+    if (x[i] != y[i]) return x[i] < y[i] ? -1 : 1;
+  }
+  return 0;
+}
+
+// z[0:m] = x[0:m] << d (d < SHIFT), returns the bits shifted out at the top
+inline digit v_lshift(digit *z, const digit *x, s64 m, u32 d) {
+  digit carry = 0;
+  For(range(m)) {
+    double_digit acc = ((double_digit)x[it] << d) | carry;
+    z[it] = (digit)acc & MASK;
+    carry = (digit)(acc >> SHIFT);
+  }
+  return carry;
+}
+
+// z[0:m] = x[0:m] >> d (d < SHIFT), returns the bits shifted out at the bottom
+inline digit v_rshift(digit *z, const digit *x, s64 m, u32 d) {
+  digit mask = ((digit)1 << d) - 1;
+
+  digit carry = 0;
+  for (s64 i = m - 1; i >= 0; --i) {
+    double_digit acc = ((double_digit)carry << SHIFT) | x[i];
+    carry = x[i] & mask;
+    z[i] = (digit)(acc >> d);
+  }
+  return carry;
+}
+
+// Compute two's complement of digit vector a[0:m], writing result to
+// z[0:m]. The digit vector a need not be normalized, but should not
+// be entirely zero. a and z may point to the same digit vector. */
+inline void v_complement(digit *z, const digit *a, s64 m) {
+  digit carry = 1;
+  For(range(m)) {
+    carry += a[it] ^ MASK;
+    z[it] = carry & MASK;
+    carry >>= SHIFT;
+  }
+  assert(carry == 0);
+}
+
+// z[0:m+n] = x[0:m] * y[0:n], grade-school algorithm.
+// z must not overlap x or y.
+inline void v_mul_basecase(digit *z, const digit *x, s64 m, const digit *y,
+                           s64 n) {
+  memset0(z, (m + n) * sizeof(digit));
 
+  For(range(m)) {
+    double_digit f = x[it];
+    if (!f) continue;
+
+    digit *pz = z + it;
+
+    double_digit carry = 0;
+    For_as(j, range(n)) {
+      carry += pz[j] + y[j] * f;
+      pz[j] = (digit)(carry & MASK);
       carry >>= SHIFT;
       assert(carry <= MASK);
+    }
 
-      // Now f is added in twice in each column of the
-      // pyramid it appears. Same as adding f<<1 once.
-      f <<= 1;
-      while (pa < paend) {
-        carry += *pz + *pa++ * f;
-        *pz++ = (digit)(carry & MASK);
-        carry >>= SHIFT;
-        assert(carry <= (MASK << 1));
-      }
+    // The previous rows didn't reach this digit
+    pz[n] = (digit)carry;
+  }
+}
 
-      if (carry) {
-        carry += *pz;
-        *pz++ = (digit)(carry & MASK);
-        carry >>= SHIFT;
-      }
+// z[0:2m] = x[0:m]^2. z must not overlap x.
+inline void v_sqr_basecase(digit *z, const digit *x, s64 m) {
+  memset0(z, 2 * m * sizeof(digit));
 
-      if (carry) *pz += (digit)(carry & MASK);
+  // Efficient squaring per HAC, Algorithm 14.16:
+  // http://www.cacr.math.uwaterloo.ca/hac/about/chap14.pdf
+  // Gives slightly less than a 2x speedup when a == b,
+  // via exploiting that each entry in the multiplication
+  // pyramid appears twice (except for the sizea squares).
 
-      assert((carry >> SHIFT) == 0);
-    }
-  } else {
-    // lhs != rhs
+  For(range(m)) {
+    double_digit f = x[it];
 
-    For(range(sizea)) {
-      double_digit f = get_digit(lhs, it);
+    auto *pz = z + (it << 1);
+    auto *pa = x + it + 1;
+    auto *paend = x + m;
 
-      auto *pz = get_digits(result) + it;
-      auto *pb = get_digits(rhs);
-      auto *pbend = get_digits(rhs) + sizeb;
+    double_digit carry = *pz + f * f;
 
-      double_digit carry = 0;
+    *pz++ = (digit)(carry & MASK);
 
-      while (pb < pbend) {
-        carry += *pz + *pb++ * f;
-        *pz++ = (digit)(carry & MASK);
-        carry >>= SHIFT;
-        assert(carry <= MASK);
-      }
+    carry >>= SHIFT;
+    assert(carry <= MASK);
 
-      if (carry) *pz += (digit)(carry & MASK);
+    // Now f is added in twice in each column of the
+    // pyramid it appears. Same as adding f<<1 once.
+    f <<= 1;
+    while (pa < paend) {
+      carry += *pz + *pa++ * f;
+      *pz++ = (digit)(carry & MASK);
+      carry >>= SHIFT;
+      assert(carry <= (MASK << 1));
+    }
 
-      assert((carry >> SHIFT) == 0);
+    if (carry) {
+      carry += *pz;
+      *pz++ = (digit)(carry & MASK);
+      carry >>= SHIFT;
     }
-  }
 
-  normalize(result);
-  return result;
+    if (carry) *pz += (digit)(carry & MASK);
+
+    assert((carry >> SHIFT) == 0);
+  }
 }
 
-// For int multiplication, use the O(N**2) school algorithm unless
-// both operands contain more than KARATSUBA_CUTOFF digits.
+//
+// Multiplication algorithms by operand size (in digits, the smaller one):
+//   - up to KARATSUBA_CUTOFF: the O(N**2) school algorithm
+//   - up to TOOM3_CUTOFF:     Karatsuba, O(N**1.58)
+//   - up to NTT_CUTOFF:       Toom-Cook 3-way, O(N**1.46)
+//   - above:                  number theoretic transform, O(N log N)
+//
+// The cutoffs were measured on x64 and are variables so they can be tuned
+// for other machines.
+//
 inline s64 KARATSUBA_CUTOFF = 70;
 inline s64 KARATSUBA_SQUARE_CUTOFF = 2 * KARATSUBA_CUTOFF;
 
-// A helper for Karatsuba multiplication (k_mul).
-// Takes an int "n" and an integer "size" representing the place to
-// split, and sets low and high such that abs(n) == (high << size) + low,
-// viewing the shift as being by digits.  The sign bit is ignored, and
-// the return values are >= 0.
-// Returns 0 on success, -1 on failure.
-inline void kmul_split(big_integer n, s64 size, big_integer *high,
-                       big_integer *low) {
-  s64 sizen = abs(n.Size);
-
-  s64 sizelo = min(sizen, size);
-  s64 sizehi = sizen - sizelo;
-
-  ensure_digits(*high, sizehi);
-  ensure_digits(*low, sizelo);
-
-  memcpy(get_digits(*low), get_digits(n), sizelo * sizeof(digit));
-  memcpy(get_digits(*high), get_digits(n) + sizelo, sizehi * sizeof(digit));
-  high->Size = sizehi;
-  low->Size = sizelo;
-
-  normalize(*high);
-  normalize(*low);
-}
-
-big_integer k_mul(big_integer *lhs, big_integer *rhs);
-
-// b has at least twice the digits of a, and a is big enough that Karatsuba
-// would pay off *if* the inputs had balanced sizes.  View b as a sequence
-// of slices, each with a->ob_size digits, and multiply the slices by a,
-// one at a time.  This gives k_mul balanced inputs to work with, and is
-// also cache-friendly (we compute one double-width slice of the result
-// at a time, then move on, never backtracking except for the helpful
-// single-width slice overlap between successive partial sums).
-inline big_integer k_lopsided_mul(big_integer *a, big_integer *b) {
-  s64 sizea = abs(a->Size), sizeb = abs(b->Size);
+inline s64 TOOM3_CUTOFF = 250;
+inline s64 NTT_CUTOFF = 3500;
 
-  assert(sizea > KARATSUBA_CUTOFF);
-  assert(2 * sizea <= sizeb);
+// The transform length is limited by the primes we use, larger products are
+// split by Toom-Cook/Karatsuba until the pieces fit
+const s64 NTT_MAX_SIZE = 1 << 23;
 
-  big_integer result = make_big_integer_and_set_size(sizea + sizeb);
+// How many scratch digits v_mul needs for operands with _m_ and _n_ digits.
+// Each algorithm takes at most 10 * (m + n) digits, including what the
+// recursive calls on the smaller pieces take.
+inline s64 v_mul_scratch_size(s64 m, s64 n) {
+  if (min(m, n) <= KARATSUBA_CUTOFF) return 0;
+  return 10 * (m + n) + 2048;
+}
+
+void v_mul(digit *z, const digit *x, s64 m, const digit *y, s64 n,
+           big_integer_scratch *scratch);
+
+namespace internal {
+//
+// Number theoretic transform. The convolution is done modulo three primes of
+// the form c * 2^k + 1 and the coefficients are recovered with the Chinese
+// remainder theorem. Their product is about 2^86, which holds coefficients
+// of products up to NTT_MAX_SIZE digits (each coefficient is a sum of at most
+// 2^23 products of two 30 bit digits).
+//
+const u32 NTT_P1 = 469762049;  // 7 * 2^26 + 1
+const u32 NTT_P2 = 167772161;  // 5 * 2^25 + 1
+const u32 NTT_P3 = 998244353;  // 119 * 2^23 + 1, limits the length to 2^23
 
-  // Successive slices of b are copied into bslice
-  big_integer bslice = make_big_integer_and_set_size(sizea);
+// 3 is a primitive root of all three
+const u32 NTT_G = 3;
 
-  s64 nbdone = 0;  // # of b digits already multiplied
-  while (sizeb > 0) {
-    s64 nbtouse = min(sizeb, sizea);
+template <u32 P>
+always_inline u32 mul_mod(u32 a, u32 b) {
+  return (u32)((u64)a * b % P);
+}
 
-    // Multiply the next slice of b by a
+template <u32 P>
+u32 pow_mod(u32 b, u64 e) {
+  u32 result = 1;
+  while (e) {
+    if (e & 1) result = mul_mod<P>(result, b);
+    b = mul_mod<P>(b, b);
+    e >>= 1;
+  }
+  return result;
+}
 
-    memcpy(get_digits(bslice), get_digits(*b) + nbdone,
-           nbtouse * sizeof(digit));
-    bslice.Size = nbtouse;
+// In-place transform of a[0:n], n is a power of 2. _roots_ is space for n / 2
+// values. The inverse transform includes the division by n.
+template <u32 P>
+void ntt(u32 *a, s64 n, bool inverse, u32 *roots) {
+  for (s64 i = 1, j = 0; i < n; ++i) {
+    s64 bit = n >> 1;
+    for (; j & bit; bit >>= 1) j ^= bit;
+    j ^= bit;
+    if (i < j) swap(a[i], a[j]);
+  }
 
-    big_integer product = k_mul(a, &bslice);
+  u32 w = pow_mod<P>(NTT_G, (P - 1) / n);
+  if (inverse) w = pow_mod<P>(w, P - 2);
 
-    // Add into result
-    v_iadd(get_digits(result) + nbdone, result.Size - nbdone,
-           get_digits(product), product.Size);
+  roots[0] = 1;
+  for (s64 i = 1; i < n / 2; ++i) roots[i] = mul_mod<P>(roots[i - 1], w);
 
-    sizeb -= nbtouse;
-    nbdone += nbtouse;
+  for (s64 len = 2; len <= n; len <<= 1) {
+    s64 half = len >> 1, step = n / len;
+    for (s64 i = 0; i < n; i += len) {
+      u32 *lo = a + i, *hi = a + i + half;
+      For_as(j, range(half)) {
+        u32 u = lo[j], v = mul_mod<P>(hi[j], roots[j * step]);
+        lo[j] = u + v >= P ? u + v - P : u + v;
+        hi[j] = u >= v ? u - v : u + P - v;
+      }
+    }
   }
 
-  normalize(result);
-  return result;
+  if (inverse) {
+    u32 nInverse = pow_mod<P>((u32)(n % P), P - 2);
+    For(range(n)) a[it] = mul_mod<P>(a[it], nInverse);
+  }
 }
 
-// Multiply the absolute values of two integers.
-// Karatsuba multiplication. See Knuth Vol. 2 Chapter 4.3.3 (Pp. 294-295).
-inline big_integer k_mul(big_integer *a, big_integer *b) {
-  s64 sizea = abs(a->Size), sizeb = abs(b->Size);
+// out[0:len] = the cyclic convolution of x[0:m] and y[0:n] modulo P
+template <u32 P>
+void ntt_convolve(u32 *out, const digit *x, s64 m, const digit *y, s64 n,
+                  s64 len, u32 *temp, u32 *roots) {
+  For(range(m)) out[it] = x[it] % P;
+  memset0(out + m, (len - m) * sizeof(u32));
+  ntt<P>(out, len, false, roots);
 
-  // (ah*X+al)(bh*X+bl) = ah*bh*X*X + (ah*bl + al*bh)*X + al*bl
-  // Let k = (ah+al)*(bh+bl) = ah*bl + al*bh  + ah*bh + al*bl
-  // Then the original product is
-  //     ah*bh*X*X + (k - ah*bh - al*bl)*X + al*bl
-  // By picking X to be a power of 2, "*X" is just shifting, and it's
-  // been reduced to 3 multiplies on numbers half the size.
+  if (x == y && m == n) {
+    For(range(len)) out[it] = mul_mod<P>(out[it], out[it]);
+  } else {
+    For(range(n)) temp[it] = y[it] % P;
+    memset0(temp + n, (len - n) * sizeof(u32));
+    ntt<P>(temp, len, false, roots);
 
-  // We want to split based on the larger number; fiddle so that bis largest.
-  if (sizea > sizeb) {
-    swap(a, b);
-    swap(sizea, sizeb);
+    For(range(len)) out[it] = mul_mod<P>(out[it], temp[it]);
   }
+  ntt<P>(out, len, true, roots);
+}
 
-  // @Speed We treat big integers as immutable. That has serious performance
-  // implications. Also the (a == b) comparison here..
+// z[0:m+n] = x[0:m] * y[0:n] with the transform, m + n <= NTT_MAX_SIZE
+inline void v_mul_ntt(digit *z, const digit *x, s64 m, const digit *y, s64 n,
+                      big_integer_scratch *scratch) {
+  s64 mark = scratch->Used;
 
-  s64 i = (*a == *b) ? KARATSUBA_SQUARE_CUTOFF : KARATSUBA_CUTOFF;
-  if (sizea <= i) {
-    if (sizea == 0) {
-      return make_big(0);
-    } else {
-      return x_mul(*a, *b);
-    }
+  s64 len = ceil_pow_of_2(m + n);
+  assert(len <= NTT_MAX_SIZE);
+
+  // digit is a u32
+  u32 *r1 = scratch_take(scratch, len);
+  u32 *r2 = scratch_take(scratch, len);
+  u32 *r3 = scratch_take(scratch, len);
+  u32 *temp = scratch_take(scratch, len);
+  u32 *roots = scratch_take(scratch, len / 2);
+
+  ntt_convolve<NTT_P1>(r1, x, m, y, n, len, temp, roots);
+  ntt_convolve<NTT_P2>(r2, x, m, y, n, len, temp, roots);
+  ntt_convolve<NTT_P3>(r3, x, m, y, n, len, temp, roots);
+
+  // Garner's algorithm: c = r1 + P1 * t2 + P1 * P2 * t3
+  const u32 inverseP1 = pow_mod<NTT_P2>(NTT_P1 % NTT_P2, NTT_P2 - 2);
+
+  const u64 p1p2 = (u64)NTT_P1 * NTT_P2;  // < 2^56
+  const u32 inverseP1P2 = pow_mod<NTT_P3>((u32)(p1p2 % NTT_P3), NTT_P3 - 2);
+
+  const u64 p1p2lo = p1p2 & MASK, p1p2hi = p1p2 >> SHIFT;
+
+  u64 carry = 0;
+  For(range(m + n)) {
+    u32 t2 = mul_mod<NTT_P2>((r2[it] + NTT_P2 - r1[it] % NTT_P2) % NTT_P2,
+                             inverseP1);
+    u64 c12 = r1[it] + (u64)NTT_P1 * t2;
+
+    u32 t3 = mul_mod<NTT_P3>((r3[it] + NTT_P3 - (u32)(c12 % NTT_P3)) % NTT_P3,
+                             inverseP1P2);
+
+    // carry + c12 + p1p2 * t3, split in the low digit and the rest
+    u64 lo = (carry & MASK) + (c12 & MASK) + p1p2lo * t3;
+    z[it] = (digit)(lo & MASK);
+    carry = (carry >> SHIFT) + (c12 >> SHIFT) + p1p2hi * t3 + (lo >> SHIFT);
   }
+  assert(carry == 0);
 
-  // If a is small compared to b, splitting on b gives a degenerate
-  // case with ah==0, and Karatsuba may be (even much) less efficient
-  // than "grade school" then.  However, we can still win, by viewing
-  // b as a string of "big digits", each of width a->Size.  That
-  // leads to a sequence of balanced calls to k_mul.
+  scratch->Used = mark;
+}
 
-  if (2 * sizea <= sizeb) return k_lopsided_mul(a, b);
+//
+// Toom-Cook 3-way. Both numbers are split in 3 pieces of k digits, seen as
+// polynomials of degree 2 in X = BASE^k. Evaluating them at 0, 1, -1, -2 and
+// infinity and multiplying the values gives the 5 coefficients of the product
+// with 5 multiplications of numbers of about k digits (instead of 9).
+//
+// The values at -1 and -2 can be negative, so the evaluation and the
+// interpolation are done in two's complement, i.e. modulo BASE^width.
+// The final coefficients are positive.
+//
 
-  big_integer ah_, al_;
+// The sign bit of a two's complement vector
+always_inline bool tc_negative(const digit *x, s64 width) {
+  return x[width - 1] >> (SHIFT - 1);
+}
 
-  // Split a & b into hi & lo pieces
-  s64 shift = sizeb >> 1;
-  kmul_split(*a, shift, &ah_, &al_);
+// x[0:width] = (x[0:width] - y[0:width]) mod BASE^width
+always_inline void tc_sub(digit *x, const digit *y, s64 width) {
+  v_isub(x, width, y, width);
+}
 
-  assert(ah_.Size > 0);  // The split isn't degenerate
+// x[0:width] = -x[0:width] mod BASE^width
+inline void tc_negate(digit *x, s64 width) {
+  digit carry = 1;
+  For(range(width)) {
+    carry += x[it] ^ MASK;
+    x[it] = carry & MASK;
+    carry >>= SHIFT;
+  }
+}
 
-  big_integer bh_, bl_;
+// x[0:width] /= 2, x must be even
+inline void tc_half(digit *x, s64 width) {
+  bool negative = tc_negative(x, width);
+  v_rshift(x, x, width, 1);
+  if (negative) x[width - 1] |= (digit)1 << (SHIFT - 1);
+}
 
-  big_integer *ah = &ah_, *al = &al_;
-  big_integer *bh, *bl;
+// x[0:width] /= 3, x must be divisible by 3. Multiplies by the inverse of 3
+// digit by digit, which works for negative values too.
+inline void tc_divexact3(digit *x, s64 width) {
+  const digit INVERSE3 = 0x2AAAAAAB;  // 3 * INVERSE3 = 1 (mod BASE)
 
-  if (*a == *b) {
-    bh = ah;
-    bl = al;
-  } else {
-    kmul_split(*b, shift, &bh_, &bl_);
+  digit carry = 0;
+  For(range(width)) {
+    digit borrow = x[it] < carry;
+    digit d = (x[it] - carry) & MASK;
 
-    bh = &bh_;
-    bl = &bl_;
+    digit q = (digit)(((double_digit)d * INVERSE3) & MASK);
+    x[it] = q;
+
+    // 3q = d + BASE * h, h is 0, 1 or 2
+    carry = (digit)(((double_digit)q * 3 - d) >> SHIFT) + borrow;
   }
+}
 
-  // The plan:
-  // 1. Allocate result space (sizea + sizeb digits: that's always enough).
-  // 2. Compute ah*bh, and copy into result at 2*shift.
-  // 3. Compute al*bl, and copy into result at 0. Note that this can't overlap
-  // with #2.
-  // 4. Subtract al*bl from the result, starting at shift. This may
-  //    underflow (borrow out of the high digit), but we don't care:
-  //    we're effectively doing unsigned arithmetic mod
-  //    BASE**(sizea + sizeb), and so long as the *final* result fits,
-  //    borrows and carries out of the high digit can be ignored.
-  // 5. Subtract ah*bh from the result, starting at shift.
-  // 6. Compute (ah+al)*(bh+bl), and add it into the result starting at shift.
+// Evaluates x0 + x1 * X + x2 * X^2 at 1, -1 and -2. Results are two's
+// complement _width_ digits, the ones at -1 and -2 are made positive and
+// the sign is returned in _negative_.
+inline void toom3_evaluate(digit *v1, digit *vm1, digit *vm2, bool *negative,
+                           const digit *x, s64 m, s64 k, s64 width) {
+  const digit *x0 = x, *x1 = x + k, *x2 = x + 2 * k;
+  s64 m2 = m - 2 * k;
 
-  // 1.
+  // v1 = x0 + x2 + x1
+  memset0(v1, width * sizeof(digit));
+  v_add(v1, x0, k, x2, m2);
 
-  big_integer result = make_big_integer_and_set_size(sizea + sizeb);
+  // vm1 = x0 + x2 - x1
+  memcpy(vm1, v1, width * sizeof(digit));
+  v_isub(vm1, width, x1, k);
 
-  // 2. t1 <- ah*bh, and copy into high digits of result
-  big_integer t1 = k_mul(ah, bh);
+  v_iadd(v1, width, x1, k);
 
-  assert(t1.Size >= 0);
-  assert(2 * shift + t1.Size <= result.Size);
-  memcpy(get_digits(result) + 2 * shift, get_digits(t1),
-         t1.Size * sizeof(digit));
+  // vm2 = 2 * (vm1 + x2) - x0
+  memcpy(vm2, vm1, width * sizeof(digit));
+  v_iadd(vm2, width, x2, m2);
+  v_lshift(vm2, vm2, width, 1);
+  v_isub(vm2, width, x0, k);
 
-  // Zero-out the digits higher than the ah*bh copy
-  i = result.Size - 2 * shift - t1.Size;
-  if (i)
-    memset0((char *)(get_digits(result) + 2 * shift + t1.Size),
-            i * sizeof(digit));
+  negative[0] = tc_negative(vm1, width);
+  if (negative[0]) v_complement(vm1, vm1, width);
 
-  // 3. t2 <- al*bl, and copy into the low digits
-  big_integer t2 = k_mul(al, bl);
+  negative[1] = tc_negative(vm2, width);
+  if (negative[1]) v_complement(vm2, vm2, width);
+}
 
-  assert(t2.Size >= 0);
-  assert(t2.Size <= 2 * shift); /* no overlap with high digits */
-  memcpy(get_digits(result), get_digits(t2), t2.Size * sizeof(digit));
+// z[0:width] = x[0:m] * y[0:n] in two's complement (negated if _negative_)
+inline void toom3_product(digit *z, s64 width, const digit *x, s64 m,
+                          const digit *y, s64 n, bool negative,
+                          big_integer_scratch *scratch) {
+  while (m > 0 && !x[m - 1]) --m;
+  while (n > 0 && !y[n - 1]) --n;
 
-  // Zero out remaining digits
-  i = 2 * shift - t2.Size;  // number of uninitialized digits
-  if (i) memset0(get_digits(result) + t2.Size, i * sizeof(digit));
+  memset0(z, width * sizeof(digit));
+  if (!m || !n) return;
 
-  // 4 & 5. Subtract ah*bh (t1) and al*bl (t2).
-  // We do al*bl first because it's fresher in cache.
-  i = result.Size - shift;  // # digits after shift
-  v_isub(get_digits(result) + shift, i, get_digits(t2), t2.Size);
+  v_mul(z, x, m, y, n, scratch);
+  if (negative) v_complement(z, z, width);
+}
+
+// z[0:m+n] = x[0:m] * y[0:n], m <= n and m > 2 * k where k = ceil(n / 3)
+inline void v_mul_toom3(digit *z, const digit *x, s64 m, const digit *y,
+                        s64 n, big_integer_scratch *scratch) {
+  s64 mark = scratch->Used;
+
+  bool square = x == y && m == n;
+
+  s64 k = (n + 2) / 3;
+  s64 m2 = m - 2 * k, n2 = n - 2 * k;
 
-  v_isub(get_digits(result) + shift, i, get_digits(t1), t1.Size);
+  // The values at the points take k + 1 digits and a sign bit, and their
+  // products twice as much
+  s64 width = k + 2, productWidth = 2 * width;
 
-  // 6. t3 <- (ah+al)(bh+bl), and add into result
-  t1 = x_add(ah, al);
-  ah = al = null;
+  digit *xv1 = scratch_take(scratch, width);
+  digit *xvm1 = scratch_take(scratch, width);
+  digit *xvm2 = scratch_take(scratch, width);
 
-  if (*a == *b) {
-    t2 = t1;
+  bool xNegative[2], yNegative[2];
+  toom3_evaluate(xv1, xvm1, xvm2, xNegative, x, m, k, width);
+
+  digit *yv1 = xv1, *yvm1 = xvm1, *yvm2 = xvm2;
+  if (square) {
+    yNegative[0] = xNegative[0];
+    yNegative[1] = xNegative[1];
   } else {
-    t2 = x_add(bh, bl);
+    yv1 = scratch_take(scratch, width);
+    yvm1 = scratch_take(scratch, width);
+    yvm2 = scratch_take(scratch, width);
+    toom3_evaluate(yv1, yvm1, yvm2, yNegative, y, n, k, width);
+  }
+
+  // The values at 0 and infinity are the lowest and the highest coefficient
+  // and go straight in the result
+  v_mul(z, x, k, y, k, scratch);
+  memset0(z + 2 * k, 2 * k * sizeof(digit));
+  v_mul(z + 4 * k, x + 2 * k, m2, y + 2 * k, n2, scratch);
+
+  digit *r1 = scratch_take(scratch, productWidth);
+  digit *r2 = scratch_take(scratch, productWidth);
+  digit *r3 = scratch_take(scratch, productWidth);
+
+  toom3_product(r1, productWidth, xv1, width, yv1, width, false, scratch);
+  toom3_product(r2, productWidth, xvm1, width, yvm1, width,
+                xNegative[0] != yNegative[0], scratch);
+  toom3_product(r3, productWidth, xvm2, width, yvm2, width,
+                xNegative[1] != yNegative[1], scratch);
+
+  // Interpolation (Bodrato's sequence). r1, r2 and r3 hold the values at 1,
+  // -1 and -2 and end up with the coefficients of X, X^2 and X^3.
+  const digit *c0 = z, *c4 = z + 4 * k;
+  s64 sizec4 = m2 + n2;
+
+  // r3 = (v(-2) - v(1)) / 3
+  tc_sub(r3, r1, productWidth);
+  tc_divexact3(r3, productWidth);
+
+  // r1 = (v(1) - v(-1)) / 2
+  tc_sub(r1, r2, productWidth);
+  tc_half(r1, productWidth);
+
+  // r2 = v(-1) - v(0)
+  v_isub(r2, productWidth, c0, 2 * k);
+
+  // r3 = (r2 - r3) / 2 + 2 * v(inf)
+  tc_negate(r3, productWidth);
+  v_iadd(r3, productWidth, r2, productWidth);
+  tc_half(r3, productWidth);
+  v_iadd(r3, productWidth, c4, sizec4);
+  v_iadd(r3, productWidth, c4, sizec4);
+
+  // r2 = r2 + r1 - v(inf)
+  v_iadd(r2, productWidth, r1, productWidth);
+  v_isub(r2, productWidth, c4, sizec4);
+
+  // r1 = r1 - r3
+  tc_sub(r1, r3, productWidth);
+
+  digit *coefficients[3] = {r1, r2, r3};
+  For(range(3)) {
+    digit *c = coefficients[it];
+
+    s64 size = productWidth;
+    while (size > 0 && !c[size - 1]) --size;
+
+    s64 offset = (it + 1) * k;
+    v_iadd(z + offset, m + n - offset, c, size);
   }
 
-  bh = bl = null;
+  scratch->Used = mark;
+}
+}  // namespace internal
+
+// z[0:m+n] = x[0:m] * y[0:n]. z must not overlap x or y. Temporaries are
+// taken from _scratch_, which must have v_mul_scratch_size(m, n) digits free.
+// Squares (x == y, m == n) take the faster path.
+inline void v_mul(digit *z, const digit *x, s64 m, const digit *y, s64 n,
+                  big_integer_scratch *scratch) {
+  // We want to split based on the larger number; fiddle so that y is largest.
+  if (m > n) {
+    swap(x, y);
+    swap(m, n);
+  }
 
-  big_integer t3 = k_mul(&t1, &t2);
-  assert(t3.Size >= 0);
+  if (!m) {
+    memset0(z, n * sizeof(digit));
+    return;
+  }
+
+  // Splitting fewer than 4 digits doesn't make the halves smaller
+  bool square = x == y && m == n;
+  if (m <= max(square ? KARATSUBA_SQUARE_CUTOFF : KARATSUBA_CUTOFF, 3)) {
+    if (square) {
+      v_sqr_basecase(z, x, m);
+    } else {
+      v_mul_basecase(z, x, m, y, n);
+    }
+    return;
+  }
+
+  if (m >= NTT_CUTOFF && m + n <= NTT_MAX_SIZE) {
+    internal::v_mul_ntt(z, x, m, y, n, scratch);
+    return;
+  }
+
+  s64 mark = scratch->Used;
+
+  if (2 * m <= n) {
+    // If x is small compared to y, splitting on y gives a degenerate case
+    // and Karatsuba may be (even much) less efficient than "grade school"
+    // then. However, we can still win, by viewing y as a string of "big
+    // digits", each of width m. That leads to a sequence of balanced calls.
+    memset0(z, (m + n) * sizeof(digit));
+
+    digit *product = internal::scratch_take(scratch, 2 * m);
+
+    s64 done = 0;
+    while (done < n) {
+      s64 k = min(n - done, m);
+      v_mul(product, x, m, y + done, k, scratch);
+      v_iadd(z + done, m + n - done, product, m + k);
+      done += k;
+    }
+
+    scratch->Used = mark;
+    return;
+  }
+
+  // Toom-Cook needs the top third of x to be non-empty. It needs about 8
+  // digits to make the pieces smaller.
+  if (m >= max(TOOM3_CUTOFF, 8) && m > 2 * ((n + 2) / 3)) {
+    internal::v_mul_toom3(z, x, m, y, n, scratch);
+    return;
+  }
 
-  // Add t3. It's not obvious why we can't run out of room here.
-  // Let f(x) mean the floor of x and c(x) mean the ceiling of x.  Some facts
-  // to start with:
-  // 1. For any integer i, i = c(i/2) + f(i/2). In particular, sizeb =
-  // c(sizeb/2) + f(sizeb/2).
-  // 2. shift = f(sizeb/2)
-  // 3. sizea <= sizeb
-  // 4. Since we call k_lopsided_mul if sizea*2 <= sizeb, sizea*2 > sizeb in
-  // this
-  //    routine, so sizea > sizeb/2 >= f(sizeb/2) in this routine.
-  //
-  // We allocated sizea + sizeb result digits, and add t3 into them at an offset
-  // of shift.  This leaves sizea+sizeb-shift allocated digit positions for t3
-  // to fit into, = (by #1 and #2) sizea + f(sizeb/2) + c(sizeb/2) - f(sizeb/2)
-  // = sizea + c(sizeb/2) available digit positions.
-  //
-  // bh has c(sizeb/2) digits, and bl at most f(size/2) digits.  So bh+hl has
-  // at most c(sizeb/2) digits + 1 bit.
-  //
-  // If sizea == sizeb, ah has c(sizeb/2) digits, else ah has at most f(sizeb/2)
-  // digits, and al has at most f(sizeb/2) digits in any case.  So ah+al has at
-  // most (sizea == sizeb ? c(sizeb/2) : f(sizeb/2)) digits + 1 bit.
-  //
-  // The product (ah+al)*(bh+bl) therefore has at most
-  //     c(sizeb/2) + (sizea == sizeb ? c(sizeb/2) : f(sizeb/2)) digits + 2 bits
-  // and we have sizea + c(sizeb/2) available digit positions.  We need to show
-  // this is always enough.  An instance of c(sizeb/2) cancels out in both, so
-  // the question reduces to whether sizea digits is enough to hold
-  // (sizea == sizeb ? c(sizeb/2) : f(sizeb/2)) digits + 2 bits.
-  //
-  // If sizea < sizeb, then we're asking whether sizea digits >= f(sizeb/2)
-  // digits + 2 bits. By #4, sizea is at least f(sizeb/2)+1 digits, so this in
-  // turn reduces to whether 1 digit is enough to hold 2 bits.  This is so since
-  // SHIFT=15 >= 2.
   //
-  // If sizea == sizeb, then we're asking whether sizeb digits is enough to hold
-  // c(sizeb/2) digits + 2 bits, or equivalently (by #1) whether f(sizeb/2)
-  // digits is enough to hold 2 bits.  This is so if sizeb >= 2, which holds
-  // because sizeb >= KARATSUBA_CUTOFF >= 2.
+  // Karatsuba multiplication. See Knuth Vol. 2 Chapter 4.3.3 (Pp. 294-295).
   //
-  // Note that since there's always enough room for (ah+al)*(bh+bl), and that's
-  // clearly >= each of ah*bh and al*bl, there's always enough room to subtract
-  // ah*bh and al*bl too.
-  v_iadd(get_digits(result) + shift, i, get_digits(t3), t3.Size);
 
-  normalize(result);
-  return result;
+  // (xh*X+xl)(yh*X+yl) = xh*yh*X*X + (xh*yl + xl*yh)*X + xl*yl
+  // Let k = (xh+xl)*(yh+yl) = xh*yl + xl*yh  + xh*yh + xl*yl
+  // Then the original product is
+  //     xh*yh*X*X + (k - xh*yh - xl*yl)*X + xl*yl
+  // By picking X to be a power of 2, "*X" is just shifting, and it's
+  // been reduced to 3 multiplies on numbers half the size.
+
+  s64 shift = n >> 1;  // m > shift since 2 * m > n
+
+  const digit *xl = x, *xh = x + shift;
+  const digit *yl = y, *yh = y + shift;
+  s64 mh = m - shift, nh = n - shift;
+
+  // xl*yl goes in the low digits and xh*yh in the high digits, they don't
+  // overlap
+  v_mul(z, xl, shift, yl, shift, scratch);
+  v_mul(z + 2 * shift, xh, mh, yh, nh, scratch);
+
+  s64 sx = max(mh, shift) + 1, sy = nh + 1;
+
+  digit *sumx = internal::scratch_take(scratch, sx);
+  v_add(sumx, xl, shift, xh, mh);
+
+  digit *sumy = sumx;
+  if (square) {
+    sy = sx;
+  } else {
+    sumy = internal::scratch_take(scratch, sy);
+    v_add(sumy, yl, shift, yh, nh);
+  }
+
+  // k = (xh+xl)*(yh+yl) - xh*yh - xl*yl
+  s64 sk = sx + sy;
+  digit *k = internal::scratch_take(scratch, sk);
+  v_mul(k, sumx, sx, sumy, sy, scratch);
+
+  v_isub(k, sk, z, 2 * shift);
+  v_isub(k, sk, z + 2 * shift, mh + nh);
+
+  // It fits since the final result does (the middle term is smaller than it)
+  while (sk > 0 && !k[sk - 1]) --sk;
+  v_iadd(z + shift, m + n - shift, k, sk);
+
+  scratch->Used = mark;
 }
 
 // Divide long pin, w/ size digits, by non-zero digit n, storing quotient
@@ -836,78 +1263,64 @@ inline div1_result divrem1(big_integer a, digit n) {
   return {result, rem};
 }
 
-inline div_result x_divrem(big_integer a, big_integer b) {
+// Above this many digits in the divisor (and the quotient) division
+// multiplies by an approximation of the divisor's reciprocal, computed with
+// Newton's iteration, instead of producing one digit at a time. The cost is
+// then a few multiplications of numbers of the divisor's size, so it gets the
+// speed of the multiplication algorithms above.
+inline s64 NEWTON_DIVISION_CUTOFF = 700;
+
+// How many scratch digits v_divrem needs
+inline s64 v_divrem_scratch_size(s64 m, s64 n) {
+  s64 result = m + n + 1;
+  if (n >= NEWTON_DIVISION_CUTOFF) {
+    result += 16 * n + v_mul_scratch_size(2 * n, 2 * n) + 64;
+  }
+  return result;
+}
+
+namespace internal {
+// Schoolbook division of a[0:ma] by b[0:n], n >= 2. _b_ is normalized (the
+// top bit of b[n - 1] is set) and a[ma - 1] < b[n - 1]. The quotient goes in
+// q[0:ma-n] (if not null) and the remainder is left in a[0:n].
+inline void v_divrem_knuth(digit *q, digit *a, s64 ma, const digit *b, s64 n) {
   // We follow Knuth [The Art of Computer Programming, Vol. 2 (3rd edn.),
-  // section 4.3.1, Algorithm D]. This divides an n-word dividend by an m-word
-  // divisor and gives an n-m+1-word quotient and m-word remainder.
+  // section 4.3.1, Algorithm D]. This divides an m-word dividend by an n-word
+  // divisor and gives an m-n+1-word quotient and n-word remainder.
 
   //
   // https://skanthak.homepage.t-online.de/division.html
   // https://surface.syr.edu/cgi/viewcontent.cgi?article=1162&context=eecs_techreports
   //
 
-  s64 sizea = abs(a.Size), sizeb = abs(b.Size);
-  if (!sizeb) panic("Division by zero");
+  digit btop = b[n - 1], bnext = b[n - 2];
 
-  big_integer na, nb;  // Normalized form of _a_ and _b_; _na_ also stores the
-                       // normalized remainder in the end.
-
-  // Normalize by shifting _b_ left just enough so that its high-order
-  // bit is on, and shift _a_ left the same amount. We may have to append a
-  // high-order digit on the dividend; we do that unconditionally.
-
-  // This counts the number of leading zeros
-  auto s = SHIFT - (msb(get_digit(b, sizeb - 1)) + 1);
-
-  assert(s >= 0 && s <= 31);
-
-  na = lshift(a, s);
-  nb = lshift(b, s);
-
-  // If _a_ overflows..
-  sizea = abs(na.Size);
-
-  if (get_digit(na, sizea - 1) >= get_digit(nb, sizeb - 1)) {
-    ensure_digits(na, sizea + 1);
-    set_digit(na, sizea, 0);
-    sizea += 1;
-  }
-
-  s64 j = sizea - sizeb;
-
-  big_integer q = make_big_integer_and_set_size(j);  // _q_ holds the quotient
-
-  while (j--) {
-    digit atop = get_digit(na, j + sizeb);
-    assert(atop <= get_digit(nb, sizeb - 1));
+  for (s64 j = ma - n - 1; j >= 0; --j) {
+    digit atop = a[j + n];
+    assert(atop <= btop);
 
     // Compute estimate qhat; may overestimate by 1 (rare).
-    double_digit vv =
-        ((double_digit)atop << SHIFT) | get_digit(na, j + sizeb - 1);
+    double_digit vv = ((double_digit)atop << SHIFT) | a[j + n - 1];
 
-    digit qhat = (digit)(vv / get_digit(nb, sizeb - 1));
-    digit rhat = (digit)(vv - qhat * (double_digit)get_digit(nb, sizeb - 1));
+    digit qhat = (digit)(vv / btop);
+    digit rhat = (digit)(vv - qhat * (double_digit)btop);
 
-    while ((double_digit)get_digit(nb, sizeb - 2) * qhat >
-           (((double_digit)rhat << SHIFT) | get_digit(na, j + sizeb - 2))) {
+    while ((double_digit)bnext * qhat >
+           (((double_digit)rhat << SHIFT) | a[j + n - 2])) {
       --qhat;
-      rhat += get_digit(nb, sizeb - 1);
+      rhat += btop;
       if (rhat >= BASE) break;
     }
     assert(qhat <= BASE);
 
-    // Multiply and subtract (qhat*nb[0:sizeb] from na[j:j+sizeb+1])
-    sdouble_digit z;
+    // Multiply and subtract (qhat*b[0:n] from a[j:j+n+1])
     sdigit zhi = 0;
-
-    For(range(sizeb)) {
+    For(range(n)) {
       // Invariants: -BASE <= -qhat <= zhi <= 0;
       //             -BASE * qhat <= z < BASE
-
-      z = (sdigit)get_digit(na, it + j) + zhi -
-          (sdouble_digit)qhat * (sdouble_digit)get_digit(nb, it);
-
-      set_digit(na, it + j, z & MASK);
+      sdouble_digit z = (sdigit)a[it + j] + zhi -
+                        (sdouble_digit)qhat * (sdouble_digit)b[it];
+      a[it + j] = (digit)z & MASK;
       zhi = (sdigit)(z >> SHIFT);
     }
 
@@ -916,9 +1329,9 @@ inline div_result x_divrem(big_integer a, big_integer b) {
     // If we subtracted too much, add back.
     if ((sdigit)atop + zhi < 0) [[unlikely]] {
       digit carry = 0;
-      For(range(sizeb)) {
-        carry += get_digit(na, it + j) + get_digit(nb, it);
-        set_digit(na, it + j, carry & MASK);
+      For(range(n)) {
+        carry += a[it + j] + b[it];
+        a[it + j] = carry & MASK;
         carry >>= SHIFT;
       }
       --qhat;
@@ -926,30 +1339,196 @@ inline div_result x_divrem(big_integer a, big_integer b) {
 
     // Store quotient digit
     assert(qhat < BASE);
-    set_digit(q, j, qhat);
+    if (q) q[j] = qhat;
+  }
+}
+
+inline s64 v_trimmed_size(const digit *x, s64 n) {
+  while (n > 0 && !x[n - 1]) --n;
+  return n;
+}
+
+// R[0:n+1] = an approximation of BASE^(2n) / b[0:n] from below, off by at
+// most 2. _b_ must be normalized.
+//
+// Newton's iteration for 1/b is r' = r + r * (1 - b * r). Each step doubles
+// the correct digits, so we start from the reciprocal of the top half of _b_
+// (computed the same way) and do a single step at full size. Starting from
+// below, the iteration stays below (we round down), so everything is
+// unsigned.
+inline void v_reciprocal(digit *R, const digit *b, s64 n,
+                         big_integer_scratch *scratch) {
+  s64 mark = scratch->Used;
+
+  if (n < max(NEWTON_DIVISION_CUTOFF, 3)) {
+    // (BASE^(2n) - 1) / b with schoolbook division
+    digit *a = scratch_take(scratch, 2 * n + 1);
+    For(range(2 * n)) a[it] = MASK;
+    a[2 * n] = 0;
+
+    v_divrem_knuth(R, a, 2 * n + 1, b, n);
+
+    scratch->Used = mark;
+    return;
   }
 
-  // Unnormalize the remainder, which was stored in _na_ during the computation.
-  na.Size = sizeb;
-  big_integer r = rshift(na, s);
+  // The top half gets an extra digit of precision, which makes up for the
+  // rounding errors of the step
+  s64 h = n / 2 + 1, k = n - h;
 
-  normalize(q);
-  normalize(r);
+  // R0 = (Rh - 4) * BASE^k, Rh is the reciprocal of b's top h digits.
+  // Rh * BASE^k is less than 4 * BASE^k above BASE^(2n) / b, so R0 is below.
+  digit *rh = R + k;
+  v_reciprocal(rh, b + k, h, scratch);
 
-  return {q, r};
+  digit four = 4;
+  v_isub(rh, h + 1, &four, 1);
+  memset0(R, k * sizeof(digit));
+
+  s64 sizerh = v_trimmed_size(rh, h + 1);
+
+  // e = BASE^(2n) - b * R0
+  digit *e = scratch_take(scratch, 2 * n + 1);
+  memset0(e, (2 * n + 1) * sizeof(digit));
+  v_mul(e + k, b, n, rh, sizerh, scratch);
+
+  if (!e[2 * n]) {
+    // Otherwise b * R0 is exactly BASE^(2n) and R0 is the answer
+    v_complement(e, e, 2 * n);
+
+    // R += R0 * e / BASE^(2n). The low n - 1 digits of _e_ change the sum
+    // by less than 1, so they are dropped (which keeps R below).
+    s64 drop = n - 1;
+    s64 sizee = v_trimmed_size(e + drop, 2 * n - drop);
+
+    digit *t = scratch_take(scratch, sizerh + sizee);
+    v_mul(t, rh, sizerh, e + drop, sizee, scratch);
+
+    s64 offset = 2 * n - k - drop, sizet = sizerh + sizee;
+    if (sizet > offset) v_iadd(R, n + 1, t + offset, sizet - offset);
+  }
+
+  scratch->Used = mark;
 }
 
-// Compute two's complement of digit vector a[0:m], writing result to
-// z[0:m]. The digit vector a need not be normalized, but should not
-// be entirely zero. a and z may point to the same digit vector. */
-inline void v_complement(digit *z, digit *a, s64 m) {
-  digit carry = 1;
-  For(range(m)) {
-    carry += a[it] ^ MASK;
-    z[it] = carry & MASK;
-    carry >>= SHIFT;
+// Division of a[0:ma] by b[0:n] with the reciprocal R[0:n+1] (see
+// v_reciprocal). Same arguments and results as v_divrem_knuth.
+//
+// The quotient is computed in blocks of n digits from the top. Each step
+// divides the current remainder with the next block of the dividend appended
+// (less than b * BASE^n). The quotient of a step is estimated by multiplying
+// the top n + 1 digits with R and corrected by a few subtractions.
+inline void v_divrem_newton(digit *q, digit *a, s64 ma, const digit *b, s64 n,
+                            const digit *R, big_integer_scratch *scratch) {
+  s64 mark = scratch->Used;
+
+  s64 sizer = v_trimmed_size(R, n + 1);
+
+  digit *t = scratch_take(scratch, 2 * n + 2);
+  digit *p = scratch_take(scratch, 2 * n);
+  digit *qb = scratch_take(scratch, n + 1);
+
+  // The quotient digits left to compute are q[0:top]
+  s64 top = ma - n;
+  while (top > 0) {
+    s64 count = min(n, top);
+    s64 offset = top - count;
+
+    digit *window = a + offset;
+    s64 sizewindow = count + n;
+
+    memset0(qb, (n + 1) * sizeof(digit));
+
+    // qb = (window / BASE^(n-1)) * R / BASE^(n+1), at most 3 less than the
+    // real quotient (and never more)
+    s64 sizehigh = v_trimmed_size(window + n - 1, count + 1);
+    if (sizehigh) {
+      v_mul(t, window + n - 1, sizehigh, R, sizer, scratch);
+
+      s64 sizet = sizehigh + sizer;
+      if (sizet > n + 1) {
+        s64 sizeqb = v_trimmed_size(t + n + 1, sizet - n - 1);
+        assert(sizeqb <= count);
+        memcpy(qb, t + n + 1, sizeqb * sizeof(digit));
+
+        if (sizeqb) {
+          v_mul(p, qb, sizeqb, b, n, scratch);
+          digit borrow = v_isub(window, sizewindow, p, sizeqb + n);
+          assert(!borrow);
+        }
+      }
+    }
+
+    digit one = 1;
+    while (v_compare(window, v_trimmed_size(window, sizewindow), b, n) >= 0) {
+      v_isub(window, sizewindow, b, n);
+      v_iadd(qb, n + 1, &one, 1);
+    }
+
+    if (q) memcpy(q + offset, qb, count * sizeof(digit));
+    top = offset;
   }
-  assert(carry == 0);
+
+  scratch->Used = mark;
+}
+}  // namespace internal
+
+// x[0:m] / y[0:n], m >= n >= 2 and y[n - 1] != 0. The quotient goes in
+// q[0:m-n+1] and the remainder in r[0:n] (either can be null). q and r may
+// overlap x and y. Temporaries are taken from _scratch_ (see
+// v_divrem_scratch_size).
+inline void v_divrem(digit *q, digit *r, const digit *x, s64 m, const digit *y,
+                     s64 n, big_integer_scratch *scratch) {
+  assert(m >= n && n >= 2 && y[n - 1]);
+
+  s64 mark = scratch->Used;
+
+  // Normalize by shifting _y_ left just enough so that its high-order bit is
+  // on, and shift _x_ left the same amount. We always append a high-order
+  // digit to the dividend (it's smaller than the top digit of _b_, so the
+  // invariant of the loop holds). _a_ also stores the remainder in the end.
+  digit *a = internal::scratch_take(scratch, m + 1);
+  digit *b = internal::scratch_take(scratch, n);
+
+  // This counts the number of leading zeros
+  u32 s = SHIFT - (msb(y[n - 1]) + 1);
+
+  v_lshift(b, y, n, s);
+  a[m] = v_lshift(a, x, m, s);
+
+  if (n >= NEWTON_DIVISION_CUTOFF && m - n + 1 >= NEWTON_DIVISION_CUTOFF) {
+    digit *R = internal::scratch_take(scratch, n + 1);
+    internal::v_reciprocal(R, b, n, scratch);
+    internal::v_divrem_newton(q, a, m + 1, b, n, R, scratch);
+  } else {
+    internal::v_divrem_knuth(q, a, m + 1, b, n);
+  }
+
+  // Unnormalize the remainder
+  if (r) v_rshift(r, a, n, s);
+
+  scratch->Used = mark;
+}
+
+inline div_result x_divrem(big_integer a, big_integer b) {
+  s64 sizea = abs(a.Size), sizeb = abs(b.Size);
+  if (!sizeb) panic("Division by zero");
+
+  if (sizea < sizeb) return {make_big(0), a};
+
+  big_integer q = make_big_integer_and_set_size(sizea - sizeb + 1);
+  big_integer r = make_big_integer_and_set_size(sizeb);
+
+  big_integer_scratch scratch;
+  internal::scratch_reserve(&scratch, v_divrem_scratch_size(sizea, sizeb));
+  v_divrem(get_digits(q), get_digits(r), get_digits(a), sizea, get_digits(b),
+           sizeb, &scratch);
+  free(scratch);
+
+  normalize(q);
+  normalize(r);
+
+  return {q, r};
 }
 
 // _op_ is one of the following: '&', '|', '^'
@@ -1069,26 +1648,7 @@ inline big_integer operator^(big_integer lhs, big_integer rhs) {
   return bitwise(lhs, '^', rhs);
 }
 
-inline big_integer add_one(big_integer b) {
-  if (!b.Size) return make_big(1);
-
-  s64 size = abs(b.Size);
-
-  digit carry = (get_digit(b, size) + 1) >> SHIFT;
-  if (carry) ++size;
-
-  big_integer result = make_big_integer_and_set_size(size);
-  memcpy(get_digits(result), get_digits(b), abs(b.Size) * sizeof(digit));
-
-  if (carry) {
-    set_digit(result, size - 2, 0);
-    set_digit(result, size - 1, 1);
-  } else {
-    // set_digit(result, size - 1, get_digit(result, size - 1) + 1);
-    ++*(get_digits(result) + size - 1);
-  }
-  return result;
-}
+inline big_integer add_one(big_integer b) { return b + make_big(1); }
 
 inline big_integer invert(big_integer b) {
   big_integer result = add_one(b);
@@ -1224,22 +1784,12 @@ inline div_result divmod(big_integer lhs, big_integer rhs) {
   }
 }
 
-inline s32 compare(big_integer a, big_integer b_) {
-  big_integer b = make_big(b_);
+inline s32 compare(big_integer a, big_integer b) {
+  if (a.Size != b.Size) return a.Size < b.Size ? -1 : 1;
 
-  s32 sign = (s32)(a.Size - b.Size);
-  if (sign == 0) {
-    if (!a.Size) return 0;  // Two zeroes
-
-    s64 i = abs(a.Size);
-    sdigit diff = 0;
-    while (--i >= 0) {
-      diff = (sdigit)get_digit(a, i) - (sdigit)get_digit(b, i);
-      if (diff) break;
-    }
-    sign = a.Size < 0 ? -1 : 1;
-  }
-  return sign;
+  s32 result =
+      v_compare(get_digits(a), abs(a.Size), get_digits(b), abs(b.Size));
+  return a.Size < 0 ? -result : result;
 }
 
 inline big_integer operator+(big_integer lhs, big_integer rhs) {
@@ -1279,7 +1829,19 @@ inline big_integer operator-(big_integer lhs, big_integer rhs) {
 }
 
 inline big_integer operator*(big_integer lhs, big_integer rhs) {
-  big_integer result = k_mul(&lhs, &rhs);
+  s64 sizea = abs(lhs.Size), sizeb = abs(rhs.Size);
+  if (!sizea || !sizeb) return make_big(0);
+
+  big_integer result = make_big_integer_and_set_size(sizea + sizeb);
+
+  big_integer_scratch scratch;
+  internal::scratch_reserve(&scratch, v_mul_scratch_size(sizea, sizeb));
+  v_mul(get_digits(result), get_digits(lhs), sizea, get_digits(rhs), sizeb,
+        &scratch);
+  free(scratch);
+
+  normalize(result);
+
   // Negate if exactly one of the inputs is negative
   if ((lhs.Size ^ rhs.Size) < 0 && result.Size) {
     result.Size = -result.Size;
@@ -1298,4 +1860,617 @@ inline big_integer operator%(big_integer lhs, big_integer rhs) {
   return mod;
 }
 
+//
+// In-place operations:
+//
+
+namespace internal {
+inline s64 big_capacity(big_integer ref b) {
+  return is_small(b) ? 2 : b.Allocated;
+}
+
+// Makes space for _n_ digits, keeping the value. Grows geometrically so
+// numbers which grow a digit at a time don't reallocate every time.
+inline void big_reserve(big_integer ref b, s64 n) {
+  if (n <= big_capacity(b)) return;
+  grow(b, n);
+}
+
+// Like normalize(), but doesn't give back the allocated digits (the in-place
+// operations reuse them).
+inline void big_trim(big_integer ref b) {
+  s64 n = abs(b.Size);
+
+  digit *d = get_digits(b);
+  while (n > 0 && !d[n - 1]) --n;
+
+  b.Size = b.Size < 0 ? -n : n;
+}
+
+// An integral value split in digits, without allocating
+struct small_digits {
+  digit Digits[5]{};  // Enough for 128 bits
+  s64 Count = 0;
+  bool Negative = false;
+};
+
+inline small_digits to_small_digits(is_integral auto v) {
+  small_digits result;
+
+  if constexpr (is_signed_integral<decltype(v)>) {
+    if (v < 0) result.Negative = true;
+  }
+
+  if constexpr (sizeof(v) == sizeof(u128)) {
+    auto u = v;
+    if (result.Negative) u = -u;
+
+    while (u) {
+      result.Digits[result.Count++] = u.lo & MASK;
+      u >>= SHIFT;
+    }
+  } else {
+    // Works for the min value of signed types too
+    u64 u = (u64)v;
+    if (result.Negative) u = 0 - u;
+
+    while (u) {
+      result.Digits[result.Count++] = u & MASK;
+      u >>= SHIFT;
+    }
+  }
+  return result;
+}
+
+// a += y[0:n] (or -= if _negative_). _y_ may point to the digits of _a_.
+inline void big_add_digits(big_integer ref a, const digit *y, s64 n,
+                           bool negative) {
+  while (n > 0 && !y[n - 1]) --n;
+  if (!n) return;
+
+  s64 m = abs(a.Size);
+  bool aNeg = m ? a.Size < 0 : negative;
+  bool aliased = y == get_digits(a);
+
+  s64 size = max(m, n) + (aNeg == negative);
+  big_reserve(a, size);
+
+  digit *x = get_digits(a);
+  if (aliased) y = x;
+  memset0(x + m, (size - m) * sizeof(digit));
+
+  if (aNeg == negative) {
+    v_iadd(x, size, y, n);
+  } else if (v_compare(x, m, y, n) >= 0) {
+    v_isub(x, size, y, n);
+  } else {
+    // |y| > |a|, the sign flips
+    v_rsub(x, y, n);
+    aNeg = negative;
+  }
+
+  a.Size = aNeg ? -size : size;
+  big_trim(a);
+}
+
+// a *= d (d is a single digit)
+inline void big_mul1(big_integer ref a, digit d, bool negative) {
+  s64 m = abs(a.Size);
+  if (!m || !d) {
+    a.Size = 0;
+    return;
+  }
+
+  big_reserve(a, m + 1);
+  digit *x = get_digits(a);
+
+  double_digit carry = 0;
+  For(range(m)) {
+    carry += (double_digit)x[it] * d;
+    x[it] = (digit)(carry & MASK);
+    carry >>= SHIFT;
+  }
+  x[m] = (digit)carry;
+
+  a.Size = (a.Size < 0) != negative ? -(m + 1) : m + 1;
+  big_trim(a);
+}
+
+// a += y[0:n] * d (or -= if _negative_). _y_ may point to the digits of _a_.
+inline void big_addmul1(big_integer ref a, const digit *y, s64 n, digit d,
+                        bool negative) {
+  while (n > 0 && !y[n - 1]) --n;
+  if (!n || !d) return;
+
+  s64 m = abs(a.Size);
+  bool aNeg = m ? a.Size < 0 : negative;
+  bool aliased = y == get_digits(a);
+
+  s64 size = max(m, n + 1) + 1;
+  big_reserve(a, size);
+
+  digit *x = get_digits(a);
+  if (aliased) y = x;
+  memset0(x + m, (size - m) * sizeof(digit));
+
+  if (aNeg == negative) {
+    double_digit carry = 0;
+
+    s64 i = 0;
+    for (; i < n; ++i) {
+      carry += x[i] + (double_digit)y[i] * d;
+      x[i] = (digit)(carry & MASK);
+      carry >>= SHIFT;
+    }
+    for (; carry; ++i) {
+      carry += x[i];
+      x[i] = (digit)(carry & MASK);
+      carry >>= SHIFT;
+    }
+  } else {
+    digit borrow = 0;
+
+    s64 i = 0;
+    for (; i < n; ++i) {
+      double_digit p = (double_digit)y[i] * d + borrow;
+
+      digit lo = (digit)(p & MASK);
+      borrow = (digit)(p >> SHIFT);
+
+      if (x[i] < lo) ++borrow;
+      x[i] = (x[i] - lo) & MASK;
+    }
+    for (; borrow && i < size; ++i) {
+      digit b = x[i] < borrow;
+      x[i] = (x[i] - borrow) & MASK;
+      borrow = b;
+    }
+
+    if (borrow) {
+      // |y * d| > |a|, what we have is the two's complement of the result
+      v_complement(x, x, size);
+      aNeg = negative;
+    }
+  }
+
+  a.Size = aNeg ? -size : size;
+  big_trim(a);
+}
+
+// a *= y[0:n]. _y_ may point to the digits of _a_ (squares a).
+inline void big_mul_digits(big_integer ref a, const digit *y, s64 n,
+                           bool negative, big_integer_scratch *scratch) {
+  while (n > 0 && !y[n - 1]) --n;
+
+  s64 m = abs(a.Size);
+  if (!m || !n) {
+    a.Size = 0;
+    return;
+  }
+
+  if (n == 1) {
+    big_mul1(a, y[0], negative);
+    return;
+  }
+
+  big_integer_scratch local;
+  if (!scratch) scratch = &local;
+  defer(free(local));
+
+  scratch_reserve(scratch, m + n + v_mul_scratch_size(m, n));
+
+  digit *product = scratch_take(scratch, m + n);
+  v_mul(product, get_digits(a), m, y, n, scratch);
+  scratch->Used = 0;
+
+  big_reserve(a, m + n);
+  memcpy(get_digits(a), product, (m + n) * sizeof(digit));
+
+  a.Size = (a.Size < 0) != negative ? -(m + n) : m + n;
+  big_trim(a);
+}
+
+// a += x[0:m] * y[0:n] (or -= if _negative_)
+inline void big_fma_digits(big_integer ref a, const digit *x, s64 m,
+                           const digit *y, s64 n, bool negative,
+                           big_integer_scratch *scratch) {
+  while (m > 0 && !x[m - 1]) --m;
+  while (n > 0 && !y[n - 1]) --n;
+  if (!m || !n) return;
+
+  if (n == 1) {
+    big_addmul1(a, x, m, y[0], negative);
+    return;
+  }
+  if (m == 1) {
+    big_addmul1(a, y, n, x[0], negative);
+    return;
+  }
+
+  big_integer_scratch local;
+  if (!scratch) scratch = &local;
+  defer(free(local));
+
+  scratch_reserve(scratch, m + n + v_mul_scratch_size(m, n));
+
+  digit *product = scratch_take(scratch, m + n);
+  v_mul(product, x, m, y, n, scratch);
+  big_add_digits(a, product, m + n, negative);
+  scratch->Used = 0;
+}
+
+enum big_div_mode { QUOTIENT, MODULO };
+
+// In QUOTIENT mode: a = trunc(a / y[0:n]), returns the low 64 bits of the
+// remainder (with the sign of a). In MODULO mode: a = a mod y[0:n] (the
+// result has the sign of the divisor, see divmod), returns 0.
+inline s64 big_divrem_digits(big_integer ref a, const digit *y, s64 n,
+                             bool negative, big_div_mode mode,
+                             big_integer_scratch *scratch) {
+  while (n > 0 && !y[n - 1]) --n;
+  if (!n) panic("Division by zero");
+
+  s64 m = abs(a.Size);
+  bool aNeg = a.Size < 0;
+
+  digit *x = get_digits(a);
+
+  u64 rem = 0;
+  if (m < n) {
+    // The quotient is 0 and the remainder is _a_
+    For(range(min(m, 3))) rem |= (u64)x[it] << (it * SHIFT);
+    if (mode == QUOTIENT) a.Size = 0;
+  } else if (n == 1) {
+    rem = inplace_divrem1(x, x, m, y[0]);
+    if (mode == QUOTIENT) {
+      a.Size = aNeg != negative ? -m : m;
+    } else {
+      x[0] = (digit)rem;
+      a.Size = aNeg ? -1 : 1;
+    }
+    big_trim(a);
+  } else {
+    big_integer_scratch local;
+    if (!scratch) scratch = &local;
+    defer(free(local));
+
+    s64 sizeq = m - n + 1;
+    scratch_reserve(scratch, sizeq + n + v_divrem_scratch_size(m, n));
+
+    digit *q = scratch_take(scratch, sizeq);
+    digit *r = scratch_take(scratch, n);
+    v_divrem(q, r, x, m, y, n, scratch);
+    scratch->Used = 0;
+
+    For(range(min(n, 3))) rem |= (u64)r[it] << (it * SHIFT);
+
+    if (mode == QUOTIENT) {
+      memcpy(x, q, sizeq * sizeof(digit));
+      a.Size = aNeg != negative ? -sizeq : sizeq;
+    } else {
+      memcpy(x, r, n * sizeof(digit));
+      a.Size = aNeg ? -n : n;
+    }
+    big_trim(a);
+  }
+
+  if (mode == QUOTIENT) return aNeg ? -(s64)rem : (s64)rem;
+
+  // Turn the remainder into a modulus
+  if (a.Size && aNeg != negative) big_add_digits(a, y, n, negative);
+  return 0;
+}
+}  // namespace internal
+
+inline bool assign(big_integer ref b, big_integer v) {
+  s64 n = abs(v.Size);
+
+  // Already share the digits (e.g. a copy of _v_)
+  if (n && get_digits(b) == get_digits(v)) {
+    b.Size = v.Size;
+    return true;
+  }
+
+  internal::big_reserve(b, n);
+  memcpy(get_digits(b), get_digits(v), n * sizeof(digit));
+  b.Size = v.Size;
+  return true;
+}
+
+inline void add_assign(big_integer ref a, big_integer b) {
+  internal::big_add_digits(a, get_digits(b), abs(b.Size), b.Size < 0);
+}
+
+inline void add_assign(big_integer ref a, is_integral auto b) {
+  auto d = internal::to_small_digits(b);
+  internal::big_add_digits(a, d.Digits, d.Count, d.Negative);
+}
+
+inline void sub_assign(big_integer ref a, big_integer b) {
+  internal::big_add_digits(a, get_digits(b), abs(b.Size), b.Size > 0);
+}
+
+inline void sub_assign(big_integer ref a, is_integral auto b) {
+  auto d = internal::to_small_digits(b);
+  internal::big_add_digits(a, d.Digits, d.Count, !d.Negative);
+}
+
+inline void mul_assign(big_integer ref a, big_integer b,
+                       big_integer_scratch *scratch) {
+  internal::big_mul_digits(a, get_digits(b), abs(b.Size), b.Size < 0,
+                           scratch);
+}
+
+inline void mul_assign(big_integer ref a, is_integral auto b,
+                       big_integer_scratch *scratch) {
+  auto d = internal::to_small_digits(b);
+  internal::big_mul_digits(a, d.Digits, d.Count, d.Negative, scratch);
+}
+
+inline void fma_assign(big_integer ref a, big_integer b, big_integer c,
+                       big_integer_scratch *scratch) {
+  internal::big_fma_digits(a, get_digits(b), abs(b.Size), get_digits(c),
+                           abs(c.Size), (b.Size < 0) != (c.Size < 0),
+                           scratch);
+}
+
+inline void fma_assign(big_integer ref a, big_integer b, is_integral auto c,
+                       big_integer_scratch *scratch) {
+  auto d = internal::to_small_digits(c);
+  internal::big_fma_digits(a, get_digits(b), abs(b.Size), d.Digits, d.Count,
+                           (b.Size < 0) != d.Negative, scratch);
+}
+
+inline void div_assign(big_integer ref a, big_integer b,
+                       big_integer_scratch *scratch) {
+  internal::big_divrem_digits(a, get_digits(b), abs(b.Size), b.Size < 0,
+                              internal::QUOTIENT, scratch);
+}
+
+inline s64 div_assign(big_integer ref a, is_integral auto b,
+                      big_integer_scratch *scratch) {
+  auto d = internal::to_small_digits(b);
+  return internal::big_divrem_digits(a, d.Digits, d.Count, d.Negative,
+                                     internal::QUOTIENT, scratch);
+}
+
+inline void mod_assign(big_integer ref a, big_integer b,
+                       big_integer_scratch *scratch) {
+  internal::big_divrem_digits(a, get_digits(b), abs(b.Size), b.Size < 0,
+                              internal::MODULO, scratch);
+}
+
+//
+// Conversion to text:
+//
+
+// Below this many digits to_chars() divides by the largest power of the base
+// that fits in a digit over and over, which is quadratic
+inline s64 TO_CHARS_CUTOFF = 15;
+
+// Numbers with at most this many digits (about 289 decimal digits) are
+// converted by to_chars() without allocating
+const s64 TO_CHARS_STACK_DIGITS = 32;
+
+namespace internal {
+struct to_chars_state {
+  const char *Alphabet;
+  u32 Base;
+
+  digit Chunk;  // The largest power of the base which fits in a digit
+  s64 ChunkChars;
+
+  // Powers[i] = Chunk^(2^i), shifted left by Shifts[i] bits so the top bit
+  // is set (ready for division). Reciprocals[i] is null if the power is too
+  // small for Newton division.
+  digit *Powers[64];
+  s64 PowerSizes[64];
+  u32 Shifts[64];
+  digit *Reciprocals[64];
+  s64 Levels;
+
+  big_integer_scratch *Scratch;
+};
+
+// Writes x[0:m] to the characters which end at _end_ and returns where they
+// start. If _width_ is not 0 the result is padded with zeros to that many
+// characters (the low halves of a split). Destroys _x_.
+inline char *to_chars_basecase(to_chars_state *s, char *end, digit *x, s64 m,
+                               s64 width) {
+  char *p = end;
+
+  m = v_trimmed_size(x, m);
+  while (m) {
+    digit rem = inplace_divrem1(x, x, m, s->Chunk);
+    m = v_trimmed_size(x, m);
+
+    For(range(s->ChunkChars)) {
+      *--p = s->Alphabet[rem % s->Base];
+      rem /= s->Base;
+
+      // No leading zeros in the top chunk
+      if (!m && !rem && !width) break;
+    }
+  }
+
+  while (end - p < width) *--p = '0';
+  return p;
+}
+
+inline char *to_chars_recursive(to_chars_state *s, char *end, const digit *x,
+                                s64 m, s64 width) {
+  auto *scratch = s->Scratch;
+  s64 mark = scratch->Used;
+
+  m = v_trimmed_size(x, m);
+
+  // At least 3 digits, so there is always a power to split at
+  if (m <= max(TO_CHARS_CUTOFF, 2)) {
+    digit *copy = scratch_take(scratch, m);
+    memcpy(copy, x, m * sizeof(digit));
+    char *p = to_chars_basecase(s, end, copy, m, width);
+
+    scratch->Used = mark;
+    return p;
+  }
+
+  // Split at the largest power with at most half as many digits
+  s64 level = s->Levels - 1;
+  while (s->PowerSizes[level] > (m + 1) / 2) --level;
+
+  s64 n = s->PowerSizes[level];
+
+  digit *q = scratch_take(scratch, m - n + 1);
+  digit *r = scratch_take(scratch, n);
+
+  if (n == 1) {
+    r[0] = inplace_divrem1(q, x, m, s->Chunk);
+  } else {
+    s64 divMark = scratch->Used;
+
+    u32 shift = s->Shifts[level];
+
+    digit *a = scratch_take(scratch, m + 1);
+    a[m] = v_lshift(a, x, m, shift);
+
+    digit *R = s->Reciprocals[level];
+    if (R && m - n + 1 >= NEWTON_DIVISION_CUTOFF) {
+      v_divrem_newton(q, a, m + 1, s->Powers[level], n, R, scratch);
+    } else {
+      v_divrem_knuth(q, a, m + 1, s->Powers[level], n);
+    }
+    v_rshift(r, a, n, shift);
+
+    scratch->Used = divMark;
+  }
+
+  s64 lowWidth = s->ChunkChars << level;
+
+  char *p = to_chars_recursive(s, end, r, n, lowWidth);
+  p = to_chars_recursive(s, p, q, m - n + 1, width ? width - lowWidth : 0);
+
+  scratch->Used = mark;
+  return p;
+}
+}  // namespace internal
+
+inline s64 to_chars_size(big_integer b, u32 base) {
+  assert(base >= 2 && base <= 36);
+  return abs(b.Size) * SHIFT / msb(base) + 2;
+}
+
+inline s64 to_chars(char *out, big_integer b, u32 base, bool upperCase,
+                    big_integer_scratch *scratch) {
+  assert(base >= 2 && base <= 36);
+
+  const char *alphabet = upperCase ? "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                                   : "0123456789abcdefghijklmnopqrstuvwxyz";
+
+  char *p = out;
+  if (b.Size < 0) *p++ = '-';
+
+  s64 n = abs(b.Size);
+  const digit *x = get_digits(b);
+
+  if (!n) {
+    *p++ = '0';
+    return p - out;
+  }
+
+  if (is_pow_of_2(base)) {
+    u32 bits = msb(base);
+
+    s64 totalBits = (n - 1) * SHIFT + msb(x[n - 1]) + 1;
+    for (s64 i = (totalBits + bits - 1) / bits - 1; i >= 0; --i) {
+      s64 bit = i * bits;
+      s64 d = bit / SHIFT;
+      u32 offset = bit % SHIFT;
+
+      double_digit v = x[d] >> offset;
+      if (offset + bits > SHIFT && d + 1 < n) {
+        v |= (double_digit)x[d + 1] << (SHIFT - offset);
+      }
+      *p++ = alphabet[v & (base - 1)];
+    }
+    return p - out;
+  }
+
+  internal::to_chars_state s;
+  s.Alphabet = alphabet;
+  s.Base = base;
+
+  s.Chunk = base;
+  s.ChunkChars = 1;
+  while ((double_digit)s.Chunk * base < BASE) {
+    s.Chunk *= base;
+    ++s.ChunkChars;
+  }
+
+  // Written backwards from the end of the buffer, then moved to the front
+  char *end = out + to_chars_size(b, base);
+
+  if (n <= TO_CHARS_STACK_DIGITS) {
+    // Small enough for the quadratic loop, which only needs a copy to
+    // divide in place
+    digit copy[TO_CHARS_STACK_DIGITS];
+    memcpy(copy, x, n * sizeof(digit));
+
+    char *start = internal::to_chars_basecase(&s, end, copy, n, 0);
+
+    s64 count = end - start;
+    memmove(p, start, count);
+    return p + count - out;
+  }
+
+  big_integer_scratch localScratch;
+  if (!scratch) scratch = &localScratch;
+  defer(free(localScratch));
+
+  internal::scratch_reserve(scratch,
+                            16 * n + v_mul_scratch_size(2 * n, 2 * n) + 1024);
+  s.Scratch = scratch;
+
+  // Square the chunk until it's too large to split _b_ at
+  digit *power = internal::scratch_take(scratch, 1);
+  power[0] = s.Chunk;
+  s64 size = 1;
+
+  s.Levels = 0;
+  while (true) {
+    s.Powers[s.Levels] = power;
+    s.PowerSizes[s.Levels] = size;
+    ++s.Levels;
+
+    if (2 * size - 1 > (n + 1) / 2) break;
+
+    digit *next = internal::scratch_take(scratch, 2 * size);
+    v_mul(next, power, size, power, size, scratch);
+
+    power = next;
+    size = internal::v_trimmed_size(next, 2 * size);
+  }
+
+  For(range(s.Levels)) {
+    digit *pow = s.Powers[it];
+    s64 powSize = s.PowerSizes[it];
+
+    s.Shifts[it] = SHIFT - (msb(pow[powSize - 1]) + 1);
+    v_lshift(pow, pow, powSize, s.Shifts[it]);
+
+    s.Reciprocals[it] = null;
+    if (powSize >= NEWTON_DIVISION_CUTOFF) {
+      s.Reciprocals[it] = internal::scratch_take(scratch, powSize + 1);
+      internal::v_reciprocal(s.Reciprocals[it], pow, powSize, scratch);
+    }
+  }
+
+  char *start = internal::to_chars_recursive(&s, end, x, n, 0);
+
+  s64 count = end - start;
+  memmove(p, start, count);
+
+  scratch->Used = 0;
+  return p + count - out;
+}
+
 LSTD_END_NAMESPACE
@@ -0,0 +1,389 @@
+#pragma once
+
+#include "fmt.h"
+#include "os.h"
+
+LSTD_BEGIN_NAMESPACE
+
+//
+// Binary logging with deferred formatting.
+//
+// Most log lines are never read, so formatting them on the hot path is wasted
+// work. log_binary() instead appends a record with the ID of the format string
+// and the raw argument bytes to a buffer. Rendering the text happens later,
+// when (and if) you decode the buffer, with the same fmt_parse_and_format()
+// that print uses. On the logging side it's about as cheap as a memcpy.
+//
+//      log_binary(FMT("Loaded {} ({} bytes) in {:.3f} ms\n"), path, size, ms);
+//      ...
+//      // E.g. at the end of a frame, on a crash, or from another thread
+//      flush(&ThreadBinaryLog, &cout);
+//
+// The format string must be a literal wrapped in FMT (see fmt/compiled.h).
+// Each distinct format string gets an ID on its first use (the IDs are only
+// valid in this process).
+//
+// A binary_log is not thread-safe. _ThreadBinaryLog_ is the calling thread's
+// log, which is what log_binary() without an explicit log writes to. To
+// decode on another thread, move the buffer out with take_buffer() and give
+// it to that thread. Its buffer is freed when the thread exits (threads
+// created with create_and_launch_thread), records which weren't flushed or
+// taken are lost.
+//
+// Decoding offline (in another process) also needs the format strings. Save
+// them with write_binary_log_formats() and load them with
+// read_binary_log_formats():
+//
+//      string records = take_buffer(&ThreadBinaryLog);
+//      os_write_to_file("log.bin", records, file_write_mode::Append);
+//
+//      string formats;
+//      reserve(formats);
+//      auto w = string_writer(&formats);
+//      write_binary_log_formats(&w);
+//      os_write_to_file("log.formats", formats, file_write_mode::Overwrite_Entire);
+//
+//      // Later, in another program:
+//      auto [formats, success] = read_binary_log_formats(formatsFileContents);
+//      decode_binary_log(&cout, logFileContents, formats);
+//
+// Arguments are stored by value: integers, floats, bools and pointers as
+// their bits, strings as their bytes (so they may be freed after logging).
+// Types with a custom formatter can't be stored like that, so they are
+// formatted to text when logged (without the specs, e.g. a width in the
+// format string applies to the formatted text).
+//
+// Record layout (native byte order):
+//   u32 Size      - of the whole record, including this header
+//   u32 FormatID
+//   for each argument:
+//     u8 Type (fmt_type)
+//     S64, U64, BOOL, POINTER: 8 bytes
+//     F32: 4 bytes, F64: 8 bytes
+//     STRING: s64 Count and then Count bytes
+//
+
+// Initial size of a log's buffer, it grows as needed
+const s64 BINARY_LOG_BUFFER_SIZE = 64_KiB;
+
+// Max arguments in one record
+const s64 BINARY_LOG_MAX_ARGS = 32;
+
+struct binary_log {
+  array<byte> Buffer;
+};
+
+inline thread_local binary_log ThreadBinaryLog;
+
+namespace internal {
+struct binary_log_record_header {
+  u32 Size;
+  u32 FormatID;
+};
+
+struct binary_log_formats {
+  mutex Mutex = create_mutex();
+  array<string> Strings;  // Indexed by ID, point to the literals in FMT
+};
+
+inline binary_log_formats *get_binary_log_formats() {
+  static binary_log_formats formats;
+  return &formats;
+}
+
+inline u32 binary_log_register_format(string fmtString) {
+  auto *formats = get_binary_log_formats();
+
+  lock(&formats->Mutex);
+  defer(unlock(&formats->Mutex));
+
+  if (!formats->Strings.Allocated) {
+    reserve(formats->Strings, 0, platform_get_persistent_allocator());
+  }
+  add(formats->Strings, fmtString);
+  return (u32) (formats->Strings.Count - 1);
+}
+
+// Returns the format's ID, registered the first time this is called
+template <fmt_string_literal S>
+u32 binary_log_format_id() {
+  static const u32 id = binary_log_register_format(
+      string(fmt_compiled_string<S>::Literal.Data, S.Count));
+  return id;
+}
+
+inline thread_local bool ThreadBinaryLogFreeScheduled = false;
+
+inline void binary_log_free_thread_log(void *) {
+  free(ThreadBinaryLog.Buffer);
+}
+
+inline void binary_log_reserve(binary_log *log, s64 size) {
+  auto ref b = log->Buffer;
+  if (b.Count + size <= b.Allocated) return;
+
+  if (!b.Allocated) {
+    if (log == &ThreadBinaryLog && !ThreadBinaryLogFreeScheduled) {
+      ThreadBinaryLogFreeScheduled =
+          thread_exit_schedule(&binary_log_free_thread_log);
+    }
+    reserve(b, max(size, BINARY_LOG_BUFFER_SIZE));
+  } else {
+    maybe_grow(b, size);
+  }
+}
+
+inline void binary_log_append(binary_log *log, const void *data, s64 size) {
+  binary_log_reserve(log, size);
+  memcpy(log->Buffer.Data + log->Buffer.Count, data, size);
+  log->Buffer.Count += size;
+}
+
+// Bytes the argument takes in the record, not counting the text of strings
+// (and custom types, which are stored as strings)
+template <typename T>
+constexpr s64 binary_log_fixed_arg_size() {
+  return fmt_mapped_type_constant_v<T> == fmt_type::F32 ? 1 + 4 : 1 + 8;
+}
+
+// Appends the custom argument formatted as text
+struct binary_log_writer : writer {
+  binary_log *Log;
+  s64 Count = 0;
+
+  binary_log_writer(binary_log *log) : Log(log) {}
+
+  void write(const char *data, s64 count) override {
+    binary_log_append(Log, data, count);
+    Count += count;
+  }
+  void flush() override {}
+};
+
+template <typename T>
+void binary_log_write_arg(binary_log *log, T no_copy arg) {
+  constexpr auto type = fmt_mapped_type_constant_v<T>;
+
+  byte t = (byte) (type == fmt_type::CUSTOM ? fmt_type::STRING : type);
+  binary_log_append(log, &t, 1);
+
+  if constexpr (type == fmt_type::CUSTOM) {
+    // Reserve the count and patch it after formatting
+    s64 countAt = log->Buffer.Count;
+    binary_log_reserve(log, 8);
+    log->Buffer.Count += 8;
+
+    binary_log_writer w(log);
+    fmt_to_writer(&w, "{}", arg);
+    memcpy(log->Buffer.Data + countAt, &w.Count, 8);
+  } else {
+    auto value = fmt_map_arg(arg);
+    if constexpr (type == fmt_type::STRING) {
+      string s = value;
+      binary_log_append(log, &s.Count, 8);
+      binary_log_append(log, s.Data, s.Count);
+    } else if constexpr (type == fmt_type::F32 || type == fmt_type::F64) {
+      binary_log_append(log, &value, sizeof(value));
+    } else if constexpr (type == fmt_type::POINTER) {
+      u64 bits = (u64) value;
+      binary_log_append(log, &bits, 8);
+    } else {
+      // S64, U64 and BOOL (stored in S64, like in fmt_value)
+      s64 bits = (s64) value;
+      binary_log_append(log, &bits, 8);
+    }
+  }
+}
+}  // namespace internal
+
+template <fmt_string_literal S, typename... Args>
+void log_binary(binary_log *log, fmt_compiled_string<S>,
+                Args no_copy... arguments) {
+  static_assert(sizeof...(Args) <= BINARY_LOG_MAX_ARGS,
+                "Too many arguments for a binary log record");
+
+  u32 id = internal::binary_log_format_id<S>();
+
+  // Grow once for everything that we know the size of
+  s64 size = sizeof(internal::binary_log_record_header) +
+             (internal::binary_log_fixed_arg_size<Args>() + ... + 0);
+  internal::binary_log_reserve(log, size);
+
+  s64 start = log->Buffer.Count;
+  log->Buffer.Count += sizeof(internal::binary_log_record_header);
+
+  (internal::binary_log_write_arg(log, arguments), ...);
+
+  internal::binary_log_record_header header = {
+      (u32) (log->Buffer.Count - start), id};
+  memcpy(log->Buffer.Data + start, &header, sizeof(header));
+}
+
+// Logs to the calling thread's log
+template <fmt_string_literal S, typename... Args>
+void log_binary(fmt_compiled_string<S> fmtString, Args no_copy... arguments) {
+  log_binary(&ThreadBinaryLog, fmtString, arguments...);
+}
+
+// Renders the records in _bytes_ as text to _out_. Format strings are looked
+// up in _formats_ if it's not empty (see read_binary_log_formats), otherwise
+// in the ones registered in this process.
+// Returns false if the data is malformed (stops at the bad record).
+inline bool decode_binary_log(writer *out, string bytes,
+                              array<string> formats = {}) {
+  auto *registered = internal::get_binary_log_formats();
+
+  const char *p = bytes.Data, *end = bytes.Data + bytes.Count;
+  while (p < end) {
+    internal::binary_log_record_header header;
+    if (end - p < (s64) sizeof(header)) return false;
+    memcpy(&header, p, sizeof(header));
+
+    if (header.Size < sizeof(header) || header.Size > end - p) return false;
+
+    const char *arg = p + sizeof(header), *recordEnd = p + header.Size;
+    p = recordEnd;
+
+    string fmtString;
+    if (formats.Count) {
+      if (header.FormatID >= formats.Count) return false;
+      fmtString = formats.Data[header.FormatID];
+    } else {
+      lock(&registered->Mutex);
+      bool valid = header.FormatID < registered->Strings.Count;
+      if (valid) fmtString = registered->Strings.Data[header.FormatID];
+      unlock(&registered->Mutex);
+      if (!valid) return false;
+    }
+
+    fmt_arg args[BINARY_LOG_MAX_ARGS];
+    s64 argCount = 0;
+
+    while (arg < recordEnd) {
+      if (argCount == BINARY_LOG_MAX_ARGS) return false;
+
+      auto type = (fmt_type) (byte) *arg++;
+
+      s64 size = type == fmt_type::F32 ? 4 : 8;
+      if (recordEnd - arg < size) return false;
+
+      fmt_arg a = {type};
+      switch (type) {
+        case fmt_type::S64:
+        case fmt_type::BOOL:
+          memcpy(&a.Value.S64, arg, 8);
+          break;
+        case fmt_type::U64:
+          memcpy(&a.Value.U64, arg, 8);
+          break;
+        case fmt_type::F32:
+          memcpy(&a.Value.F32, arg, 4);
+          break;
+        case fmt_type::F64:
+          memcpy(&a.Value.F64, arg, 8);
+          break;
+        case fmt_type::POINTER:
+          memcpy(&a.Value.Pointer, arg, 8);
+          break;
+        case fmt_type::STRING: {
+          s64 count;
+          memcpy(&count, arg, 8);
+          if (count < 0 || count > recordEnd - arg - 8) return false;
+          a.Value.String = string(arg + 8, count);
+          size += count;
+          break;
+        }
+        default:
+          return false;
+      }
+      arg += size;
+      args[argCount++] = a;
+    }
+
+    auto f = fmt_context(out, fmtString, array<fmt_arg>(args, argCount));
+    fmt_parse_and_format(&f);
+  }
+  out->flush();
+  return true;
+}
+
+// Decodes the log's records to _out_ and clears it
+inline bool flush(binary_log *log, writer *out) {
+  auto ref b = log->Buffer;
+  bool result = decode_binary_log(out, string((const char *) b.Data, b.Count));
+  b.Count = 0;
+  return result;
+}
+
+// Returns the log's records (to decode on another thread or save to a file)
+// and leaves it empty. The caller owns the returned memory.
+mark_as_leak inline string take_buffer(binary_log *log) {
+  auto ref b = log->Buffer;
+  string result;
+  result.Data = (char *) b.Data;
+  result.Count = b.Count;
+  result.Allocated = b.Allocated;
+  b = {};
+  return result;
+}
+
+inline void free(binary_log ref log) { free(log.Buffer); }
+
+// Writes the format strings registered in this process: u32 count and then
+// (u32 size, bytes) for each, in ID order.
+inline void write_binary_log_formats(writer *out) {
+  auto *registered = internal::get_binary_log_formats();
+
+  lock(&registered->Mutex);
+  defer(unlock(&registered->Mutex));
+
+  u32 count = (u32) registered->Strings.Count;
+  out->write((const char *) &count, 4);
+  For(registered->Strings) {
+    u32 size = (u32) it.Count;
+    out->write((const char *) &size, 4);
+    out->write(it.Data, it.Count);
+  }
+  out->flush();
+}
+
+struct read_binary_log_formats_result {
+  array<string> Formats;  // Views into the bytes which were read
+  bool Success;
+};
+
+// Reads what write_binary_log_formats() wrote
+mark_as_leak inline read_binary_log_formats_result
+read_binary_log_formats(string bytes) {
+  const char *p = bytes.Data, *end = bytes.Data + bytes.Count;
+
+  u32 count;
+  if (end - p < 4) return {{}, false};
+  memcpy(&count, p, 4);
+  p += 4;
+
+  // Each format takes at least its 4 byte size, don't reserve for a bogus
+  // count
+  if (count > (u64) (end - p) / 4) return {{}, false};
+
+  array<string> formats;
+  reserve(formats, count ? count : 1);
+  For(range(count)) {
+    u32 size;
+    if (end - p < 4) break;
+    memcpy(&size, p, 4);
+    p += 4;
+
+    if (end - p < size) break;
+    add(formats, string(p, size));
+    p += size;
+  }
+
+  if (formats.Count != count) {
+    free(formats);
+    return {{}, false};
+  }
+  return {formats, true};
+}
+
+LSTD_END_NAMESPACE
@@ -25,7 +25,7 @@ extern "C" unsigned char __cdecl _BitScanReverse(unsigned long *_Index,
 
 //
 // Defines:
-//      msb, lsb, rotate_left/right_32/64,
+//      msb, lsb, pop_count, rotate_left/right_32/64,
 //      byte_swap_2/4/8, count_digits
 //
 // These bit hacks may be useful:
@@ -114,6 +114,31 @@ inline s32 lsb(is_unsigned_integral auto x) {
   }
 }
 
+// Returns the number of set bits in x.
+//   e.g pop_count(12) (binary - 1100) -> returns 2
+//
+// We don't use the POPCNT instruction on MSVC since it isn't guaranteed
+// to exist on every x64 CPU, the bit hack below compiles to a handful of ops.
+inline s32 pop_count(is_unsigned_integral auto x) {
+  if constexpr (sizeof(x) == 16) {
+    return pop_count(x.lo) + pop_count(x.hi);
+  } else {
+#if COMPILER == MSVC
+    u64 v = (u64)x;
+    v = v - ((v >> 1) & 0x5555555555555555ull);
+    v = (v & 0x3333333333333333ull) + ((v >> 2) & 0x3333333333333333ull);
+    v = (v + (v >> 4)) & 0x0f0f0f0f0f0f0f0full;
+    return (s32)((v * 0x0101010101010101ull) >> 56);
+#else
+    if constexpr (sizeof(x) == 8) {
+      return __builtin_popcountll(x);
+    } else {
+      return __builtin_popcount(x);
+    }
+#endif
+  }
+}
+
 inline u32 rotate_left_32(u32 x, u32 bits) {
   return (x << bits) | (x >> (32 - bits));
 }
@@ -173,32 +198,30 @@ void swap(T (&a)[N], T (&b)[N]) {
 inline const u64 POWERS_OF_10_64[] = {
     1, POWERS_OF_10(1), POWERS_OF_10(1000000000ull), 10000000000000000000ull};
 
+// For each msb(n), the number of decimal digits of the largest n with that
+// msb. The real count is either this or one less.
+inline const u8 COUNT_DIGITS_GUESS[] = {
+    1,  1,  1,  2,  2,  2,  3,  3,  3,  4,  4,  4,  4,  5,  5,  5,
+    6,  6,  6,  7,  7,  7,  7,  8,  8,  8,  9,  9,  9,  10, 10, 10,
+    10, 11, 11, 11, 12, 12, 12, 13, 13, 13, 13, 14, 14, 14, 15, 15,
+    15, 16, 16, 16, 16, 17, 17, 17, 18, 18, 18, 19, 19, 19, 19, 20};
+
 // Returns the number of decimal digits in n. Leading zeros are not counted
 // except for n == 0 in which case count_digits returns 1.
+// One table lookup and one compare, no branches.
 inline u32 count_digits(is_unsigned_integral auto n) {
-  s32 integerLog2 =
-      msb(n | 1);  // log_2(n) == msb(n) (@Speed Not the fastest way)
-  // We also | 1 (if n is 0, we treat is as 1)
-
-  // Divide by log_2(10), which is approx. 1233 / 4096
-  u32 t = ((u32)integerLog2 + 1) * 1233 >>
-          12;  // We add 1 to integerLog2 because it rounds down.
+  // We | 1 so 0 is treated as 1. That doesn't change the result of the
+  // compare because powers of 10 (other than 1) are even.
+  auto x = n | 1;
 
-  u32 integerLog10 =
-      t - (n < POWERS_OF_10_64[t]);  // t may be off by 1, correct it.
-
-  return integerLog10 + 1;  // Number of digits in 'n' is [log_10(n)] + 1
+  u32 guess = COUNT_DIGITS_GUESS[msb(x)];
+  return guess - (x < POWERS_OF_10_64[guess - 1]);
 }
 
+// Returns the number of digits in base 2^Bits, e.g. count_digits<4> for hex.
 template <u32 Bits>
 inline u32 count_digits(is_integral auto value) {
-  decltype(value) n = value;
-
-  u32 numDigits = 0;
-  do {
-    ++numDigits;
-  } while ((n >>= Bits) != 0);
-  return numDigits;
+  return (u32)msb((u64)value | 1) / Bits + 1;
 }
 
 LSTD_END_NAMESPACE
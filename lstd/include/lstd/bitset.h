@@ -0,0 +1,476 @@
+#pragma once
+
+#include "memory.h"
+#include "simd.h"
+
+LSTD_BEGIN_NAMESPACE
+
+//
+// Bitsets with a summary level.
+//
+//   bitset<N>       - fixed size, the bits live inside the object
+//   dynamic_bitset  - size chosen at runtime (and resizable), allocated
+//
+// Besides the bits (64 per word) we keep two summaries with a bit per word:
+// _NonEmpty_ (the word has a set bit) and _Full_ (all bits in the word are
+// set). find_first_set() and find_first_clear() look at the summary to skip
+// 4096 bits at a time, so searching for a free slot in a big pool or an
+// occupied voxel in a mostly empty chunk doesn't walk every word.
+//
+//      bitset<32 * 32 * 32> occupied;   // A voxel chunk
+//      set(occupied, index);
+//      if (test(occupied, index)) ...
+//
+//      For(occupied) { ... it is the index of a set bit ... }
+//
+//      dynamic_bitset freeSlots;
+//      resize(freeSlots, 100000);
+//      set_range(freeSlots, 0, 100000);
+//      s64 slot = find_first_set(freeSlots);  // -1 if none
+//
+// bits_and/or/xor/andnot combine two bitsets of the same size word by word
+// (with AVX2 when available) and rebuild the summaries in the same pass.
+//
+// All functions work on both types (see the concept below).
+//
+
+template <s64 N>
+struct bitset {
+  static_assert(N > 0);
+
+  static const s64 Count = N;  // In bits
+
+  static const s64 WORD_COUNT = (N + 63) / 64;
+  static const s64 SUMMARY_WORD_COUNT = (WORD_COUNT + 63) / 64;
+
+  u64 Words[WORD_COUNT] = {};
+  u64 NonEmpty[SUMMARY_WORD_COUNT] = {};
+  u64 Full[SUMMARY_WORD_COUNT] = {};
+};
+
+struct dynamic_bitset {
+  u64 *Words = null;
+  u64 *NonEmpty = null;
+  u64 *Full = null;
+
+  s64 Count = 0;  // In bits
+
+  // Used when resizing, if null the Context's allocator is used
+  allocator Alloc;
+};
+
+namespace internal {
+template <typename B>
+concept any_bitset = requires(B b) {
+  b.Words;
+  b.NonEmpty;
+  b.Full;
+  b.Count;
+};
+
+inline s64 bitset_word_count(s64 bits) { return (bits + 63) / 64; }
+
+// The bits of word _w_ which are in range (only the last word is partial)
+inline u64 bitset_word_mask(s64 bits, s64 w) {
+  s64 rem = bits - w * 64;
+  return rem >= 64 ? ~0ull : (1ull << rem) - 1;
+}
+
+// Updates the summary bits of word _w_ after it changed
+template <any_bitset B>
+always_inline void bitset_update_summary(B ref b, s64 w) {
+  u64 word = b.Words[w];
+  u64 bit = 1ull << (w & 63);
+
+  if (word) {
+    b.NonEmpty[w >> 6] |= bit;
+  } else {
+    b.NonEmpty[w >> 6] &= ~bit;
+  }
+
+  if (word == bitset_word_mask(b.Count, w)) {
+    b.Full[w >> 6] |= bit;
+  } else {
+    b.Full[w >> 6] &= ~bit;
+  }
+}
+
+template <any_bitset B>
+void bitset_rebuild_summary(B ref b) {
+  s64 words = bitset_word_count(b.Count);
+  For(range(bitset_word_count(words))) b.NonEmpty[it] = b.Full[it] = 0;
+  For(range(words)) bitset_update_summary(b, it);
+}
+
+// Returns the index of the first set bit in _summary_ at or after _from_ and
+// before _count_, or -1
+inline s64 bitset_summary_find(const u64 *summary, s64 from, s64 count,
+                               bool inverted) {
+  if (from >= count) return -1;
+
+  s64 s = from >> 6;
+  u64 x = (inverted ? ~summary[s] : summary[s]) & (~0ull << (from & 63));
+
+  s64 summaryWords = bitset_word_count(count);
+  while (true) {
+    if (x) {
+      s64 result = s * 64 + lsb(x);
+      return result < count ? result : -1;
+    }
+    if (++s == summaryWords) return -1;
+    x = inverted ? ~summary[s] : summary[s];
+  }
+}
+
+enum bitset_op { BITSET_AND, BITSET_OR, BITSET_XOR, BITSET_ANDNOT };
+
+template <bitset_op Op>
+always_inline u64 bitset_apply(u64 a, u64 b) {
+  if constexpr (Op == BITSET_AND) return a & b;
+  if constexpr (Op == BITSET_OR) return a | b;
+  if constexpr (Op == BITSET_XOR) return a ^ b;
+  if constexpr (Op == BITSET_ANDNOT) return a & ~b;
+}
+
+// dest = dest op src for a group of at most 64 words, returns the summary
+// bits of the group in _nonEmpty_ and _full_ (as if all words were whole).
+template <bitset_op Op>
+void bitset_op_group_scalar(u64 *dest, const u64 *src, s64 words,
+                            u64 *nonEmpty, u64 *full) {
+  u64 ne = 0, f = 0;
+  For(range(words)) {
+    u64 r = bitset_apply<Op>(dest[it], src[it]);
+    dest[it] = r;
+    ne |= (u64) (r != 0) << it;
+    f |= (u64) (r == ~0ull) << it;
+  }
+  *nonEmpty = ne;
+  *full = f;
+}
+
+#if LSTD_SIMD_X86
+template <bitset_op Op>
+LSTD_TARGET_AVX2 inline __m256i avx2_bitset_apply(__m256i a, __m256i b) {
+  if constexpr (Op == BITSET_AND) return _mm256_and_si256(a, b);
+  if constexpr (Op == BITSET_OR) return _mm256_or_si256(a, b);
+  if constexpr (Op == BITSET_XOR) return _mm256_xor_si256(a, b);
+  if constexpr (Op == BITSET_ANDNOT) return _mm256_andnot_si256(b, a);
+}
+
+template <bitset_op Op>
+LSTD_TARGET_AVX2 void avx2_bitset_op_group(u64 *dest, const u64 *src,
+                                           s64 words, u64 *nonEmpty,
+                                           u64 *full) {
+  __m256i zero = _mm256_setzero_si256();
+  __m256i ones = _mm256_set1_epi64x(-1);
+
+  // 4 words per vector, movemask_pd gives a bit per word
+  u64 zeroMask = 0, f = 0;
+  s64 i = 0;
+  for (; words - i >= 4; i += 4) {
+    __m256i r = avx2_bitset_apply<Op>(
+        _mm256_loadu_si256((const __m256i *) (dest + i)),
+        _mm256_loadu_si256((const __m256i *) (src + i)));
+    _mm256_storeu_si256((__m256i *) (dest + i), r);
+
+    zeroMask |= (u64) _mm256_movemask_pd(
+                    _mm256_castsi256_pd(_mm256_cmpeq_epi64(r, zero)))
+                << i;
+    f |= (u64) _mm256_movemask_pd(
+             _mm256_castsi256_pd(_mm256_cmpeq_epi64(r, ones)))
+         << i;
+  }
+
+  u64 ne = ~zeroMask & (i == 64 ? ~0ull : (1ull << i) - 1);
+  for (; i < words; ++i) {
+    u64 r = bitset_apply<Op>(dest[i], src[i]);
+    dest[i] = r;
+    ne |= (u64) (r != 0) << i;
+    f |= (u64) (r == ~0ull) << i;
+  }
+  *nonEmpty = ne;
+  *full = f;
+}
+
+// Population count with a nibble lookup table (W. Mula)
+LSTD_TARGET_AVX2 inline s64 avx2_pop_count(const u64 *words, s64 count) {
+  __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3,
+                                    3, 4, 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3,
+                                    2, 3, 3, 4);
+  __m256i low = _mm256_set1_epi8(0x0f);
+
+  __m256i acc = _mm256_setzero_si256();
+  s64 i = 0;
+  for (; count - i >= 4; i += 4) {
+    __m256i v = _mm256_loadu_si256((const __m256i *) (words + i));
+    __m256i lo = _mm256_shuffle_epi8(lookup, _mm256_and_si256(v, low));
+    __m256i hi = _mm256_shuffle_epi8(
+        lookup, _mm256_and_si256(_mm256_srli_epi16(v, 4), low));
+    acc = _mm256_add_epi64(
+        acc, _mm256_sad_epu8(_mm256_add_epi8(lo, hi), _mm256_setzero_si256()));
+  }
+
+  s64 result = _mm256_extract_epi64(acc, 0) + _mm256_extract_epi64(acc, 1) +
+               _mm256_extract_epi64(acc, 2) + _mm256_extract_epi64(acc, 3);
+  for (; i < count; ++i) result += pop_count(words[i]);
+  return result;
+}
+#endif
+
+template <bitset_op Op, any_bitset B, any_bitset C>
+void bitset_op(B ref dest, C no_copy src) {
+  assert(dest.Count == src.Count && "Bitsets must have the same size");
+
+  s64 words = bitset_word_count(dest.Count);
+
+#if LSTD_SIMD_X86
+  bool avx2 = words * 8 >= SIMD_AVX2_THRESHOLD && cpu_has(CPU_AVX2);
+#endif
+
+  for (s64 g = 0; g < words; g += 64) {
+    s64 n = words - g < 64 ? words - g : 64;
+
+    u64 nonEmpty, full;
+#if LSTD_SIMD_X86
+    if (avx2) {
+      avx2_bitset_op_group<Op>(dest.Words + g, src.Words + g, n, &nonEmpty,
+                               &full);
+    } else {
+      bitset_op_group_scalar<Op>(dest.Words + g, src.Words + g, n, &nonEmpty,
+                                 &full);
+    }
+#else
+    bitset_op_group_scalar<Op>(dest.Words + g, src.Words + g, n, &nonEmpty,
+                               &full);
+#endif
+    dest.NonEmpty[g >> 6] = nonEmpty;
+    dest.Full[g >> 6] = full;
+  }
+
+  // The last word may be partial, in which case it's "full" when all bits in
+  // range are set (the bits past the end are always 0).
+  if (dest.Count & 63) bitset_update_summary(dest, words - 1);
+}
+}  // namespace internal
+
+template <internal::any_bitset B>
+bool test(B no_copy b, s64 index) {
+  assert(index >= 0 && index < b.Count);
+  return b.Words[index >> 6] & (1ull << (index & 63));
+}
+
+template <internal::any_bitset B>
+void set(B ref b, s64 index) {
+  assert(index >= 0 && index < b.Count);
+  b.Words[index >> 6] |= 1ull << (index & 63);
+  internal::bitset_update_summary(b, index >> 6);
+}
+
+template <internal::any_bitset B>
+void clear(B ref b, s64 index) {
+  assert(index >= 0 && index < b.Count);
+  b.Words[index >> 6] &= ~(1ull << (index & 63));
+  internal::bitset_update_summary(b, index >> 6);
+}
+
+template <internal::any_bitset B>
+void flip(B ref b, s64 index) {
+  assert(index >= 0 && index < b.Count);
+  b.Words[index >> 6] ^= 1ull << (index & 63);
+  internal::bitset_update_summary(b, index >> 6);
+}
+
+// Sets (or clears) the bits in [begin, end), whole words at a time
+template <internal::any_bitset B>
+void set_range(B ref b, s64 begin, s64 end, bool value = true) {
+  assert(begin >= 0 && end <= b.Count);
+  if (begin >= end) return;
+
+  s64 first = begin >> 6, last = (end - 1) >> 6;
+  For_as(w, range(first, last + 1)) {
+    u64 mask = ~0ull;
+    if (w == first) mask &= ~0ull << (begin & 63);
+    if (w == last && (end & 63)) mask &= (1ull << (end & 63)) - 1;
+
+    if (value) {
+      b.Words[w] |= mask;
+    } else {
+      b.Words[w] &= ~mask;
+    }
+    internal::bitset_update_summary(b, w);
+  }
+}
+
+template <internal::any_bitset B>
+void clear_range(B ref b, s64 begin, s64 end) {
+  set_range(b, begin, end, false);
+}
+
+template <internal::any_bitset B>
+void set_all(B ref b) {
+  set_range(b, 0, b.Count);
+}
+
+template <internal::any_bitset B>
+void clear_all(B ref b) {
+  s64 words = internal::bitset_word_count(b.Count);
+  memset(b.Words, 0, words * sizeof(u64));
+  memset(b.NonEmpty, 0, internal::bitset_word_count(words) * sizeof(u64));
+  memset(b.Full, 0, internal::bitset_word_count(words) * sizeof(u64));
+}
+
+// Returns the index of the first set bit at or after _from_, -1 if none
+template <internal::any_bitset B>
+s64 find_first_set(B no_copy b, s64 from = 0) {
+  if (from < 0) from = 0;
+  if (from >= b.Count) return -1;
+
+  s64 w = from >> 6;
+  u64 x = b.Words[w] & (~0ull << (from & 63));
+  if (x) return w * 64 + lsb(x);
+
+  w = internal::bitset_summary_find(b.NonEmpty, w + 1,
+                                    internal::bitset_word_count(b.Count), false);
+  if (w == -1) return -1;
+  return w * 64 + lsb(b.Words[w]);
+}
+
+// Returns the index of the first clear bit at or after _from_, -1 if none
+template <internal::any_bitset B>
+s64 find_first_clear(B no_copy b, s64 from = 0) {
+  if (from < 0) from = 0;
+  if (from >= b.Count) return -1;
+
+  s64 w = from >> 6;
+  u64 x = ~b.Words[w] & (~0ull << (from & 63));
+  if (!x) {
+    w = internal::bitset_summary_find(b.Full, w + 1,
+                                      internal::bitset_word_count(b.Count), true);
+    if (w == -1) return -1;
+    x = ~b.Words[w];
+  }
+
+  s64 result = w * 64 + lsb(x);
+  return result < b.Count ? result : -1;
+}
+
+// Number of set bits
+template <internal::any_bitset B>
+s64 pop_count(B no_copy b) {
+  s64 words = internal::bitset_word_count(b.Count);
+#if LSTD_SIMD_X86
+  if (words * 8 >= SIMD_AVX2_THRESHOLD && cpu_has(CPU_AVX2)) {
+    return internal::avx2_pop_count(b.Words, words);
+  }
+#endif
+  s64 result = 0;
+  For(range(words)) result += pop_count(b.Words[it]);
+  return result;
+}
+
+template <internal::any_bitset B>
+bool any(B no_copy b) {
+  For(range(internal::bitset_word_count(internal::bitset_word_count(b.Count)))) {
+    if (b.NonEmpty[it]) return true;
+  }
+  return false;
+}
+
+// dest &= src, both must have the same size
+template <internal::any_bitset B, internal::any_bitset C>
+void bits_and(B ref dest, C no_copy src) {
+  internal::bitset_op<internal::BITSET_AND>(dest, src);
+}
+
+// dest |= src
+template <internal::any_bitset B, internal::any_bitset C>
+void bits_or(B ref dest, C no_copy src) {
+  internal::bitset_op<internal::BITSET_OR>(dest, src);
+}
+
+// dest ^= src
+template <internal::any_bitset B, internal::any_bitset C>
+void bits_xor(B ref dest, C no_copy src) {
+  internal::bitset_op<internal::BITSET_XOR>(dest, src);
+}
+
+// dest &= ~src
+template <internal::any_bitset B, internal::any_bitset C>
+void bits_andnot(B ref dest, C no_copy src) {
+  internal::bitset_op<internal::BITSET_ANDNOT>(dest, src);
+}
+
+//
+// dynamic_bitset
+//
+
+// Changes the number of bits, keeps the old ones (new bits are clear)
+inline void resize(dynamic_bitset ref b, s64 count, allocator alloc = {}) {
+  assert(count >= 0);
+
+  if (alloc) b.Alloc = alloc;
+  if (!b.Alloc) b.Alloc = Context.Alloc;
+
+  s64 words = internal::bitset_word_count(count);
+  s64 summaryWords = internal::bitset_word_count(words);
+
+  u64 *block = null;
+  if (count) {
+    // Words first (aligned for the SIMD ops), then the summaries
+    block = malloc<u64>(
+        {.Count = words + 2 * summaryWords, .Alloc = b.Alloc, .Alignment = 64});
+    memset(block, 0, (words + 2 * summaryWords) * sizeof(u64));
+
+    s64 keep = internal::bitset_word_count(min(count, b.Count));
+    if (keep) memcpy(block, b.Words, keep * sizeof(u64));
+
+    // Clear the bits past the end when shrinking
+    if (count < b.Count) block[words - 1] &= internal::bitset_word_mask(count, words - 1);
+  }
+
+  if (b.Words) free(b.Words);
+
+  b.Words = block;
+  b.NonEmpty = block ? block + words : null;
+  b.Full = block ? block + words + summaryWords : null;
+  b.Count = count;
+
+  if (block) internal::bitset_rebuild_summary(b);
+}
+
+inline void free(dynamic_bitset ref b) {
+  if (b.Words) free(b.Words);
+  b.Words = b.NonEmpty = b.Full = null;
+  b.Count = 0;
+}
+
+//
+// Iteration over the indices of the set bits
+//
+template <typename B>
+struct bitset_iterator {
+  const B *Bitset;
+  s64 Index;
+
+  bitset_iterator &operator++() {
+    Index = find_first_set(*Bitset, Index + 1);
+    return *this;
+  }
+
+  bool operator==(bitset_iterator other) const { return Index == other.Index; }
+  bool operator!=(bitset_iterator other) const { return Index != other.Index; }
+
+  s64 operator*() const { return Index; }
+};
+
+template <internal::any_bitset B>
+auto begin(B no_copy b) {
+  return bitset_iterator<B>{&b, find_first_set(b)};
+}
+
+template <internal::any_bitset B>
+auto end(B no_copy b) {
+  return bitset_iterator<B>{&b, -1};
+}
+
+LSTD_END_NAMESPACE
@@ -0,0 +1,751 @@
+#pragma once
+
+#include "memory.h"
+#include "string.h"
+
+LSTD_BEGIN_NAMESPACE
+
+//
+// Ordered map (B+ tree).
+//
+// Unlike hash_table this keeps the keys sorted, so you can ask for the
+// first key >= x, iterate a range of keys in order, etc.
+//
+// Each node holds many keys in a contiguous array (about NODE_BYTES worth, a
+// few cache lines), so a lookup touches a handful of nodes instead of chasing
+// a pointer per key like a binary tree would. Values are stored only in the
+// leaves, which are linked, so iterating in order is a linear walk.
+//
+//      btree_map<f64, event> events;
+//      set(events, event.Time, event);
+//
+//      auto *e = search(events, 12.5).Value;   // null if not found
+//
+//      // All events in [10, 20)
+//      for (auto [time, e] : key_range(events, 10.0, 20.0)) { ... }
+//
+//      remove(events, 12.5);
+//      free(events);
+//
+// Keys are compared with < (strings lexicographically).
+//
+// Nodes have a fixed size and are allocated one at a time with _Alloc_, so
+// an arena allocator works well here. Removed nodes are kept in a free list and
+// reused, memory is only released with free().
+//
+// Pointers returned by search/set and iterators are invalidated when the
+// map is modified.
+//
+template <typename K_, typename V_>
+struct btree_map {
+  using K = K_;
+  using V = V_;
+
+  // Target size for the key array of a node
+  static const s64 NODE_BYTES = 256;
+
+  static const s64 LEAF_CAPACITY =
+      NODE_BYTES / (s64) sizeof(K) < 4    ? 4
+      : NODE_BYTES / (s64) sizeof(K) > 64 ? 64
+                                          : NODE_BYTES / (s64) sizeof(K);
+  static const s64 INNER_CAPACITY = LEAF_CAPACITY;
+
+  // Nodes (except the root) never have fewer keys than this
+  static const s64 LEAF_MIN = LEAF_CAPACITY / 2;
+  static const s64 INNER_MIN = INNER_CAPACITY / 2;
+
+  static const s64 MAX_DEPTH = 32;
+
+  struct node {
+    s64 Count;  // Number of keys
+    bool IsLeaf;
+    node *NextFree;
+  };
+
+  struct leaf : node {
+    leaf *Prev, *Next;
+    K Keys[LEAF_CAPACITY];
+    V Values[LEAF_CAPACITY];
+  };
+
+  // Child i has keys < Keys[i], child i + 1 has keys >= Keys[i]
+  struct inner : node {
+    K Keys[INNER_CAPACITY];
+    node *Children[INNER_CAPACITY + 1];
+  };
+
+  node *Root = null;
+  leaf *First = null, *Last = null;
+
+  s64 Count = 0;
+  s64 Depth = 0;  // Number of inner levels
+
+  node *FreeLeaves = null;
+  node *FreeInners = null;
+
+  // Used for the nodes, if null the Context's allocator is used
+  // (at the first insertion).
+  allocator Alloc;
+};
+
+template <typename>
+const bool is_btree_map = false;
+
+template <typename K, typename V>
+const bool is_btree_map<btree_map<K, V>> = true;
+
+template <typename T>
+concept any_btree_map = is_btree_map<T>;
+
+template <any_btree_map T>
+struct btree_item {
+  typename T::K *Key;
+  typename T::V *Value;
+};
+
+template <any_btree_map T>
+struct btree_iterator {
+  typename T::leaf *Leaf;
+  s64 Index;
+
+  btree_iterator &operator++() {
+    if (++Index == Leaf->Count) {
+      Leaf = Leaf->Next;
+      Index = 0;
+    }
+    return *this;
+  }
+
+  btree_iterator &operator--() {
+    if (Index-- == 0) {
+      Leaf = Leaf->Prev;
+      Index = Leaf->Count - 1;
+    }
+    return *this;
+  }
+
+  bool operator==(btree_iterator other) const {
+    return Leaf == other.Leaf && Index == other.Index;
+  }
+  bool operator!=(btree_iterator other) const { return !(*this == other); }
+
+  btree_item<T> operator*() {
+    return {Leaf->Keys + Index, Leaf->Values + Index};
+  }
+};
+
+namespace internal {
+template <typename K>
+always_inline bool btree_less(K no_copy a, K no_copy b) {
+  if constexpr (is_same<K, string>) {
+    return compare_lexicographically(a, b) < 0;
+  } else {
+    return a < b;
+  }
+}
+
+// First index with keys[i] >= key
+template <typename K>
+s64 btree_lower_bound(const K *keys, s64 count, K no_copy key) {
+  s64 lo = 0, hi = count;
+  while (lo < hi) {
+    s64 mid = lo + (hi - lo) / 2;
+    if (btree_less(keys[mid], key)) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+// First index with keys[i] > key
+template <typename K>
+s64 btree_upper_bound(const K *keys, s64 count, K no_copy key) {
+  s64 lo = 0, hi = count;
+  while (lo < hi) {
+    s64 mid = lo + (hi - lo) / 2;
+    if (btree_less(key, keys[mid])) {
+      hi = mid;
+    } else {
+      lo = mid + 1;
+    }
+  }
+  return lo;
+}
+
+template <any_btree_map T>
+auto *btree_new_leaf(T ref map) {
+  using leaf = typename T::leaf;
+
+  leaf *l;
+  if (map.FreeLeaves) {
+    l = (leaf *) map.FreeLeaves;
+    map.FreeLeaves = l->NextFree;
+  } else {
+    if (!map.Alloc) map.Alloc = Context.Alloc;
+    l = malloc<leaf>({.Alloc = map.Alloc});
+  }
+  l->Count = 0;
+  l->IsLeaf = true;
+  l->NextFree = null;
+  l->Prev = l->Next = null;
+  return l;
+}
+
+template <any_btree_map T>
+auto *btree_new_inner(T ref map) {
+  using inner = typename T::inner;
+
+  inner *n;
+  if (map.FreeInners) {
+    n = (inner *) map.FreeInners;
+    map.FreeInners = n->NextFree;
+  } else {
+    if (!map.Alloc) map.Alloc = Context.Alloc;
+    n = malloc<inner>({.Alloc = map.Alloc});
+  }
+  n->Count = 0;
+  n->IsLeaf = false;
+  n->NextFree = null;
+  return n;
+}
+
+template <any_btree_map T>
+void btree_release(T ref map, typename T::node *n) {
+  if (n->IsLeaf) {
+    n->NextFree = map.FreeLeaves;
+    map.FreeLeaves = n;
+  } else {
+    n->NextFree = map.FreeInners;
+    map.FreeInners = n;
+  }
+}
+
+// The inner nodes on the way to a leaf and which child we took in each
+template <any_btree_map T>
+struct btree_path {
+  typename T::inner *Nodes[T::MAX_DEPTH];
+  s64 Indices[T::MAX_DEPTH];
+  s64 Count = 0;
+};
+
+template <any_btree_map T>
+auto *btree_find_leaf(T no_copy map, typename T::K no_copy key,
+                      btree_path<T> *path = null) {
+  using inner = typename T::inner;
+  using leaf = typename T::leaf;
+
+  auto *n = map.Root;
+  while (!n->IsLeaf) {
+    auto *in = (inner *) n;
+    s64 index = btree_upper_bound(in->Keys, in->Count, key);
+    if (path) {
+      path->Nodes[path->Count] = in;
+      path->Indices[path->Count] = index;
+      ++path->Count;
+    }
+    n = in->Children[index];
+  }
+  return (leaf *) n;
+}
+
+// Inserts _key_ and _right_ after child _index_ of the inner node at
+// _level_ in the path, splitting up the tree as needed
+template <any_btree_map T>
+void btree_insert_in_parent(T ref map, btree_path<T> ref path, s64 level,
+                            typename T::K key, typename T::node *right) {
+  using K = typename T::K;
+  using node = typename T::node;
+
+  if (level < 0) {
+    // Split the root
+    auto *root = btree_new_inner(map);
+    root->Count = 1;
+    root->Keys[0] = key;
+    root->Children[0] = map.Root;
+    root->Children[1] = right;
+    map.Root = root;
+    map.Depth += 1;
+    return;
+  }
+
+  auto *n = path.Nodes[level];
+  s64 index = path.Indices[level];
+
+  if (n->Count < T::INNER_CAPACITY) {
+    For(range(n->Count, index, -1)) {
+      n->Keys[it] = n->Keys[it - 1];
+      n->Children[it + 1] = n->Children[it];
+    }
+    n->Keys[index] = key;
+    n->Children[index + 1] = right;
+    n->Count += 1;
+    return;
+  }
+
+  // Full, gather everything and split in two around the middle key
+  K keys[T::INNER_CAPACITY + 1];
+  node *children[T::INNER_CAPACITY + 2];
+
+  For(range(index)) keys[it] = n->Keys[it];
+  keys[index] = key;
+  For(range(index, T::INNER_CAPACITY)) keys[it + 1] = n->Keys[it];
+
+  For(range(index + 1)) children[it] = n->Children[it];
+  children[index + 1] = right;
+  For(range(index + 1, T::INNER_CAPACITY + 1)) children[it + 1] = n->Children[it];
+
+  s64 total = T::INNER_CAPACITY + 1;
+  s64 mid = total / 2;
+
+  auto *sibling = btree_new_inner(map);
+
+  n->Count = mid;
+  For(range(mid)) {
+    n->Keys[it] = keys[it];
+    n->Children[it] = children[it];
+  }
+  n->Children[mid] = children[mid];
+
+  sibling->Count = total - mid - 1;
+  For(range(sibling->Count)) {
+    sibling->Keys[it] = keys[mid + 1 + it];
+    sibling->Children[it] = children[mid + 1 + it];
+  }
+  sibling->Children[sibling->Count] = children[total];
+
+  btree_insert_in_parent(map, path, level - 1, keys[mid], sibling);
+}
+
+// Fixes an inner node at _level_ in the path which has too few keys
+template <any_btree_map T>
+void btree_rebalance_inner(T ref map, btree_path<T> ref path, s64 level) {
+  using inner = typename T::inner;
+
+  auto *n = path.Nodes[level];
+
+  if (level == 0) {
+    // The root may have any number of keys, but if it has no keys left the
+    // tree gets shorter
+    if (n->Count == 0) {
+      map.Root = n->Children[0];
+      map.Depth -= 1;
+      btree_release(map, n);
+    }
+    return;
+  }
+  if (n->Count >= T::INNER_MIN) return;
+
+  auto *parent = path.Nodes[level - 1];
+  s64 index = path.Indices[level - 1];
+
+  auto *left = index > 0 ? (inner *) parent->Children[index - 1] : null;
+  auto *right =
+      index < parent->Count ? (inner *) parent->Children[index + 1] : null;
+
+  if (left && left->Count > T::INNER_MIN) {
+    // Rotate the separator down and the last key of _left_ up
+    For(range(n->Count, 0, -1)) n->Keys[it] = n->Keys[it - 1];
+    For(range(n->Count + 1, 0, -1)) n->Children[it] = n->Children[it - 1];
+
+    n->Keys[0] = parent->Keys[index - 1];
+    n->Children[0] = left->Children[left->Count];
+    n->Count += 1;
+
+    parent->Keys[index - 1] = left->Keys[left->Count - 1];
+    left->Count -= 1;
+    return;
+  }
+
+  if (right && right->Count > T::INNER_MIN) {
+    n->Keys[n->Count] = parent->Keys[index];
+    n->Children[n->Count + 1] = right->Children[0];
+    n->Count += 1;
+
+    parent->Keys[index] = right->Keys[0];
+    For(range(right->Count - 1)) right->Keys[it] = right->Keys[it + 1];
+    For(range(right->Count)) right->Children[it] = right->Children[it + 1];
+    right->Count -= 1;
+    return;
+  }
+
+  // Merge with a sibling, the separator comes down between them
+  s64 separator = left ? index - 1 : index;
+  auto *a = left ? left : n;
+  auto *b = left ? n : right;
+
+  a->Keys[a->Count] = parent->Keys[separator];
+  For(range(b->Count)) a->Keys[a->Count + 1 + it] = b->Keys[it];
+  For(range(b->Count + 1)) a->Children[a->Count + 1 + it] = b->Children[it];
+  a->Count += b->Count + 1;
+  btree_release(map, b);
+
+  For(range(separator, parent->Count - 1)) {
+    parent->Keys[it] = parent->Keys[it + 1];
+    parent->Children[it + 1] = parent->Children[it + 2];
+  }
+  parent->Count -= 1;
+
+  btree_rebalance_inner(map, path, level - 1);
+}
+
+template <any_btree_map T>
+void btree_free_subtree(T ref map, typename T::node *n) {
+  if (n->IsLeaf) {
+    free((typename T::leaf *) n);
+    return;
+  }
+
+  auto *in = (typename T::inner *) n;
+  For(range(in->Count + 1)) btree_free_subtree(map, in->Children[it]);
+  free(in);
+}
+}  // namespace internal
+
+// Looks up _key_, returns null pointers if it's not in the map
+template <any_btree_map T>
+btree_item<T> search(T ref map, typename T::K no_copy key) {
+  if (!map.Root) return {null, null};
+
+  auto *l = internal::btree_find_leaf(map, key);
+  s64 index = internal::btree_lower_bound(l->Keys, l->Count, key);
+  if (index < l->Count && !internal::btree_less(key, l->Keys[index])) {
+    return {l->Keys + index, l->Values + index};
+  }
+  return {null, null};
+}
+
+template <any_btree_map T>
+bool has(T ref map, typename T::K no_copy key) {
+  return search(map, key).Key != null;
+}
+
+// Inserts the key or overwrites the value if it's already in the map.
+// Returns pointers to the key and value in the map.
+template <any_btree_map T>
+btree_item<T> set(T ref map, typename T::K no_copy key,
+                  typename T::V no_copy value) {
+  if (!map.Root) {
+    auto *l = internal::btree_new_leaf(map);
+    map.Root = l;
+    map.First = map.Last = l;
+  }
+
+  internal::btree_path<T> path;
+  auto *l = internal::btree_find_leaf(map, key, &path);
+
+  s64 index = internal::btree_lower_bound(l->Keys, l->Count, key);
+  if (index < l->Count && !internal::btree_less(key, l->Keys[index])) {
+    l->Values[index] = value;
+    return {l->Keys + index, l->Values + index};
+  }
+
+  map.Count += 1;
+
+  if (l->Count == T::LEAF_CAPACITY) {
+    // Split, the upper half goes to a new leaf on the right
+    auto *right = internal::btree_new_leaf(map);
+
+    s64 keep = T::LEAF_CAPACITY - T::LEAF_CAPACITY / 2;
+    right->Count = l->Count - keep;
+    For(range(right->Count)) {
+      right->Keys[it] = l->Keys[keep + it];
+      right->Values[it] = l->Values[keep + it];
+    }
+    l->Count = keep;
+
+    right->Next = l->Next;
+    right->Prev = l;
+    if (l->Next) {
+      l->Next->Prev = right;
+    } else {
+      map.Last = right;
+    }
+    l->Next = right;
+
+    internal::btree_insert_in_parent(map, path, path.Count - 1, right->Keys[0],
+                                     right);
+
+    if (index > keep) {
+      index -= keep;
+      l = right;
+    }
+  }
+
+  For(range(l->Count, index, -1)) {
+    l->Keys[it] = l->Keys[it - 1];
+    l->Values[it] = l->Values[it - 1];
+  }
+  l->Keys[index] = key;
+  l->Values[index] = value;
+  l->Count += 1;
+
+  return {l->Keys + index, l->Values + index};
+}
+
+// Returns true if the key was found and removed
+template <any_btree_map T>
+bool remove(T ref map, typename T::K no_copy key) {
+  using leaf = typename T::leaf;
+
+  if (!map.Root) return false;
+
+  internal::btree_path<T> path;
+  auto *l = internal::btree_find_leaf(map, key, &path);
+
+  s64 index = internal::btree_lower_bound(l->Keys, l->Count, key);
+  if (index == l->Count || internal::btree_less(key, l->Keys[index])) {
+    return false;
+  }
+
+  For(range(index, l->Count - 1)) {
+    l->Keys[it] = l->Keys[it + 1];
+    l->Values[it] = l->Values[it + 1];
+  }
+  l->Count -= 1;
+  map.Count -= 1;
+
+  // The root leaf may have any number of keys. Separators in the parents may
+  // now be smaller than the smallest key in _l_, that's still valid.
+  if (!path.Count || l->Count >= T::LEAF_MIN) return true;
+
+  auto *parent = path.Nodes[path.Count - 1];
+  s64 child = path.Indices[path.Count - 1];
+
+  auto *left = child > 0 ? (leaf *) parent->Children[child - 1] : null;
+  auto *right =
+      child < parent->Count ? (leaf *) parent->Children[child + 1] : null;
+
+  if (left && left->Count > T::LEAF_MIN) {
+    For(range(l->Count, 0, -1)) {
+      l->Keys[it] = l->Keys[it - 1];
+      l->Values[it] = l->Values[it - 1];
+    }
+    l->Keys[0] = left->Keys[left->Count - 1];
+    l->Values[0] = left->Values[left->Count - 1];
+    l->Count += 1;
+    left->Count -= 1;
+
+    parent->Keys[child - 1] = l->Keys[0];
+    return true;
+  }
+
+  if (right && right->Count > T::LEAF_MIN) {
+    l->Keys[l->Count] = right->Keys[0];
+    l->Values[l->Count] = right->Values[0];
+    l->Count += 1;
+
+    For(range(right->Count - 1)) {
+      right->Keys[it] = right->Keys[it + 1];
+      right->Values[it] = right->Values[it + 1];
+    }
+    right->Count -= 1;
+
+    parent->Keys[child] = right->Keys[0];
+    return true;
+  }
+
+  // Merge with a sibling and remove the separator between them
+  s64 separator = left ? child - 1 : child;
+  auto *a = left ? left : l;
+  auto *b = left ? l : right;
+
+  For(range(b->Count)) {
+    a->Keys[a->Count + it] = b->Keys[it];
+    a->Values[a->Count + it] = b->Values[it];
+  }
+  a->Count += b->Count;
+
+  a->Next = b->Next;
+  if (b->Next) {
+    b->Next->Prev = a;
+  } else {
+    map.Last = a;
+  }
+  internal::btree_release(map, b);
+
+  For(range(separator, parent->Count - 1)) {
+    parent->Keys[it] = parent->Keys[it + 1];
+    parent->Children[it + 1] = parent->Children[it + 2];
+  }
+  parent->Count -= 1;
+
+  internal::btree_rebalance_inner(map, path, path.Count - 1);
+  return true;
+}
+
+//
+// Iteration in key order
+//
+template <any_btree_map T>
+btree_iterator<T> begin(T ref map) {
+  if (!map.First || !map.First->Count) return {null, 0};
+  return {map.First, 0};
+}
+
+template <any_btree_map T>
+btree_iterator<T> end(T ref map) {
+  return {null, 0};
+}
+
+// Returns an iterator to the first key >= _key_
+template <any_btree_map T>
+btree_iterator<T> lower_bound(T ref map, typename T::K no_copy key) {
+  if (!map.Root) return end(map);
+
+  auto *l = internal::btree_find_leaf(map, key);
+  s64 index = internal::btree_lower_bound(l->Keys, l->Count, key);
+  if (index == l->Count) return {l->Next, 0};
+  return {l, index};
+}
+
+// Returns an iterator to the first key > _key_
+template <any_btree_map T>
+btree_iterator<T> upper_bound(T ref map, typename T::K no_copy key) {
+  if (!map.Root) return end(map);
+
+  auto *l = internal::btree_find_leaf(map, key);
+  s64 index = internal::btree_upper_bound(l->Keys, l->Count, key);
+  if (index == l->Count) return {l->Next, 0};
+  return {l, index};
+}
+
+template <any_btree_map T>
+struct btree_range {
+  btree_iterator<T> Begin, End;
+
+  btree_iterator<T> begin() { return Begin; }
+  btree_iterator<T> end() { return End; }
+};
+
+// The entries with keys in [first, last), for range-based for loops
+template <any_btree_map T>
+btree_range<T> key_range(T ref map, typename T::K no_copy first,
+                         typename T::K no_copy last) {
+  if (!internal::btree_less(first, last)) return {end(map), end(map)};
+  return {lower_bound(map, first), lower_bound(map, last)};
+}
+
+// Frees all nodes
+template <any_btree_map T>
+void free(T ref map) {
+  if (map.Root) internal::btree_free_subtree(map, map.Root);
+
+  for (auto *n = map.FreeLeaves; n;) {
+    auto *next = n->NextFree;
+    free((typename T::leaf *) n);
+    n = next;
+  }
+  for (auto *n = map.FreeInners; n;) {
+    auto *next = n->NextFree;
+    free((typename T::inner *) n);
+    n = next;
+  }
+
+  map.Root = null;
+  map.First = map.Last = null;
+  map.FreeLeaves = map.FreeInners = null;
+  map.Count = 0;
+  map.Depth = 0;
+}
+
+// Builds the map from _count_ entries sorted by key (without duplicates).
+// Much faster than calling set() for each one: leaves are filled one after
+// the other and the inner levels are built on top of them. The map must be
+// empty.
+template <any_btree_map T>
+void bulk_load(T ref map, const typename T::K *keys, const typename T::V *values,
+               s64 count) {
+  using node = typename T::node;
+  using inner = typename T::inner;
+  using leaf = typename T::leaf;
+
+  assert(!map.Count && "The map must be empty");
+  if (count <= 0) return;
+
+  free(map);
+
+  // Fill the leaves, but make sure the last one isn't underfull by
+  // splitting the remainder evenly with the one before it
+  s64 leafCount = (count + T::LEAF_CAPACITY - 1) / T::LEAF_CAPACITY;
+
+  leaf *prev = null;
+  s64 done = 0;
+  For_as(index, range(leafCount)) {
+    s64 remaining = count - done;
+    s64 n = remaining < T::LEAF_CAPACITY ? remaining : T::LEAF_CAPACITY;
+    if (index == leafCount - 2 && remaining - n < T::LEAF_MIN) {
+      n = remaining / 2;
+    }
+
+    auto *l = internal::btree_new_leaf(map);
+    For(range(n)) {
+      assert((done + it == 0 || internal::btree_less(keys[done + it - 1],
+                                                     keys[done + it])) &&
+             "Keys must be sorted and unique");
+      l->Keys[it] = keys[done + it];
+      l->Values[it] = values[done + it];
+    }
+    l->Count = n;
+    done += n;
+
+    l->Prev = prev;
+    if (prev) {
+      prev->Next = l;
+    } else {
+      map.First = l;
+    }
+    prev = l;
+  }
+  map.Last = prev;
+  map.Count = count;
+
+  // Build the inner levels bottom up. Each level is a list of nodes with the
+  // smallest key under each of them.
+  struct entry {
+    node *Node;
+    typename T::K MinKey;
+  };
+
+  entry *current =
+      malloc<entry>({.Count = leafCount, .Alloc = map.Alloc});
+  defer(free(current));
+
+  s64 levelCount = 0;
+  for (leaf *l = map.First; l; l = l->Next) {
+    current[levelCount++] = {l, l->Keys[0]};
+  }
+
+  map.Depth = 0;
+  while (levelCount > 1) {
+    s64 fanout = T::INNER_CAPACITY + 1;
+    s64 parents = (levelCount + fanout - 1) / fanout;
+
+    s64 next = 0, taken = 0;
+    For_as(index, range(parents)) {
+      s64 remaining = levelCount - taken;
+      s64 n = remaining < fanout ? remaining : fanout;
+      if (index == parents - 2 && remaining - n < T::INNER_MIN + 1) {
+        n = remaining / 2;
+      }
+
+      auto *in = internal::btree_new_inner(map);
+      in->Children[0] = current[taken].Node;
+      For(range(1, n)) {
+        in->Keys[it - 1] = current[taken + it].MinKey;
+        in->Children[it] = current[taken + it].Node;
+      }
+      in->Count = n - 1;
+
+      // Written in place, _next_ never passes _taken_
+      current[next++] = {in, current[taken].MinKey};
+      taken += n;
+    }
+    levelCount = next;
+    map.Depth += 1;
+  }
+  map.Root = current[0].Node;
+}
+
+LSTD_END_NAMESPACE
@@ -0,0 +1,254 @@
+#pragma once
+
+#include "array.h"
+#include "bits.h"
+
+LSTD_BEGIN_NAMESPACE
+
+//
+// Bucket array.
+//
+// Elements are stored in fixed size buckets which are never moved or
+// reallocated, so pointers to elements stay valid until the element is
+// removed (unlike array<T> which copies everything when it grows).
+// Adding never copies existing elements, it takes a free slot in a bucket
+// which isn't full or allocates a new bucket.
+//
+// Removed slots are reused by later adds. Iteration walks the buckets in order
+// and skips empty slots using the occupancy bit masks, so it's still
+// mostly linear in memory.
+//
+//      bucket_array<entity, 64> entities;
+//
+//      bucket_locator loc;
+//      entity *e = add(entities, {...}, &loc);  // _e_ is stable
+//      ...
+//      remove(entities, loc);   // O(1)
+//
+//      For(entities) { update(it); }
+//
+//      free(entities);
+//
+template <typename T, s64 BucketSize = 64>
+struct bucket_array {
+  static_assert(BucketSize > 0);
+
+  static const s64 MASK_WORDS = (BucketSize + 63) / 64;
+
+  struct bucket {
+    T Data[BucketSize];
+    u64 Occupied[MASK_WORDS];  // Bit per slot
+    s64 Count;
+    s64 Index;                 // In _Buckets_
+    bool InUnfullList;
+  };
+
+  array<bucket *> Buckets;
+
+  // Indices of buckets which have a free slot
+  array<s64> Unfull;
+
+  s64 Count = 0;
+
+  // Used for the buckets and the arrays above, if null the Context's
+  // allocator is used (at the first add).
+  allocator Alloc;
+};
+
+// Where an element is, used for O(1) removal
+struct bucket_locator {
+  s64 Bucket = -1;
+  s64 Slot = -1;
+};
+
+namespace internal {
+template <typename T, s64 B>
+auto *bucket_array_new_bucket(bucket_array<T, B> ref ba) {
+  using bucket = typename bucket_array<T, B>::bucket;
+
+  if (!ba.Alloc) ba.Alloc = Context.Alloc;
+  if (!ba.Buckets.Allocated) {
+    reserve(ba.Buckets, 8, ba.Alloc);
+    reserve(ba.Unfull, 8, ba.Alloc);
+  }
+
+  auto *b = malloc<bucket>({.Alloc = ba.Alloc});
+  memset(b->Occupied, 0, sizeof(b->Occupied));
+  b->Count = 0;
+  b->Index = ba.Buckets.Count;
+  b->InUnfullList = true;
+
+  add(ba.Buckets, b);
+  add(ba.Unfull, b->Index);
+  return b;
+}
+}  // namespace internal
+
+// Copies _element_ in a free slot and returns a pointer to it (which stays
+// valid until the element is removed). Optionally returns its locator.
+template <typename T, s64 B>
+T *add(bucket_array<T, B> ref ba, T no_copy element,
+       bucket_locator *locator = null) {
+  typename bucket_array<T, B>::bucket *b;
+  if (ba.Unfull.Count) {
+    b = ba.Buckets.Data[ba.Unfull.Data[ba.Unfull.Count - 1]];
+  } else {
+    b = internal::bucket_array_new_bucket(ba);
+  }
+
+  s64 slot = -1;
+  For(range(bucket_array<T, B>::MASK_WORDS)) {
+    u64 empty = ~b->Occupied[it];
+    if (empty) {
+      slot = it * 64 + lsb(empty);
+      break;
+    }
+  }
+  assert(slot != -1 && slot < B);
+
+  b->Occupied[slot / 64] |= 1ull << (slot % 64);
+  b->Count += 1;
+  ba.Count += 1;
+
+  if (b->Count == B) {
+    // Full, it's always the last one in the list
+    b->InUnfullList = false;
+    ba.Unfull.Count -= 1;
+  }
+
+  if (locator) *locator = {b->Index, slot};
+
+  T *result = b->Data + slot;
+  *result = element;
+  return result;
+}
+
+template <typename T, s64 B>
+bool is_occupied(bucket_array<T, B> no_copy ba, bucket_locator locator) {
+  if (locator.Bucket < 0 || locator.Bucket >= ba.Buckets.Count) return false;
+  if (locator.Slot < 0 || locator.Slot >= B) return false;
+
+  auto *b = ba.Buckets.Data[locator.Bucket];
+  return b->Occupied[locator.Slot / 64] & (1ull << (locator.Slot % 64));
+}
+
+template <typename T, s64 B>
+T *get(bucket_array<T, B> ref ba, bucket_locator locator) {
+  assert(is_occupied(ba, locator));
+  return ba.Buckets.Data[locator.Bucket]->Data + locator.Slot;
+}
+
+// Finds the locator of an element from a pointer to it.
+// O(number of buckets), prefer keeping the locator from add().
+template <typename T, s64 B>
+bucket_locator get_locator(bucket_array<T, B> no_copy ba, const T *element) {
+  For(ba.Buckets) {
+    if (element >= it->Data && element < it->Data + B) {
+      return {it->Index, element - it->Data};
+    }
+  }
+  return {};
+}
+
+template <typename T, s64 B>
+void remove(bucket_array<T, B> ref ba, bucket_locator locator) {
+  assert(is_occupied(ba, locator));
+
+  auto *b = ba.Buckets.Data[locator.Bucket];
+  b->Occupied[locator.Slot / 64] &= ~(1ull << (locator.Slot % 64));
+  b->Count -= 1;
+  ba.Count -= 1;
+
+  if (!b->InUnfullList) {
+    b->InUnfullList = true;
+    add(ba.Unfull, b->Index);
+  }
+}
+
+template <typename T, s64 B>
+void remove(bucket_array<T, B> ref ba, const T *element) {
+  remove(ba, get_locator(ba, element));
+}
+
+// Removes all elements but keeps the buckets allocated
+template <typename T, s64 B>
+void reset(bucket_array<T, B> ref ba) {
+  ba.Unfull.Count = 0;
+  For(ba.Buckets) {
+    memset(it->Occupied, 0, sizeof(it->Occupied));
+    it->Count = 0;
+    it->InUnfullList = true;
+    add(ba.Unfull, it->Index);
+  }
+  ba.Count = 0;
+}
+
+template <typename T, s64 B>
+void free(bucket_array<T, B> ref ba) {
+  For(ba.Buckets) free(it);
+  free(ba.Buckets);
+  free(ba.Unfull);
+  ba.Count = 0;
+}
+
+//
+// Iteration (over occupied slots, in bucket order)
+//
+template <typename T, s64 B>
+struct bucket_array_iterator {
+  bucket_array<T, B> *Array;
+  s64 Bucket;
+  s64 Slot;
+
+  // Moves to the first occupied slot at or after (Bucket, Slot)
+  void skip_empty() {
+    while (Bucket < Array->Buckets.Count) {
+      auto *b = Array->Buckets.Data[Bucket];
+      if (b->Count) {
+        while (Slot < B) {
+          u64 word = b->Occupied[Slot / 64] >> (Slot % 64);
+          if (word) {
+            Slot += lsb(word);
+            if (Slot < B) return;
+            break;
+          }
+          Slot = (Slot / 64 + 1) * 64;
+        }
+      }
+      ++Bucket;
+      Slot = 0;
+    }
+    Slot = 0;
+  }
+
+  bucket_array_iterator &operator++() {
+    ++Slot;
+    skip_empty();
+    return *this;
+  }
+
+  bool operator==(bucket_array_iterator other) const {
+    return Array == other.Array && Bucket == other.Bucket && Slot == other.Slot;
+  }
+  bool operator!=(bucket_array_iterator other) const {
+    return !(*this == other);
+  }
+
+  T &operator*() { return Array->Buckets.Data[Bucket]->Data[Slot]; }
+
+  bucket_locator locator() const { return {Bucket, Slot}; }
+};
+
+template <typename T, s64 B>
+auto begin(bucket_array<T, B> ref ba) {
+  bucket_array_iterator<T, B> it = {&ba, 0, 0};
+  it.skip_empty();
+  return it;
+}
+
+template <typename T, s64 B>
+auto end(bucket_array<T, B> ref ba) {
+  return bucket_array_iterator<T, B>{&ba, ba.Buckets.Count, 0};
+}
+
+LSTD_END_NAMESPACE
@@ -2,6 +2,7 @@
 
 #include "common.h"
 #include "fmt/arg.h"
+#include "fmt/compiled.h"
 #include "fmt/context.h"
 #include "fmt/interp.h"
 #include "fmt/pretty.h"
@@ -195,6 +196,7 @@ template <typename... Args>
 s64 fmt_calculate_length(string fmtString, Args no_copy... arguments);
 
 // Formats to a string. The caller is responsible for freeing.
+// Allocates once, with the exact size (see internal::fmt_sprint).
 template <typename... Args>
 mark_as_leak string sprint(string fmtString, Args no_copy... arguments);
 
@@ -212,6 +214,54 @@ char *mprint(string fmtString, Args no_copy... arguments);
 template <typename... Args>
 void print(string fmtString, Args no_copy... arguments);
 
+// Formats into a caller-provided buffer of _size_ bytes, never allocates
+// (except for very large big integers, see write_custom).
+// Output which doesn't fit is cut (at a code point boundary). No null
+// terminator is written.
+//
+//      char buffer[256];
+//      auto [count, needed] = format_to(buffer, 256, "{} {}", a, b);
+//      if (needed > count) { ... } // Truncated
+//
+struct format_to_result {
+  s64 Count;   // Bytes written to the buffer
+  s64 Needed;  // Bytes the whole output takes, > Count if it was truncated
+};
+
+template <typename F, typename... Args>
+format_to_result format_to(char *buffer, s64 size, F no_copy fmtString,
+                           Args no_copy... arguments);
+
+// Appends the formatted output to _out_, grows it if needed.
+// Doesn't allocate if _out_ has enough space already, so a string which is
+// reused (e.g. reset with Count = 0 each frame) stops allocating after it
+// has grown to fit.
+template <typename F, typename... Args>
+void format_to(string ref out, F no_copy fmtString, Args no_copy... arguments);
+
+// Overloads of the above which take a format string parsed at compile time,
+// e.g. print(FMT("{} {:.3f}"), name, value). See fmt/compiled.h.
+template <fmt_string_literal S, typename... Args>
+void fmt_to_writer(writer *out, fmt_compiled_string<S>,
+                   Args no_copy... arguments);
+
+template <fmt_string_literal S, typename... Args>
+s64 fmt_calculate_length(fmt_compiled_string<S> fmtString,
+                         Args no_copy... arguments);
+
+template <fmt_string_literal S, typename... Args>
+mark_as_leak string sprint(fmt_compiled_string<S> fmtString,
+                           Args no_copy... arguments);
+
+template <fmt_string_literal S, typename... Args>
+string tprint(fmt_compiled_string<S> fmtString, Args no_copy... arguments);
+
+template <fmt_string_literal S, typename... Args>
+char *mprint(fmt_compiled_string<S> fmtString, Args no_copy... arguments);
+
+template <fmt_string_literal S, typename... Args>
+void print(fmt_compiled_string<S> fmtString, Args no_copy... arguments);
+
 // Same as print, but the format string is expected to contain standard printf
 // syntax. Type-safety, custom-formatters, etc. work here. You don't get all
 // features, but this is designed as a drop-in replacement for printf.
@@ -227,11 +277,93 @@ void printf(string fmtString, Args no_copy... arguments) {
 void fmt_parse_and_format(fmt_context *f);
 
 inline void write_custom(fmt_context *f, const string_builder *b) {
-  auto *buffer = &b->BaseBuffer;
-  while (buffer) {
-    write_no_specs(f, buffer->Data, buffer->Occupied);
-    buffer = buffer->Next;
+  For(builder_view(b)) write_no_specs(f, it);
+}
+
+// Big integers take the same specs as other integers (except 'n' and 'c').
+// Numbers up to TO_CHARS_STACK_DIGITS digits are formatted from stack buffers,
+// larger ones allocate temporary memory with the Context's allocator (so
+// format_to() isn't allocation-free for them).
+inline void write_custom(fmt_context *f, const big_integer *b) {
+  fmt_specs specs;
+  if (f->Specs) specs = *f->Specs;
+
+  char type = specs.Type;
+  if (!type) type = 'd';
+
+  u32 base;
+  if (type == 'd') {
+    base = 10;
+  } else if (to_lower(type) == 'b') {
+    base = 2;
+  } else if (type == 'o') {
+    base = 8;
+  } else if (to_lower(type) == 'x') {
+    base = 16;
+  } else {
+    on_error(f, "Invalid type specifier for a big integer",
+             f->Parse.It.Data - f->Parse.FormatString.Data - 1);
+    return;
+  }
+
+  big_integer absolute = *b;
+  absolute.Size = abs(absolute.Size);
+
+  // Enough for TO_CHARS_STACK_DIGITS digits in base 2
+  char stackDigits[TO_CHARS_STACK_DIGITS * SHIFT + 2];
+
+  char *digits = stackDigits;
+  s64 size = to_chars_size(absolute, base);
+  if (size > (s64) sizeof(stackDigits)) digits = malloc<char>({.Count = size});
+  defer(if (digits != stackDigits) free(digits));
+
+  s64 numDigits = to_chars(digits, absolute, base, is_upper(type));
+
+  char prefixBuffer[4];
+  char *prefixPointer = prefixBuffer;
+
+  if (b->Size < 0) {
+    *prefixPointer++ = '-';
+  } else if (specs.Sign == fmt_sign::PLUS) {
+    *prefixPointer++ = '+';
+  } else if (specs.Sign == fmt_sign::SPACE) {
+    *prefixPointer++ = ' ';
+  }
+
+  if ((to_lower(type) == 'x' || to_lower(type) == 'b') && specs.Hash) {
+    *prefixPointer++ = '0';
+    *prefixPointer++ = type;
+  }
+
+  if (type == 'o' && specs.Hash) {
+    if (specs.Precision == -1 || specs.Precision > numDigits)
+      *prefixPointer++ = '0';
   }
+
+  auto prefix = string(prefixBuffer, prefixPointer - prefixBuffer);
+
+  s64 formattedSize = prefix.Count + numDigits;
+  s64 padding = 0;
+  if (specs.Align == fmt_alignment::NUMERIC) {
+    if (specs.Width > formattedSize) {
+      padding = specs.Width - formattedSize;
+      formattedSize = specs.Width;
+    }
+  } else if (specs.Precision > numDigits) {
+    formattedSize = prefix.Count + specs.Precision;
+    padding = specs.Precision - numDigits;
+    specs.Fill = '0';
+  }
+  if (specs.Align == fmt_alignment::NONE) specs.Align = fmt_alignment::RIGHT;
+
+  write_padded_helper(
+      f, specs,
+      [&]() {
+        if (prefix.Count) write_no_specs(f, prefix);
+        For(range(padding)) write_no_specs(f, specs.Fill);
+        write_no_specs(f, digits, numDigits);
+      },
+      formattedSize);
 }
 
 // Format arrays in the following way: [1, 2, ...]
@@ -408,6 +540,22 @@ inline bool fmt_handle_dynamic_specs(fmt_context *f) {
   return true;
 }
 
+// Writes the ANSI escape codes for a text style (unless disabled)
+inline void fmt_write_text_style(fmt_context *f, fmt_text_style style) {
+  if (Context.FmtDisableAnsiCodes) return;
+
+  char ansiBuffer[7 + 3 * 4 + 1];
+  auto *ansiEnd = color_to_ansi(ansiBuffer, style);
+  write_no_specs(f, ansiBuffer, ansiEnd - ansiBuffer);
+
+  u8 emphasis = (u8)style.Emphasis;
+  if (emphasis) {
+    assert(!style.Background);
+    ansiEnd = emphasis_to_ansi(ansiBuffer, emphasis);
+    write_no_specs(f, ansiBuffer, ansiEnd - ansiBuffer);
+  }
+}
+
 inline void fmt_parse_and_format(fmt_context *f) {
   fmt_interp *p = &f->Parse;
 
@@ -480,18 +628,7 @@ inline void fmt_parse_and_format(fmt_context *f) {
         return;
       }
 
-      if (!Context.FmtDisableAnsiCodes) {
-        char ansiBuffer[7 + 3 * 4 + 1];
-        auto *ansiEnd = color_to_ansi(ansiBuffer, style);
-        write_no_specs(f, ansiBuffer, ansiEnd - ansiBuffer);
-
-        u8 emphasis = (u8)style.Emphasis;
-        if (emphasis) {
-          assert(!style.Background);
-          ansiEnd = emphasis_to_ansi(ansiBuffer, emphasis);
-          write_no_specs(f, ansiBuffer, ansiEnd - ansiBuffer);
-        }
-      }
+      fmt_write_text_style(f, style);
     } else {
       // Parse integer specified or a named argument
       s64 argId = fmt_parse_arg_id(p);
@@ -550,18 +687,75 @@ s64 fmt_calculate_length(string fmtString, Args no_copy... arguments) {
   return writer.Count;
 }
 
-template <typename... Args>
-mark_as_leak string sprint(string fmtString, Args no_copy... arguments) {
-  string_builder b;
+// How much sprint formats on the stack before it knows the size of the result
+const s64 FMT_SPRINT_STACK_BUFFER_SIZE = 1_KiB;
+
+namespace internal {
+// Formats into a stack buffer while counting the full length, then allocates
+// once with the exact size. Only if the output didn't fit on the stack do we
+// format a second time, directly into the allocated string. Custom
+// formatters must write the same thing both times.
+//
+// With _nullTerminate_ one extra byte is allocated and set to 0 (which is not
+// included in the string's Count).
+template <typename F, typename... Args>
+mark_as_leak string fmt_sprint(bool nullTerminate, F no_copy fmtString,
+                               Args no_copy... arguments) {
+  char stackBuffer[FMT_SPRINT_STACK_BUFFER_SIZE];
+
+  buffer_writer writer(stackBuffer, FMT_SPRINT_STACK_BUFFER_SIZE);
+  fmt_to_writer(&writer, fmtString, arguments...);
+
+  s64 count = writer.Count;
 
-  string_builder_writer writer;
-  writer.Builder = &b;
+  string result;
+  reserve(result, count + (nullTerminate ? 1 : 0));
+
+  if (count <= FMT_SPRINT_STACK_BUFFER_SIZE) {
+    memcpy(result.Data, stackBuffer, count);
+  } else {
+    buffer_writer full(result.Data, count);
+    fmt_to_writer(&full, fmtString, arguments...);
+    assert(full.Count == count && "Custom formatter wrote different output");
+  }
+
+  result.Count = count;
+  if (nullTerminate) result.Data[count] = '\0';
+  return result;
+}
+}  // namespace internal
+
+template <typename F, typename... Args>
+format_to_result format_to(char *buffer, s64 size, F no_copy fmtString,
+                           Args no_copy... arguments) {
+  buffer_writer writer(buffer, size);
   fmt_to_writer(&writer, fmtString, arguments...);
 
-  string combined = builder_to_string(&b);
-  free_buffers(&b);
+  s64 needed = writer.Count;
+  if (needed <= size) return {needed, needed};
 
-  return combined;
+  // Don't leave half of a code point at the end
+  s64 count = size;
+  s64 start = count;
+  while (start > 0 && (buffer[start - 1] & 0xC0) == 0x80) --start;
+  if (start > 0) {
+    s64 lead = start - 1;
+    if (lead + utf8_get_size_of_cp(buffer + lead) > count) count = lead;
+  }
+  return {count, needed};
+}
+
+template <typename F, typename... Args>
+void format_to(string ref out, F no_copy fmtString, Args no_copy... arguments) {
+  if (!out.Allocated) reserve(out);  // Own the memory before appending
+
+  string_writer writer(&out);
+  fmt_to_writer(&writer, fmtString, arguments...);
+}
+
+template <typename... Args>
+mark_as_leak string sprint(string fmtString, Args no_copy... arguments) {
+  return internal::fmt_sprint(false, fmtString, arguments...);
 }
 
 template <typename... Args>
@@ -572,7 +766,7 @@ string tprint(string fmtString, Args no_copy... arguments) {
 template <typename... Args>
 char *mprint(string fmtString, Args no_copy... arguments) {
   PUSH_ALLOC(TemporaryAllocator) {
-    return to_c_string(sprint(fmtString, arguments...));
+    return internal::fmt_sprint(true, fmtString, arguments...).Data;
   }
 }
 
@@ -582,6 +776,125 @@ void print(string fmtString, Args no_copy... arguments) {
   fmt_to_writer(Context.Log, fmtString, arguments...);
 }
 
+namespace internal {
+template <s64 I, typename First, typename... Rest>
+always_inline auto no_copy fmt_nth_arg(First no_copy first,
+                                       Rest no_copy... rest) {
+  if constexpr (I == 0) {
+    return first;
+  } else {
+    return fmt_nth_arg<I - 1>(rest...);
+  }
+}
+
+// Calls the write() overload for the mapped type of the argument (what
+// fmt_context_visitor does after fmt_visit_arg, but without the type erasure)
+always_inline void fmt_write_mapped(fmt_context *f, auto mapped) {
+  using T = decltype(mapped);
+  if constexpr (fmt_type_constant<T>::value == fmt_type::CUSTOM) {
+    write_custom(f, mapped);
+  } else {
+    write(f, mapped);
+  }
+}
+
+template <typename Compiled, s64 I, typename... Args>
+always_inline void fmt_write_compiled_field(fmt_context *f,
+                                            Args no_copy... arguments) {
+  constexpr auto no_copy fields = Compiled::Result;
+  constexpr fmt_compiled_field field = fields.Fields[I];
+
+  if constexpr (field.Kind == fmt_compiled_field::LITERAL) {
+    write_no_specs(f, fields.Text + field.Begin, field.Count);
+  } else if constexpr (field.Kind == fmt_compiled_field::STYLE) {
+    // Point the parser at the style (including the closing brace) so errors
+    // show the right position
+    f->Parse.It =
+        string(f->Parse.FormatString.Data + field.Begin, field.Count + 1);
+
+    auto [success, style] = fmt_parse_text_style(&f->Parse);
+    if (!success) return;
+    if (!f->Parse.It.Count || f->Parse.It[0] != '}') {
+      on_error(f, "\"}\" expected");
+      return;
+    }
+    fmt_write_text_style(f, style);
+  } else {
+    auto mapped = fmt_map_arg(fmt_nth_arg<field.ArgIndex>(arguments...));
+
+    if constexpr (!field.HasSpecs) {
+      fmt_write_mapped(f, mapped);
+    } else {
+      fmt_dynamic_specs specs = field.Specs;
+      if constexpr (field.Specs.WidthIndex != -1) {
+        specs.Width = fmt_width_checker{f}(
+            fmt_map_arg(fmt_nth_arg<field.Specs.WidthIndex>(arguments...)));
+        if (specs.Width == (u32)-1) return;
+      }
+      if constexpr (field.Specs.PrecisionIndex != -1) {
+        specs.Precision = fmt_precision_checker{f}(
+            fmt_map_arg(fmt_nth_arg<field.Specs.PrecisionIndex>(arguments...)));
+        if (specs.Precision == -1) return;
+      }
+
+      f->Specs = &specs;
+      fmt_write_mapped(f, mapped);
+      f->Specs = null;
+    }
+  }
+}
+
+// Unrolls to one call per field
+template <typename Compiled, s64 I, typename... Args>
+always_inline void fmt_write_compiled(fmt_context *f,
+                                      Args no_copy... arguments) {
+  if constexpr (I < Compiled::Result.Count) {
+    fmt_write_compiled_field<Compiled, I>(f, arguments...);
+    fmt_write_compiled<Compiled, I + 1>(f, arguments...);
+  }
+}
+}  // namespace internal
+
+template <fmt_string_literal S, typename... Args>
+void fmt_to_writer(writer *out, fmt_compiled_string<S>,
+                   Args no_copy... arguments) {
+  auto f = fmt_context(out, string(S.Data, S.Count), {});
+  internal::fmt_write_compiled<fmt_compiled<S, Args...>, 0>(&f, arguments...);
+  f.flush();
+}
+
+template <fmt_string_literal S, typename... Args>
+s64 fmt_calculate_length(fmt_compiled_string<S> fmtString,
+                         Args no_copy... arguments) {
+  counting_writer writer;
+  fmt_to_writer(&writer, fmtString, arguments...);
+  return writer.Count;
+}
+
+template <fmt_string_literal S, typename... Args>
+mark_as_leak string sprint(fmt_compiled_string<S> fmtString,
+                           Args no_copy... arguments) {
+  return internal::fmt_sprint(false, fmtString, arguments...);
+}
+
+template <fmt_string_literal S, typename... Args>
+string tprint(fmt_compiled_string<S> fmtString, Args no_copy... arguments) {
+  PUSH_ALLOC(TemporaryAllocator) { return sprint(fmtString, arguments...); }
+}
+
+template <fmt_string_literal S, typename... Args>
+char *mprint(fmt_compiled_string<S> fmtString, Args no_copy... arguments) {
+  PUSH_ALLOC(TemporaryAllocator) {
+    return internal::fmt_sprint(true, fmtString, arguments...).Data;
+  }
+}
+
+template <fmt_string_literal S, typename... Args>
+void print(fmt_compiled_string<S> fmtString, Args no_copy... arguments) {
+  assert(Context.Log && "Context log was null. By default it points to cout.");
+  fmt_to_writer(Context.Log, fmtString, arguments...);
+}
+
 //
 // Specialize this function for formatting your custom type.
 //
@@ -99,7 +99,7 @@ auto fmt_map_arg(auto no_copy v) {
 }
 
 template <typename T>
-auto fmt_mapped_type_constant_v =
+constexpr auto fmt_mapped_type_constant_v =
     fmt_type_constant_v<decltype(fmt_map_arg(declval<T>()))>;
 
 fmt_arg fmt_make_arg(auto no_copy v) {
@@ -0,0 +1,457 @@
+#pragma once
+
+#include "../common.h"
+#include "arg.h"
+#include "specs.h"
+#include "type.h"
+
+LSTD_BEGIN_NAMESPACE
+
+//
+// Compile-time parsed format strings.
+//
+// Wrapping a literal format string in FMT(...) makes the compiler parse it
+// (and check the specs against the types of the arguments) instead of doing
+// that at runtime on every call:
+//
+//      print(FMT("{} took {:.3f} ms\n"), name, ms);
+//
+// The string is split into literal text and fields. Formatting then is a
+// straight sequence of writes of the literal text and calls to the write()
+// overload for each argument's type - no format string walking, no fmt_arg
+// type erasure and no runtime spec parsing.
+//
+// Errors in the format string (unmatched braces, bad specs, argument index
+// out of range, a spec which isn't valid for the argument's type, etc.) are
+// compile errors which point to a call to _fmt_compile_error_ with the message.
+//
+// Text styles ({!...}) are also split out at compile time but the style itself
+// is parsed when written.
+//
+// The syntax is the same as the runtime one (see the big comment in fmt.h).
+//
+
+// A string literal which can be passed as a template argument
+template <s64 N>
+struct fmt_string_literal {
+  char Data[N];
+
+  consteval fmt_string_literal(const char (&str)[N]) {
+    for (s64 i = 0; i < N; ++i) Data[i] = str[i];
+  }
+
+  // Without the null terminator
+  static constexpr s64 Count = N - 1;
+};
+
+// The type which carries a compile-time format string, construct with FMT(..)
+template <fmt_string_literal S>
+struct fmt_compiled_string {
+  static constexpr auto Literal = S;
+};
+
+#define FMT(str) \
+  LSTD_NAMESPACE::fmt_compiled_string<LSTD_NAMESPACE::fmt_string_literal(str)> {}
+
+// Deliberately not constexpr. Calling this while parsing a format string at
+// compile time stops compilation and the error shows the message.
+inline void fmt_compile_error(const char *message) {}
+
+struct fmt_compiled_field {
+  enum kind : u8 {
+    LITERAL,  // Range in _Text_ of the result (already unescaped)
+    ARG,      // Argument with index _ArgIndex_, formatted with _Specs_
+    STYLE     // Text style, range in the format string (between "{!" and "}")
+  };
+
+  kind Kind = LITERAL;
+
+  s64 Begin = 0;
+  s64 Count = 0;
+
+  s64 ArgIndex = -1;
+
+  bool HasSpecs = false;
+  fmt_dynamic_specs Specs = {};
+};
+
+// Used while parsing, at most one field per byte of the format string.
+// fmt_compiled exposes a copy sized to what was parsed (fmt_compiled_result).
+template <s64 N>
+struct fmt_compiled_fields {
+  fmt_compiled_field Fields[N + 1] = {};
+  s64 Count = 0;
+
+  // The literal text with escaped braces collapsed, consecutive literal parts
+  // end up in one field so they are written with one call.
+  char Text[N + 1] = {};
+  s64 TextCount = 0;
+};
+
+// The parsed fields and literal text of a format string, in arrays of the
+// exact size
+template <s64 FieldCount, s64 TextSize>
+struct fmt_compiled_result {
+  fmt_compiled_field Fields[FieldCount ? FieldCount : 1] = {};
+  s64 Count = FieldCount;
+
+  char Text[TextSize ? TextSize : 1] = {};
+  s64 TextCount = TextSize;
+};
+
+namespace internal {
+consteval bool fmt_ct_is_digit(char c) { return c >= '0' && c <= '9'; }
+
+consteval fmt_alignment fmt_ct_alignment(code_point c) {
+  if (c == '<') return fmt_alignment::LEFT;
+  if (c == '>') return fmt_alignment::RIGHT;
+  if (c == '=') return fmt_alignment::NUMERIC;
+  if (c == '^') return fmt_alignment::CENTER;
+  return fmt_alignment::NONE;
+}
+
+consteval bool fmt_ct_is_integral(fmt_type t) {
+  return t == fmt_type::S64 || t == fmt_type::U64 || t == fmt_type::BOOL;
+}
+
+consteval bool fmt_ct_is_arithmetic(fmt_type t) {
+  return fmt_ct_is_integral(t) || t == fmt_type::F32 || t == fmt_type::F64;
+}
+
+// Decodes the utf-8 code point at _s_, stores its size in bytes in _size_
+consteval code_point fmt_ct_decode(const char *s, s64 *size) {
+  auto b = (u8) s[0];
+  if (b < 0x80) return *size = 1, b;
+  if ((b >> 5) == 0x6) {
+    *size = 2;
+    return ((b & 0x1F) << 6) | (s[1] & 0x3F);
+  }
+  if ((b >> 4) == 0xE) {
+    *size = 3;
+    return ((b & 0x0F) << 12) | ((s[1] & 0x3F) << 6) | (s[2] & 0x3F);
+  }
+  *size = 4;
+  return ((b & 0x07) << 18) | ((s[1] & 0x3F) << 12) | ((s[2] & 0x3F) << 6) |
+         (s[3] & 0x3F);
+}
+
+// The fmt_type an argument of type T ends up as (see fmt_map_arg)
+template <typename T>
+constexpr fmt_type fmt_ct_type =
+    fmt_type_constant<remove_cvref_t<decltype(fmt_map_arg(declval<T>()))>>::value;
+
+struct fmt_ct_parser {
+  const char *Str;
+  s64 Count;
+  s64 It = 0;
+
+  const fmt_type *ArgTypes;
+  s64 ArgCount;
+
+  s32 NextArgID = 0;  // -1 after manual indexing
+
+  consteval char peek() const { return It < Count ? Str[It] : 0; }
+
+  consteval s64 next_arg_id() {
+    if (NextArgID < 0) {
+      fmt_compile_error("Cannot switch from manual to automatic argument indexing");
+    }
+    return NextArgID++;
+  }
+
+  consteval s64 parse_u32() {
+    u64 value = 0;
+    while (It < Count && fmt_ct_is_digit(Str[It])) {
+      value = value * 10 + (Str[It] - '0');
+      if (value > numeric<u32>::max() - 1) {
+        fmt_compile_error("Integer in format string is too large");
+      }
+      ++It;
+    }
+    return (s64) value;
+  }
+
+  // Parses an argument index (or takes the next one if there isn't one)
+  // and checks that it's in range. Expects '}' or ':' after it.
+  consteval s64 parse_arg_id() {
+    s64 id;
+    if (peek() == '}' || peek() == ':') {
+      id = next_arg_id();
+    } else if (fmt_ct_is_digit(peek())) {
+      id = parse_u32();
+      if (NextArgID > 0) {
+        fmt_compile_error("Cannot switch from automatic to manual argument indexing");
+      }
+      NextArgID = -1;
+      if (peek() != '}' && peek() != ':') {
+        fmt_compile_error("Expected \":\" or \"}\"");
+      }
+    } else {
+      fmt_compile_error("Expected a number - an index to an argument");
+      return -1;
+    }
+
+    if (id >= ArgCount) fmt_compile_error("Argument index out of range");
+    return id;
+  }
+
+  // Dynamic width or precision: "{}" or "{N}" which refers to an integer
+  consteval s64 parse_dynamic_index() {
+    ++It;  // Skip the {
+    s64 id = parse_arg_id();
+    if (peek() != '}') {
+      fmt_compile_error(
+          "Expected a closing \"}\" after parsing an argument ID for a "
+          "dynamic width or precision");
+    }
+    ++It;  // Skip the }
+
+    if (ArgTypes[id] != fmt_type::S64 && ArgTypes[id] != fmt_type::U64) {
+      fmt_compile_error("Dynamic width or precision was not an integer");
+    }
+    return id;
+  }
+
+  consteval void require_arithmetic(fmt_type t) {
+    if (t == fmt_type::CUSTOM) return;
+    if (!fmt_ct_is_arithmetic(t)) {
+      fmt_compile_error("Format specifier requires an arithmetic argument");
+    }
+  }
+
+  consteval void require_signed_arithmetic(fmt_type t) {
+    if (t == fmt_type::CUSTOM) return;
+    require_arithmetic(t);
+    if (fmt_ct_is_integral(t) && t != fmt_type::S64) {
+      fmt_compile_error(
+          "Format specifier requires a signed integer argument (got "
+          "unsigned)");
+    }
+  }
+
+  // Same rules as fmt_parse_specs(), plus the checks on the type specifier
+  // which the runtime path does when writing.
+  consteval void parse_specs(fmt_type t, fmt_dynamic_specs *specs) {
+    if (peek() == '}') return;
+
+    // Fill and align
+    s64 size = 0;
+    code_point fill = fmt_ct_decode(Str + It, &size);
+    auto align = fmt_ct_alignment(fill);
+    if (align != fmt_alignment::NONE) {
+      It += size;
+      specs->Align = align;
+    } else if (It + size < Count &&
+               fmt_ct_alignment(Str[It + size]) != fmt_alignment::NONE) {
+      if (fill == '{' || fill == '}') {
+        fmt_compile_error("Invalid fill character");
+      }
+      specs->Fill = fill;
+      specs->Align = fmt_ct_alignment(Str[It + size]);
+      It += size + 1;
+    }
+    if (specs->Align == fmt_alignment::NUMERIC) require_arithmetic(t);
+
+    // Sign
+    char c = peek();
+    if (c == '+' || c == '-' || c == ' ') {
+      require_signed_arithmetic(t);
+      specs->Sign = c == '+'   ? fmt_sign::PLUS
+                    : c == '-' ? fmt_sign::MINUS
+                               : fmt_sign::SPACE;
+      ++It;
+    }
+
+    if (peek() == '#') {
+      require_arithmetic(t);
+      specs->Hash = true;
+      ++It;
+    }
+
+    if (peek() == '0') {
+      require_arithmetic(t);
+      specs->Align = fmt_alignment::NUMERIC;
+      specs->Fill = '0';
+      ++It;
+    }
+
+    // Width
+    if (fmt_ct_is_digit(peek())) {
+      specs->Width = (u32) parse_u32();
+    } else if (peek() == '{') {
+      specs->WidthIndex = parse_dynamic_index();
+    }
+
+    // Precision
+    if (peek() == '.') {
+      ++It;
+      if (fmt_ct_is_digit(peek())) {
+        specs->Precision = (s32) parse_u32();
+      } else if (peek() == '{') {
+        specs->PrecisionIndex = parse_dynamic_index();
+      } else {
+        fmt_compile_error(
+            "Missing precision specifier (we parsed a dot but nothing valid "
+            "after that)");
+      }
+
+      if (fmt_ct_is_integral(t)) {
+        fmt_compile_error("Precision is not allowed for integer types");
+      }
+      if (t == fmt_type::POINTER) {
+        fmt_compile_error("Precision is not allowed for pointer type");
+      }
+    }
+
+    if (peek() && peek() != '}') specs->Type = Str[It++];
+
+    check_type_specifier(t, *specs);
+  }
+
+  consteval void check_type_specifier(fmt_type t, fmt_specs no_copy specs) {
+    char type = specs.Type;
+
+    // Bools with a type specifier are formatted as integers
+    if (t == fmt_type::BOOL && !type) return;
+
+    if (fmt_ct_is_integral(t)) {
+      if (!type || type == 'd' || type == 'n' || type == 'b' || type == 'B' ||
+          type == 'o' || type == 'x' || type == 'X') {
+        return;
+      }
+      if (type == 'c') {
+        if (specs.Align == fmt_alignment::NUMERIC ||
+            specs.Sign != fmt_sign::NONE || specs.Hash) {
+          fmt_compile_error(
+              "Invalid format specifier(s) for code point - code points "
+              "can't have numeric alignment, signs or #");
+        }
+        return;
+      }
+      fmt_compile_error("Invalid type specifier for an integer");
+    } else if (t == fmt_type::F32 || t == fmt_type::F64) {
+      if (!type || type == 'g' || type == 'G' || type == 'e' || type == 'E' ||
+          type == 'f' || type == 'F' || type == '%' || type == 'a' ||
+          type == 'A') {
+        return;
+      }
+      fmt_compile_error("Invalid type specifier for a float");
+    } else if (t == fmt_type::STRING) {
+      if (type && type != 's' && type != 'p') {
+        fmt_compile_error("Invalid type specifier for a string");
+      }
+    } else if (t == fmt_type::POINTER) {
+      if (type && type != 'p') {
+        fmt_compile_error("Invalid type specifier for a pointer");
+      }
+    }
+  }
+};
+
+template <s64 N>
+consteval void fmt_ct_add_text(fmt_compiled_fields<N> ref result,
+                               const char *data, s64 count) {
+  if (!count) return;
+
+  auto *last = result.Count ? &result.Fields[result.Count - 1] : null;
+  if (!last || last->Kind != fmt_compiled_field::LITERAL) {
+    last = &result.Fields[result.Count++];
+    last->Kind = fmt_compiled_field::LITERAL;
+    last->Begin = result.TextCount;
+    last->Count = 0;
+  }
+
+  for (s64 i = 0; i < count; ++i) result.Text[result.TextCount++] = data[i];
+  last->Count += count;
+}
+
+template <fmt_string_literal S, typename... Args>
+consteval auto fmt_compile() {
+  const s64 N = S.Count;
+
+  fmt_type argTypes[sizeof...(Args) + 1] = {fmt_ct_type<Args>...};
+
+  fmt_compiled_fields<N> result;
+  fmt_ct_parser p = {S.Data, N, 0, argTypes, sizeof...(Args)};
+
+  while (p.It < N) {
+    char c = S.Data[p.It];
+
+    if (c == '}') {
+      if (p.It + 1 >= N || S.Data[p.It + 1] != '}') {
+        fmt_compile_error(
+            "Unmatched \"}\" in format string - if you want to print it use "
+            "\"}}\" to escape");
+      }
+      fmt_ct_add_text(result, "}", 1);
+      p.It += 2;
+      continue;
+    }
+
+    if (c != '{') {
+      s64 start = p.It;
+      while (p.It < N && S.Data[p.It] != '{' && S.Data[p.It] != '}') ++p.It;
+      fmt_ct_add_text(result, S.Data + start, p.It - start);
+      continue;
+    }
+
+    ++p.It;  // Skip the {
+    if (p.It >= N) fmt_compile_error("Invalid format string");
+
+    if (S.Data[p.It] == '{') {
+      fmt_ct_add_text(result, "{", 1);
+      ++p.It;
+      continue;
+    }
+
+    if (S.Data[p.It] == '!') {
+      ++p.It;
+      s64 start = p.It;
+      while (p.It < N && S.Data[p.It] != '}') ++p.It;
+      if (p.It >= N) fmt_compile_error("\"}\" expected");
+
+      auto *field = &result.Fields[result.Count++];
+      field->Kind = fmt_compiled_field::STYLE;
+      field->Begin = start;
+      field->Count = p.It - start;
+      ++p.It;  // Skip the }
+      continue;
+    }
+
+    auto *field = &result.Fields[result.Count++];
+    field->Kind = fmt_compiled_field::ARG;
+    field->ArgIndex = p.parse_arg_id();
+
+    if (p.peek() == ':') {
+      ++p.It;
+      field->HasSpecs = true;
+      p.parse_specs(argTypes[field->ArgIndex], &field->Specs);
+    }
+
+    if (p.peek() != '}') fmt_compile_error("\"}\" expected");
+    ++p.It;  // Skip the }
+  }
+  return result;
+}
+
+// Parses and copies the result into arrays of the exact size, so only
+// those end up in the binary
+template <fmt_string_literal S, typename... Args>
+consteval auto fmt_compile_sized() {
+  constexpr auto parsed = fmt_compile<S, Args...>();
+
+  fmt_compiled_result<parsed.Count, parsed.TextCount> result;
+  for (s64 i = 0; i < parsed.Count; ++i) result.Fields[i] = parsed.Fields[i];
+  for (s64 i = 0; i < parsed.TextCount; ++i) result.Text[i] = parsed.Text[i];
+  return result;
+}
+}  // namespace internal
+
+// Holds the parsed fields for a format string and argument types.
+// The parsing happens once per combination, when this is instantiated.
+template <fmt_string_literal S, typename... Args>
+struct fmt_compiled {
+  static constexpr auto Result = internal::fmt_compile_sized<S, Args...>();
+};
+
+LSTD_END_NAMESPACE
@@ -140,6 +140,11 @@ void write_u64(fmt_context *f, u64 value, bool negative, fmt_specs specs);
 // write() function.
 void write_float(fmt_context *f, is_floating_point auto value, fmt_specs specs);
 
+void write_float_significand(fmt_context *f, string significand, s32 exp,
+                             code_point sign, fmt_specs no_copy specs,
+                             fmt_float_specs no_copy floatSpecs,
+                             bool percentage);
+
 //
 // The implementations of the above functions follow:
 //
@@ -193,9 +198,15 @@ inline char FORMAT_UINT_DIGITS[] =
     "6061626364656667686970717273747576777879"
     "8081828384858687888990919293949596979899";
 
+// Copies the two digits of _value_ (< 100) to _p_
+always_inline void format_two_digits(char *p, u32 value) {
+  memcpy(p, FORMAT_UINT_DIGITS + value * 2, 2);
+}
+
+// Formats the number with thousands separators between every 3 digits
 template <typename UInt>
-char *format_uint_decimal(char *buffer, UInt value, s64 formattedSize,
-                          string thousandsSep = "") {
+char *format_uint_decimal_separated(char *buffer, UInt value,
+                                    s64 formattedSize, string thousandsSep) {
   u32 digitIndex = 0;
 
   buffer += formattedSize;
@@ -230,6 +241,52 @@ char *format_uint_decimal(char *buffer, UInt value, s64 formattedSize,
   return buffer;
 }
 
+// Writes the digits of _value_ so they end at buffer + formattedSize and
+// returns a pointer to the first digit.
+//
+// Emits two digits per step from the table above. 64-bit values are first
+// cut into chunks of 8 digits so most of the divisions are 32-bit ones (which
+// are much cheaper), the 4 pairs in a chunk don't depend on each other.
+template <typename UInt>
+char *format_uint_decimal(char *buffer, UInt value, s64 formattedSize,
+                          string thousandsSep = "") {
+  if (thousandsSep.Count) {
+    return format_uint_decimal_separated(buffer, value, formattedSize,
+                                         thousandsSep);
+  }
+
+  buffer += formattedSize;
+
+  if constexpr (sizeof(UInt) > sizeof(u32)) {
+    while (value >= 100000000) {
+      u32 chunk = (u32)(value % 100000000);
+      value /= 100000000;
+
+      u32 high = chunk / 10000, low = chunk % 10000;
+      buffer -= 8;
+      format_two_digits(buffer, high / 100);
+      format_two_digits(buffer + 2, high % 100);
+      format_two_digits(buffer + 4, low / 100);
+      format_two_digits(buffer + 6, low % 100);
+    }
+  }
+
+  auto v = (u32)value;
+  while (v >= 100) {
+    buffer -= 2;
+    format_two_digits(buffer, v % 100);
+    v /= 100;
+  }
+
+  if (v < 10) {
+    *--buffer = (char)('0' + v);
+  } else {
+    buffer -= 2;
+    format_two_digits(buffer, v);
+  }
+  return buffer;
+}
+
 template <u32 BASE_BITS, typename UInt>
 char *format_uint_base(char *buffer, UInt value, s64 formattedSize,
                        bool upper = false) {
@@ -343,6 +400,20 @@ inline void write_u64(fmt_context *f, u64 value, bool negative,
   char type = specs.Type;
   if (!type) type = 'd';
 
+  // Fast path for the most common case - no width, sign or prefix. The digits
+  // go in a buffer which is written with one call.
+  if (type == 'd' && !specs.Width && specs.Sign == fmt_sign::NONE) {
+    char buffer[numeric<u64>::digits10 + 2];  // u64 max has 20 digits, + '-'
+
+    u32 numDigits = count_digits(value);
+    char *end = buffer + sizeof(buffer);
+    char *p = format_uint_decimal(end - numDigits, value, numDigits);
+    if (negative) *--p = '-';
+
+    write_no_specs(f, p, end - p);
+    return;
+  }
+
   s64 numDigits;
   if (type == 'd' || type == 'n') {
     numDigits = count_digits(value);
@@ -399,7 +470,7 @@ inline void write_u64(fmt_context *f, u64 value, bool negative,
   }
 
   auto prefix = string(prefixBuffer, prefixPointer - prefixBuffer);
-  auto prefixLength = length(prefix);
+  auto prefixLength = prefix.Count;  // ASCII
 
   s64 formattedSize = prefixLength + numDigits;
   s64 padding = 0;
@@ -415,7 +486,7 @@ inline void write_u64(fmt_context *f, u64 value, bool negative,
   }
   if (specs.Align == fmt_alignment::NONE) specs.Align = fmt_alignment::RIGHT;
 
-  char U64_FORMAT_BUFFER[numeric<u64>::digits + 1]{};
+  char U64_FORMAT_BUFFER[numeric<u64>::digits + 1];
 
   if (type == 'n') {
     formattedSize += ((numDigits - 1) / 3);
@@ -488,10 +559,12 @@ inline void write_significand(fmt_context *f, string significand,
   if (!significand.Count)
     return;  // The significand is actually empty if the value formatted is 0
 
-  write_no_specs(f, slice(significand, 0, integralSize));
+  // The digits are ASCII so we slice by bytes (slice() counts code points)
+  write_no_specs(f, significand.Data, integralSize);
   if (decimalPoint) {
     write_no_specs(f, decimalPoint);
-    write_no_specs(f, slice(significand, integralSize, significand.Count));
+    write_no_specs(f, significand.Data + integralSize,
+                   significand.Count - integralSize);
   }
 }
 
@@ -745,6 +818,27 @@ inline void write_float(fmt_context *f, is_floating_point auto value,
     specs.Align = fmt_alignment::RIGHT;
   }
 
+  if (specs.Precision < 0) {
+    // Shortest representation which round trips. Dragonbox gives us the
+    // digits as an integer, so we format them straight into a small buffer.
+    char digits[numeric<u64>::digits10 + 1];
+    s32 exp = 0;
+    u32 numDigits = 1;
+
+    if (value == 0) {
+      digits[0] = '0';
+    } else {
+      auto dec = dragonbox_format_float(value);
+      numDigits = count_digits(dec.Significand);
+      format_uint_decimal(digits, dec.Significand, numDigits);
+      exp = dec.Exponent;
+    }
+
+    write_float_significand(f, string(digits, numDigits), exp, sign, specs,
+                            floatSpecs, percentage);
+    return;
+  }
+
   // This routine writes the significand in the floatBuffer, then we use the
   // returned exponent to choose how to format the final string. The returned
   // exponent is the exponent base 10 of the LAST written digit in
@@ -771,7 +865,17 @@ inline void write_float(fmt_context *f, is_floating_point auto value,
 
   string significand = string((char *)floatBuffer.BaseBuffer.Data,
                               floatBuffer.BaseBuffer.Occupied);
+  write_float_significand(f, significand, exp, sign, specs, floatSpecs,
+                          percentage);
+}
 
+// Chooses between EXP and FIXED and writes the digits in _significand_,
+// _exp_ is the exponent base 10 of the last digit.
+inline void write_float_significand(fmt_context *f, string significand,
+                                    s32 exp, code_point sign,
+                                    fmt_specs no_copy specs,
+                                    fmt_float_specs no_copy floatSpecs,
+                                    bool percentage) {
   s64 outputExp = exp + significand.Count - 1;
 
   bool useExpFormat = false;
@@ -6,26 +6,6 @@
 
 LSTD_BEGIN_NAMESPACE
 
-inline void add_u64(string_builder *builder, u64 value) {
-  const s32 BUFFER_SIZE = numeric<u64>::digits10;
-  char buffer[BUFFER_SIZE];
-
-  auto *p = buffer + BUFFER_SIZE - 1;
-
-  if (!value) {
-    *p-- = '0';
-  }
-
-  while (value) {
-    auto d = value % 10;
-    *p-- = (char)('0' + d);
-    value /= 10;
-  }
-
-  ++p;  // Roll back
-  add(builder, p, buffer + BUFFER_SIZE - p);
-}
-
 // The returned exponent is the exponent base 10 of the LAST written digit in
 // _floatBuffer_. In the end, _floatBuffer_ contains the digits of the final
 // number to be written out, without the dot.
@@ -46,16 +26,12 @@ s32 fmt_format_non_negative_float(string_builder *floatBuffer,
     return -precision;
   }
 
-  // If precision is still -1 (because no precision and no spec type was
-  // specified), use Dragonbox for the shortest format. We set a default
-  // precision to 6 before calling this routine in the cases when the format
-  // string didn't specify a precision, but specified a specific format
-  // (GENERAL, EXP, FIXED, etc.)
-  if (precision < 0) {
-    auto dec = dragonbox_format_float(value);
-    add_u64(floatBuffer, dec.Significand);
-    return dec.Exponent;
-  }
+  // The shortest format (precision -1, when no precision and no spec type was
+  // specified) doesn't get here, write_float() formats Dragonbox's output
+  // directly. We set a default precision to 6 before calling this routine in
+  // the cases when the format string didn't specify a precision, but
+  // specified a specific format (GENERAL, EXP, FIXED, etc.)
+  assert(precision >= 0);
 
   return grisu_format_float(floatBuffer, value, precision, specs);
 }
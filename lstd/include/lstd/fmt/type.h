@@ -51,6 +51,6 @@ TYPE_CONSTANT(void *, fmt_type::POINTER);
 #undef TYPE_CONSTANT
 
 template <typename T>
-auto fmt_type_constant_v = fmt_type_constant<remove_cvref_t<T>>::value;
+constexpr auto fmt_type_constant_v = fmt_type_constant<remove_cvref_t<T>>::value;
 
 LSTD_END_NAMESPACE
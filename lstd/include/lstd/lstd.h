@@ -1,9 +1,14 @@
 #pragma once
 
 #include "array.h"
+#include "atom.h"
 #include "atomic.h"
 #include "big_integer.h"
+#include "binary_log.h"
 #include "bits.h"
+#include "bitset.h"
+#include "btree.h"
+#include "bucket_array.h"
 #include "common.h"
 #include "context.h"
 #include "delegate.h"
@@ -12,8 +17,16 @@
 #include "lstd/math.h"
 #include "memory.h"
 #include "os.h"
+#include "parallel.h"
 #include "parse.h"
+#include "piece_table.h"
 #include "qsort.h"
+#include "radix_sort.h"
+#include "reader.h"
+#include "ring_queue.h"
+#include "simd.h"
+#include "small_array.h"
+#include "soa_array.h"
 #include "stack_array.h"
 #include "string.h"
 #include "string_builder.h"
@@ -617,6 +617,128 @@ inline void *pool_allocator(allocator_mode mode, void *context, s64 size,
   return null;
 }
 
+//
+// Small block allocator.
+//
+// Short strings (identifiers, tokens, path components, hash table keys) and
+// other tiny buffers make up most of the allocations in a typical program,
+// yet each one pays for a trip through the general purpose allocator.
+// This allocator serves blocks of up to SMALL_BLOCK_MAX_SIZE bytes
+// (including the allocation header) from per-size-class pools which carve
+// their chunks out of bigger slabs. Bigger requests are passed to the parent.
+//
+// It's transparent to code which allocates through the Context, e.g.
+//
+//      small_block_allocator_data smallData;
+//      smallData.Parent = Context.Alloc;
+//
+//      PUSH_ALLOC((allocator{small_block_allocator, &smallData})) {
+//          tokenize(...);  // add(), clone(), free() etc. just work
+//      }
+//      free_all({small_block_allocator, &smallData});
+//
+// Resizing within the same size class happens in place, otherwise we return
+// null and the caller moves the block (to another class or to the parent).
+//
+// Note: We can't store small strings inside the _string_ object itself (SSO)
+// since strings are views which are freely copied and relocated with memcpy
+// (e.g. when an array of strings grows), so a pointer into the object would
+// dangle.
+//
+// Not thread-safe, use one per thread (or guard it with a mutex).
+//
+inline const s64 SMALL_BLOCK_CLASS_SIZES[] = {64, 128, 256};
+inline const s64 SMALL_BLOCK_CLASS_COUNT = 3;
+inline const s64 SMALL_BLOCK_MAX_SIZE = 256;
+
+struct small_block_allocator_data {
+  allocator Parent;  // You must set this before using the allocator
+
+  // How much memory we request from _Parent_ when a class runs out
+  s64 SlabSize = 16_KiB;
+
+  pool_allocator_data Classes[SMALL_BLOCK_CLASS_COUNT];
+};
+
+namespace internal {
+// Returns -1 if _size_ is too big for any class.
+inline s64 small_block_class(s64 size) {
+  For(range(SMALL_BLOCK_CLASS_COUNT)) {
+    if (size <= SMALL_BLOCK_CLASS_SIZES[it]) return it;
+  }
+  return -1;
+}
+}  // namespace internal
+
+inline void *small_block_allocator(allocator_mode mode, void *context,
+                                   s64 size, void *oldMemory, s64 oldSize,
+                                   u64 options) {
+  auto *data = (small_block_allocator_data *)context;
+  auto parent = data->Parent;
+  assert(parent && "Parent allocator not set");
+
+  switch (mode) {
+    case allocator_mode::ALLOCATE: {
+      s64 c = internal::small_block_class(size);
+      if (c == -1) {
+        return parent.Function(mode, parent.Context, size, oldMemory, oldSize,
+                               options);
+      }
+
+      auto *pool = data->Classes + c;
+      pool->ElementSize = SMALL_BLOCK_CLASS_SIZES[c];
+
+      if (!pool->FreeList) {
+        s64 slabSize = sizeof(pool_allocator_data::block) +
+                       (data->SlabSize / pool->ElementSize) * pool->ElementSize;
+        void *slab = parent.Function(allocator_mode::ALLOCATE, parent.Context,
+                                     slabSize, null, 0, options);
+        if (!slab) return null;
+        pool_allocator_provide_block(pool, slab, slabSize);
+      }
+      return pool_allocator(mode, pool, pool->ElementSize, null, 0, options);
+    }
+    case allocator_mode::RESIZE: {
+      s64 oldClass = internal::small_block_class(oldSize);
+      s64 newClass = internal::small_block_class(size);
+      if (oldClass == -1 && newClass == -1) {
+        return parent.Function(mode, parent.Context, size, oldMemory, oldSize,
+                               options);
+      }
+      if (oldClass == newClass) return oldMemory;
+      return null;
+    }
+    case allocator_mode::FREE: {
+      s64 c = internal::small_block_class(oldSize);
+      if (c == -1) {
+        return parent.Function(mode, parent.Context, size, oldMemory, oldSize,
+                               options);
+      }
+      return pool_allocator(mode, data->Classes + c, 0, oldMemory, oldSize,
+                            options);
+    }
+    case allocator_mode::FREE_ALL: {
+      // Give the slabs back to the parent. Big blocks are allocated directly
+      // from the parent, so those are the parent's business.
+      For(range(SMALL_BLOCK_CLASS_COUNT)) {
+        auto *pool = data->Classes + it;
+        auto *b = pool->Base;
+        while (b) {
+          auto *next = b->Next;
+          parent.Function(allocator_mode::FREE, parent.Context, 0, b,
+                          b->Size + sizeof(pool_allocator_data::block),
+                          options);
+          b = next;
+        }
+        pool->Base = null;
+        pool->FreeList = null;
+      }
+      return null;
+    }
+  }
+  return null;
+}
+
 // Calculates the required padding in bytes which needs to be added to _ptr_
 // in order to be aligned
 inline u16 calculate_padding_for_pointer(void *ptr, s32 alignment) {
@@ -27,5 +27,7 @@
 #include "os/dynamic_library.h"
 #include "os/memory.h"
 #include "os/thread.h"
+#include "os/job_system.h"
+#include "os/async_writer.h"
 #include "os/path.h"
 
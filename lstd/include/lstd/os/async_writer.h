@@ -0,0 +1,385 @@
+#pragma once
+
+#include "common.h"
+#include "thread.h"
+
+LSTD_BEGIN_NAMESPACE
+
+//
+// Console output for programs which log from many threads.
+//
+// Writing to _cout_ takes a global lock and blocks on the console, so threads
+// which print a lot wait on each other. Here each thread appends to its own
+// ring buffer (no locks, no syscalls) and a background thread collects what
+// all threads have written and hands it to the OS in one go (writev on posix).
+//
+//      async_writer log;
+//      init_async_writer(&log, console::COUT);
+//      defer(free(log));
+//
+//      auto newContext = Context;
+//      newContext.Log = &log;
+//      OVERRIDE_CONTEXT(newContext);  // Threads created after this inherit it
+//
+//      print("Hello from thread {}\n", Context.ThreadID);
+//
+// Everything written between two flushes (print flushes at the end) is
+// published at once, so a message never gets split by output from other
+// threads, as long as it fits in a ring (_RingSize_). Output from one thread
+// stays in order. Writes larger than the ring are passed through: we wait for
+// the thread's earlier output to be written and then write directly.
+//
+// The background thread wakes up when something is published, writes it, and
+// then collects output for ASYNC_WRITER_FLUSH_INTERVAL_MS before writing
+// again, so under load it's one syscall per interval instead of one per
+// print, and printing threads don't have to wake it. When a ring is full the
+// thread wakes the background thread and waits, output is never dropped.
+//
+// Each thread which writes gets a ring on the first write and keeps it until
+// it exits (threads created with create_and_launch_thread publish what they
+// have left and give the ring back, the next thread that needs one reuses it).
+// If more than ASYNC_WRITER_MAX_THREADS threads hold a ring at the same time,
+// the rest go through _cout_ / _cerr_. The writer object itself must outlive
+// the threads which wrote to it.
+//
+const s64 ASYNC_WRITER_RING_SIZE = 64_KiB;
+const s64 ASYNC_WRITER_MAX_THREADS = 64;
+const u32 ASYNC_WRITER_FLUSH_INTERVAL_MS = 1;
+
+namespace internal {
+struct async_writer_ring {
+  alignas(64) s64 Head = 0;  // Written up to here (by the background thread)
+  alignas(64) s64 Tail = 0;  // Published up to here (by the owner)
+
+  s64 Pending = 0;  // Copied up to here but not published, only the owner touches this
+  u64 Owner = 0;    // Thread ID, 0 if the ring is free
+  char *Data = null;
+};
+}  // namespace internal
+
+struct async_writer : writer {
+  console::output_type OutputType = console::COUT;
+  s64 RingSize = 0;  // Power of 2
+
+  // Changes each init so threads know their cached ring is gone
+  s64 Generation = 0;
+
+  internal::async_writer_ring *Rings[ASYNC_WRITER_MAX_THREADS] = {};
+  s64 RingCount = 0;
+
+  alignas(64) parker HasOutput;  // The background thread sleeps here when idle
+  alignas(64) parker FlushNow;   // ... and here between writes
+  alignas(64) parker HasSpace;   // Threads with a full ring wait here
+
+  // Set while the background thread sleeps on _HasOutput_, the first publish
+  // clears it and wakes it
+  s32 Idle = 0;
+
+  s32 Quit = 0;
+  thread Thread;
+
+  void write(const char *data, s64 size) override;
+  void flush() override;
+};
+
+namespace internal {
+inline s64 AsyncWriterGeneration = 0;
+
+// The ring of the writer this thread used last
+struct async_writer_ring_cache {
+  async_writer *Writer = null;
+  s64 Generation = 0;
+  async_writer_ring *Ring = null;
+};
+inline thread_local async_writer_ring_cache AsyncWriterRingCache;
+
+// Returns null if this thread hasn't written to _w_ yet
+inline async_writer_ring *async_writer_find_ring(async_writer *w) {
+  auto *cache = &AsyncWriterRingCache;
+  if (cache->Writer == w && cache->Generation == w->Generation) {
+    return cache->Ring;
+  }
+
+  // This thread might have written to _w_ before and then used another writer
+  u64 id = Context.ThreadID;
+
+  s64 count = atomic_load(&w->RingCount);
+  For(range(count)) {
+    auto *r = atomic_load(&w->Rings[it]);
+    if (r && atomic_load(&r->Owner) == id) {
+      *cache = {w, w->Generation, r};
+      return r;
+    }
+  }
+  return null;
+}
+
+inline void async_writer_publish(async_writer *w, async_writer_ring *r) {
+  if (r->Pending == r->Tail) return;
+
+  atomic_store(&r->Tail, r->Pending);
+
+  // Only one thread wakes it. unpark_all() alone would make a syscall on
+  // every publish until the background thread gets to run.
+  if (atomic_load(&w->Idle) && atomic_swap(&w->Idle, 0)) {
+    unpark_all(&w->HasOutput);
+  }
+}
+
+// Runs on thread exit, see async_writer_get_ring
+inline void async_writer_release_rings(void *data) {
+  auto *w = (async_writer *) data;
+  if (!atomic_load(&w->RingSize)) return;  // Freed since
+
+  u64 id = Context.ThreadID;
+
+  s64 count = atomic_load(&w->RingCount);
+  For(range(count)) {
+    auto *r = atomic_load(&w->Rings[it]);
+    if (!r || atomic_load(&r->Owner) != id) continue;
+
+    // The next owner continues from _Tail_
+    async_writer_publish(w, r);
+    atomic_store(&r->Owner, (u64) 0);
+  }
+
+  if (AsyncWriterRingCache.Writer == w) AsyncWriterRingCache = {};
+}
+
+// Returns null if all rings are taken
+inline async_writer_ring *async_writer_get_ring(async_writer *w) {
+  auto *r = async_writer_find_ring(w);
+  if (r) return r;
+
+  u64 id = Context.ThreadID;
+
+  // Take a ring which was given back by a thread that exited
+  s64 count = atomic_load(&w->RingCount);
+  For(range(count)) {
+    auto *given = atomic_load(&w->Rings[it]);
+    if (given && atomic_load(&given->Owner) == 0 &&
+        atomic_compare_and_swap(&given->Owner, (u64) 0, id) == 0) {
+      r = given;
+      break;
+    }
+  }
+
+  if (!r) {
+    s64 slot = atomic_load(&w->RingCount);
+    while (true) {
+      if (slot == ASYNC_WRITER_MAX_THREADS) return null;
+
+      s64 old = atomic_compare_and_swap(&w->RingCount, slot, slot + 1);
+      if (old == slot) break;
+      slot = old;
+    }
+
+    // Thread-safe. Rings larger than its pools are requested from the OS
+    // directly.
+    auto alloc = platform_get_persistent_allocator();
+
+    r = malloc<async_writer_ring>({.Alloc = alloc, .Alignment = 64});
+    r->Owner = id;
+    r->Data = malloc<char>({.Count = w->RingSize, .Alloc = alloc});
+
+    // The background thread skips the slot until it sees the pointer
+    atomic_store(&w->Rings[slot], r);
+  }
+
+  // If this thread has too many exit callbacks the ring just isn't given back
+  thread_exit_schedule(&async_writer_release_rings, w);
+
+  AsyncWriterRingCache = {w, w->Generation, r};
+  return r;
+}
+
+// Blocks until the ring has _size_ free bytes
+inline void async_writer_wait_for_space(async_writer *w, async_writer_ring *r,
+                                        s64 size) {
+  auto has_space = [&]() {
+    return w->RingSize - (r->Pending - atomic_load(&r->Head)) >= size;
+  };
+
+  while (!has_space()) {
+    s32 ticket = prepare_park(&w->HasSpace);
+    if (has_space()) {
+      cancel_park(&w->HasSpace);
+      break;
+    }
+
+    // Don't wait for the end of the interval
+    unpark_all(&w->FlushNow);
+    park(&w->HasSpace, ticket);
+  }
+}
+
+// True if a ring has at least _size_ bytes published
+inline bool async_writer_has_output(async_writer *w, s64 size = 1) {
+  s64 count = atomic_load(&w->RingCount);
+  For(range(count)) {
+    auto *r = atomic_load(&w->Rings[it]);
+    if (r && atomic_load(&r->Tail) - r->Head >= size) return true;
+  }
+  return false;
+}
+
+inline void async_writer_thread(void *data) {
+  auto *w = (async_writer *) data;
+
+  // A ring which wraps around is two pieces
+  string buffers[2 * ASYNC_WRITER_MAX_THREADS];
+
+  async_writer_ring *rings[ASYNC_WRITER_MAX_THREADS];
+  s64 tails[ASYNC_WRITER_MAX_THREADS];
+
+  s64 mask = w->RingSize - 1;
+
+  while (true) {
+    s64 bufferCount = 0, ringCount = 0;
+
+    s64 count = atomic_load(&w->RingCount);
+    For(range(count)) {
+      auto *r = atomic_load(&w->Rings[it]);
+      if (!r) continue;
+
+      s64 head = r->Head;
+      s64 tail = atomic_load(&r->Tail);
+      if (head == tail) continue;
+
+      rings[ringCount] = r;
+      tails[ringCount] = tail;
+      ++ringCount;
+
+      s64 start = head & mask;
+      s64 size = tail - head;
+      s64 first = min(size, w->RingSize - start);
+
+      buffers[bufferCount++] = string(r->Data + start, first);
+      if (size > first) buffers[bufferCount++] = string(r->Data, size - first);
+    }
+
+    if (bufferCount) {
+      os_write_to_console(w->OutputType, buffers, bufferCount);
+
+      For(range(ringCount)) atomic_store(&rings[it]->Head, tails[it]);
+      unpark_all(&w->HasSpace);
+
+      // Let output pile up, unless a ring is filling up
+      s32 ticket = prepare_park(&w->FlushNow);
+      if (async_writer_has_output(w, w->RingSize / 2) ||
+          atomic_load(&w->Quit)) {
+        cancel_park(&w->FlushNow);
+      } else {
+        park(&w->FlushNow, ticket, ASYNC_WRITER_FLUSH_INTERVAL_MS);
+      }
+      continue;
+    }
+
+    // Quit only after everything published has been written
+    if (atomic_load(&w->Quit)) break;
+
+    s32 ticket = prepare_park(&w->HasOutput);
+    atomic_store(&w->Idle, 1);
+    if (async_writer_has_output(w) || atomic_load(&w->Quit)) {
+      atomic_store(&w->Idle, 0);
+      cancel_park(&w->HasOutput);
+      continue;
+    }
+    park(&w->HasOutput, ticket);
+    atomic_store(&w->Idle, 0);
+  }
+}
+}  // namespace internal
+
+inline void async_writer::write(const char *data, s64 size) {
+  assert(RingSize && "Async writer not initialized (call init_async_writer)");
+
+  auto *r = internal::async_writer_get_ring(this);
+  if (!r) {
+    (OutputType == console::COUT ? cout : cerr).write(data, size);
+    return;
+  }
+
+  if (size > RingSize) {
+    // Write out what this thread has so far so the order is kept
+    internal::async_writer_publish(this, r);
+    internal::async_writer_wait_for_space(this, r, RingSize);
+
+    string s(data, size);
+    os_write_to_console(OutputType, &s, 1);
+    return;
+  }
+
+  if (RingSize - (r->Pending - atomic_load(&r->Head)) < size) {
+    // Wait for the published part to be written, maybe the message fits then
+    s64 unpublished = r->Pending - r->Tail;
+    internal::async_writer_wait_for_space(this, r,
+                                          min(size, RingSize - unpublished));
+
+    if (RingSize - unpublished < size) {
+      // The message is larger than the ring, so it gets split. Hand over
+      // the start of it to make space.
+      internal::async_writer_publish(this, r);
+      internal::async_writer_wait_for_space(this, r, size);
+    }
+  }
+
+  s64 start = r->Pending & (RingSize - 1);
+  s64 first = min(size, RingSize - start);
+
+  memcpy(r->Data + start, data, first);
+  if (size > first) memcpy(r->Data, data + first, size - first);
+
+  r->Pending += size;
+}
+
+inline void async_writer::flush() {
+  auto *r = internal::async_writer_find_ring(this);
+  if (r) {
+    internal::async_writer_publish(this, r);
+  } else if (atomic_load(&RingCount) == ASYNC_WRITER_MAX_THREADS) {
+    (OutputType == console::COUT ? cout : cerr).flush();
+  }
+}
+
+// Launches the background thread. The writer must stay in place while it's
+// running (the thread gets a pointer to it). _ringSize_ must be a power of 2.
+inline void init_async_writer(async_writer *w, console::output_type type,
+                              s64 ringSize = ASYNC_WRITER_RING_SIZE) {
+  assert(ringSize > 0 && (ringSize & (ringSize - 1)) == 0 &&
+         "Ring size must be a power of 2");
+
+  w->OutputType = type;
+  w->RingSize = ringSize;
+  w->Generation = atomic_inc(&internal::AsyncWriterGeneration);
+  w->Quit = 0;
+  w->Thread = create_and_launch_thread(&internal::async_writer_thread, w);
+}
+
+// Writes out everything that was flushed and stops the background thread.
+// Output which other threads haven't flushed yet is lost, so they should be
+// done printing.
+inline void free(async_writer ref w) {
+  if (!w.RingSize) return;
+
+  w.flush();
+
+  atomic_store(&w.Quit, 1);
+  unpark_all(&w.HasOutput);
+  unpark_all(&w.FlushNow);
+  wait(w.Thread);
+
+  For(range(w.RingCount)) {
+    auto *r = w.Rings[it];
+    if (!r) continue;
+
+    free(r->Data);
+    free(r);
+    w.Rings[it] = null;
+  }
+
+  w.RingCount = 0;
+  w.RingSize = 0;
+}
+
+LSTD_END_NAMESPACE
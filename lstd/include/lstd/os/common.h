@@ -39,6 +39,64 @@ mark_as_leak optional<string> os_read_entire_file(string path);
 // Returns true on success.
 bool os_write_to_file(string path, string contents, file_write_mode mode);
 
+//
+// Streaming reads, for files which are too large to read in memory at once
+// (see _file_reader_ in reader.h). _File_ is a platform specific handle.
+//
+struct os_open_file_result {
+  void *File;
+  bool Success;
+};
+
+os_open_file_result os_open_file_for_reading(string path);
+
+// Reads at most _size_ bytes in _buffer_. Returns how many bytes were read,
+// 0 at the end of the file and -1 on error.
+s64 os_read_file(void *file, char *buffer, s64 size);
+
+void os_close_file(void *file);
+
+// Opens a file for streaming writes with os_write_file(). Close it with
+// os_close_file().
+os_open_file_result os_open_file_for_writing(string path, file_write_mode mode);
+
+// Writes _buffers_ to the file in order without merging them first (one
+// writev per 64 buffers on posix). Returns false on error.
+bool os_write_file(void *file, const string *buffers, s64 count);
+
+// Writes the builder's contents, buffer by buffer, without building a string
+// first (see builder_view in string_builder.h)
+inline bool os_write_file(void *file, const string_builder *builder) {
+  string buffers[64];
+  s64 count = 0;
+
+  For(builder_view(builder)) {
+    buffers[count++] = it;
+    if (count == 64) {
+      if (!os_write_file(file, buffers, count)) return false;
+      count = 0;
+    }
+  }
+  return os_write_file(file, buffers, count);
+}
+
+//
+// Maps a file in memory (read-only). The OS pages it in as it's accessed, so
+// reading a large file doesn't need a buffer or any copying.
+//
+struct os_mapped_file {
+  string Contents;
+  void *Handle = null;  // Platform specific
+};
+
+struct os_map_file_result {
+  os_mapped_file File;
+  bool Success;
+};
+
+os_map_file_result os_map_file(string path);
+void os_unmap_file(os_mapped_file file);
+
 // Returns a time stamp that can be used for time-interval measurements
 time_t os_get_time();
 
@@ -86,6 +144,11 @@ u64 os_get_current_thread_id();
 // If you need to keep old results make sure to clone string or copy elsewhere.
 string os_read_from_console_overwrite_previous_call();
 
+// Writes _buffers_ to the console in order, unbuffered and without locking
+// (unlike _cout_ and _cerr_). On posix it's a single writev for all of them.
+// Used by _async_writer_ to flush many threads' output with one syscall.
+void os_write_to_console(console::output_type type, const string *buffers, s64 count);
+
 struct os_get_env_result {
   string Value;
   bool Success;
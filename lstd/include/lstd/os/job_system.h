@@ -0,0 +1,412 @@
+#pragma once
+
+#include "common.h"
+#include "thread.h"
+
+LSTD_BEGIN_NAMESPACE
+
+//
+// Job system.
+//
+// A fixed set of worker threads which run small jobs (a function and a
+// pointer), instead of creating a thread for each piece of work. Each worker
+// has its own deque (Chase-Lev): it pushes and pops jobs at the bottom
+// without locking, idle workers steal from the top of other workers' deques.
+// Threads which aren't workers (e.g. the main thread) submit through a shared
+// queue.
+//
+// Fork-join is done with counters: run_jobs() adds the number of jobs to the
+// counter, each finished job decrements it, wait() returns when it reaches 0.
+// A thread which waits runs other jobs in the meantime, so a job can itself
+// start jobs and wait for them (that's how you express dependencies) without
+// blocking a worker. When there is nothing left to take it sleeps until a
+// counter reaches 0 or new jobs are queued.
+//
+//      job jobs[16];
+//      For(range(16)) jobs[it] = {.Function = &mesh_chunk, .Data = chunks + it};
+//
+//      job_counter counter;
+//      run_jobs(jobs, 16, &counter);
+//      ... do something else ...
+//      wait(&counter);
+//
+// The jobs are NOT copied, they must stay alive until the counter reaches 0.
+// This way the job system never allocates.
+//
+// The Context's Alloc, Log and allocation options of the thread which called
+// run_jobs() are used while the job runs.
+//
+// If a queue is full the job is run right away on the submitting thread.
+//
+struct job_counter {
+  s64 Value = 0;
+};
+
+struct job {
+  delegate<void(void *)> Function;
+  void *Data = null;
+
+  // These are set by run_jobs()
+  job_counter *Counter = null;
+
+  allocator Alloc;
+  u16 AllocAlignment;
+  u64 AllocOptions;
+  writer *Log;
+};
+
+struct job_system;
+
+namespace internal {
+// Chase-Lev work stealing deque with a fixed capacity
+struct job_deque {
+  static const s64 CAPACITY = 4096;  // Power of 2
+
+  alignas(64) s64 Top;
+  alignas(64) s64 Bottom;
+
+  job *Jobs[CAPACITY];
+
+  job_system *System;
+  s64 Index;
+};
+
+// Called only by the owner
+inline bool job_deque_push(job_deque *d, job *j) {
+  s64 b = atomic_load(&d->Bottom);
+  s64 t = atomic_load(&d->Top);
+  if (b - t >= job_deque::CAPACITY) return false;
+
+  d->Jobs[b & (job_deque::CAPACITY - 1)] = j;
+  atomic_store(&d->Bottom, b + 1);
+  return true;
+}
+
+// Called only by the owner
+inline job *job_deque_pop(job_deque *d) {
+  s64 b = atomic_load(&d->Bottom) - 1;
+  atomic_store(&d->Bottom, b);
+  s64 t = atomic_load(&d->Top);
+
+  if (t > b) {
+    // Empty
+    atomic_store(&d->Bottom, b + 1);
+    return null;
+  }
+
+  job *j = d->Jobs[b & (job_deque::CAPACITY - 1)];
+  if (t == b) {
+    // Last job, race with the thieves
+    if (atomic_compare_and_swap(&d->Top, t, t + 1) != t) j = null;
+    atomic_store(&d->Bottom, b + 1);
+  }
+  return j;
+}
+
+// Called by any thread
+inline job *job_deque_steal(job_deque *d) {
+  s64 t = atomic_load(&d->Top);
+  s64 b = atomic_load(&d->Bottom);
+  if (t >= b) return null;
+
+  job *j = d->Jobs[t & (job_deque::CAPACITY - 1)];
+  if (atomic_compare_and_swap(&d->Top, t, t + 1) != t) return null;
+  return j;
+}
+
+// Set for worker threads
+inline thread_local job_system *JobWorkerSystem;
+inline thread_local s64 JobWorkerIndex;
+
+inline thread_local u32 JobStealSeed;
+}  // namespace internal
+
+struct job_system {
+  static const s64 SHARED_QUEUE_CAPACITY = 4096;  // Power of 2
+
+  s64 WorkerCount = 0;
+  internal::job_deque *Deques = null;  // One per worker
+  thread *Threads = null;
+
+  // Jobs submitted by threads which aren't workers
+  fast_mutex SharedMutex;
+  job *Shared[SHARED_QUEUE_CAPACITY];
+  s64 SharedHead = 0, SharedTail = 0;
+
+  // Jobs in the queues, workers go to sleep when there are none
+  s64 Pending = 0;
+
+  s64 Sleepers = 0;
+  mutex SleepMutex;
+  condition_variable WakeUp;
+
+  // Threads in wait() sleep here, woken when a counter reaches 0 or jobs
+  // are queued. Counters may be freed right after reaching 0, so they can't
+  // be parked on.
+  parker Progress;
+
+  s32 Quit = 0;
+};
+
+namespace internal {
+inline job *job_system_take_shared(job_system *js) {
+  if (atomic_load(&js->SharedHead) == atomic_load(&js->SharedTail)) {
+    return null;
+  }
+
+  lock(&js->SharedMutex);
+  job *j = null;
+  if (js->SharedHead != js->SharedTail) {
+    j = js->Shared[js->SharedHead & (job_system::SHARED_QUEUE_CAPACITY - 1)];
+    atomic_store(&js->SharedHead, js->SharedHead + 1);
+  }
+  unlock(&js->SharedMutex);
+  return j;
+}
+
+// Returns a job for the calling thread to run or null if there is no work
+inline job *job_system_find_job(job_system *js) {
+  if (!atomic_load(&js->Pending)) return null;
+
+  bool isWorker = JobWorkerSystem == js;
+
+  job *j = null;
+  if (isWorker) j = job_deque_pop(js->Deques + JobWorkerIndex);
+  if (!j) j = job_system_take_shared(js);
+
+  if (!j && js->WorkerCount) {
+    // Steal, starting from a random worker
+    if (!JobStealSeed) JobStealSeed = (u32) Context.ThreadID | 1;
+
+    u32 x = JobStealSeed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    JobStealSeed = x;
+
+    For(range(js->WorkerCount)) {
+      s64 victim = (x + it) % js->WorkerCount;
+      if (isWorker && victim == JobWorkerIndex) continue;
+
+      j = job_deque_steal(js->Deques + victim);
+      if (j) break;
+    }
+  }
+
+  if (j) atomic_add(&js->Pending, (s64) -1);
+  return j;
+}
+
+inline void job_execute(job_system *js, job *j) {
+  auto newContext = Context;
+  newContext.Alloc = j->Alloc;
+  newContext.AllocAlignment = j->AllocAlignment;
+  newContext.AllocOptions = j->AllocOptions;
+  newContext.Log = j->Log;
+
+  // _j_ may be freed as soon as the counter is decremented
+  job_counter *counter = j->Counter;
+
+  PUSH_CONTEXT(newContext) { j->Function(j->Data); }
+
+  atomic_add(&counter->Value, (s64) -1);
+
+  // The counter may be gone already (if it reached 0), so we can't check it.
+  // This is cheap when nobody is waiting.
+  unpark_all(&js->Progress);
+}
+
+inline void job_worker_thread(void *data) {
+  auto *d = (job_deque *) data;
+  auto *js = d->System;
+
+  JobWorkerSystem = js;
+  JobWorkerIndex = d->Index;
+
+  while (true) {
+    job *j = job_system_find_job(js);
+    if (j) {
+      job_execute(js, j);
+      continue;
+    }
+
+    // Spin a bit before going to sleep, new jobs often come in bursts
+    For(range(64)) {
+      if (atomic_load(&js->Pending) || atomic_load(&js->Quit)) break;
+      thread_sleep(0);
+    }
+    if (atomic_load(&js->Pending)) continue;
+
+    // Submitters increment _Pending_ and then check _Sleepers_,
+    // we do the opposite, so one of us sees the other.
+    lock(&js->SleepMutex);
+    atomic_inc(&js->Sleepers);
+    while (!atomic_load(&js->Pending) && !atomic_load(&js->Quit)) {
+      wait(&js->WakeUp, &js->SleepMutex);
+    }
+    atomic_add(&js->Sleepers, (s64) -1);
+    unlock(&js->SleepMutex);
+
+    if (atomic_load(&js->Quit)) break;
+  }
+}
+
+inline void job_system_wake_workers(job_system *js) {
+  if (!atomic_load(&js->Sleepers)) return;
+
+  lock(&js->SleepMutex);
+  notify_all(&js->WakeUp);
+  unlock(&js->SleepMutex);
+}
+}  // namespace internal
+
+// Launches _workers_ threads.
+// The job system must be initialized in place (it's passed to the threads).
+inline void init_job_system(job_system *js, s64 workers) {
+  js->SleepMutex = create_mutex();
+  js->WakeUp = create_condition_variable();
+
+  js->WorkerCount = workers;
+  if (!workers) return;
+
+  // Over-aligned so _Top_ and _Bottom_ are on their own cache lines
+  js->Deques = malloc<internal::job_deque>(
+      {.Count = workers,
+       .Alloc = platform_get_persistent_allocator(),
+       .Alignment = alignof(internal::job_deque)});
+  js->Threads = malloc<thread>(
+      {.Count = workers, .Alloc = platform_get_persistent_allocator()});
+
+  For(range(workers)) {
+    auto *d = js->Deques + it;
+    d->Top = d->Bottom = 0;
+    d->System = js;
+    d->Index = it;
+  }
+
+  For(range(workers)) {
+    js->Threads[it] =
+        create_and_launch_thread(&internal::job_worker_thread, js->Deques + it);
+  }
+}
+
+// Stops and waits for the workers. Jobs which haven't started are dropped.
+inline void free(job_system ref js) {
+  lock(&js.SleepMutex);
+  atomic_store(&js.Quit, 1);
+  notify_all(&js.WakeUp);
+  unlock(&js.SleepMutex);
+
+  For(range(js.WorkerCount)) wait(js.Threads[it]);
+
+  if (js.Deques) free(js.Deques);
+  if (js.Threads) free(js.Threads);
+  js.Deques = null;
+  js.Threads = null;
+  js.WorkerCount = 0;
+
+  free_condition_variable(&js.WakeUp);
+  free_mutex(&js.SleepMutex);
+}
+
+namespace internal {
+inline job_system DefaultJobSystem;
+inline s32 DefaultJobSystemInitted;
+inline fast_mutex DefaultJobSystemMutex;
+}  // namespace internal
+
+// The global job system, created on first use with a worker per core
+// (minus one for the main thread, which helps while waiting).
+inline job_system *get_default_job_system() {
+  auto *js = &internal::DefaultJobSystem;
+
+  if (!atomic_load(&internal::DefaultJobSystemInitted)) {
+    lock(&internal::DefaultJobSystemMutex);
+    if (!internal::DefaultJobSystemInitted) {
+      s64 cores = os_get_hardware_concurrency();
+      init_job_system(js, cores > 1 ? cores - 1 : 0);
+      atomic_store(&internal::DefaultJobSystemInitted, 1);
+    }
+    unlock(&internal::DefaultJobSystemMutex);
+  }
+  return js;
+}
+
+// Queues _count_ jobs and adds _count_ to the counter.
+// Uses the global job system unless _js_ is specified.
+inline void run_jobs(job *jobs, s64 count, job_counter *counter,
+                     job_system *js = null) {
+  if (count <= 0) return;
+  if (!js) js = get_default_job_system();
+
+  atomic_add(&counter->Value, count);
+
+  For_as(index, range(count)) {
+    job *j = jobs + index;
+    j->Counter = counter;
+    j->Alloc = Context.Alloc;
+    j->AllocAlignment = Context.AllocAlignment;
+    j->AllocOptions = Context.AllocOptions;
+    j->Log = Context.Log;
+  }
+
+  if (!js->WorkerCount) {
+    // Nobody to give the work to
+    For(range(count)) internal::job_execute(js, jobs + it);
+    return;
+  }
+
+  bool isWorker = internal::JobWorkerSystem == js;
+  For_as(index, range(count)) {
+    job *j = jobs + index;
+
+    bool queued = false;
+    if (isWorker) {
+      queued = internal::job_deque_push(js->Deques + internal::JobWorkerIndex, j);
+    } else {
+      lock(&js->SharedMutex);
+      if (js->SharedTail - js->SharedHead < job_system::SHARED_QUEUE_CAPACITY) {
+        js->Shared[js->SharedTail & (job_system::SHARED_QUEUE_CAPACITY - 1)] = j;
+        atomic_store(&js->SharedTail, js->SharedTail + 1);
+        queued = true;
+      }
+      unlock(&js->SharedMutex);
+    }
+
+    if (queued) {
+      atomic_inc(&js->Pending);
+    } else {
+      internal::job_execute(js, j);
+    }
+  }
+
+  internal::job_system_wake_workers(js);
+  unpark_all(&js->Progress);
+}
+
+inline void run_job(job *j, job_counter *counter, job_system *js = null) {
+  run_jobs(j, 1, counter, js);
+}
+
+// Runs jobs until the counter reaches 0
+inline void wait(job_counter *counter, job_system *js = null) {
+  if (!js) js = get_default_job_system();
+
+  while (atomic_load(&counter->Value) > 0) {
+    job *j = internal::job_system_find_job(js);
+    if (j) {
+      internal::job_execute(js, j);
+      continue;
+    }
+
+    // The remaining jobs are running on other threads
+    s32 ticket = prepare_park(&js->Progress);
+    if (atomic_load(&counter->Value) <= 0 || atomic_load(&js->Pending)) {
+      cancel_park(&js->Progress);
+      continue;
+    }
+    park(&js->Progress, ticket);
+  }
+}
+
+LSTD_END_NAMESPACE
@@ -17,6 +17,19 @@ mark_as_leak void *os_allocate_block(s64 size);
 // Frees a memory block allocated by os_allocate_block()
 void os_free_block(void *ptr);
 
+// Reserves _size_ bytes of address space without backing them with memory.
+// Nothing in the range can be accessed until it's committed. Returns null on
+// failure.
+mark_as_leak void *os_reserve_memory(s64 size);
+
+// Makes [ptr, ptr + size) readable and writable. The range must be inside a
+// block returned by os_reserve_memory() and aligned to the page size.
+// Returns false if the OS is out of memory.
+bool os_commit_memory(void *ptr, s64 size);
+
+// Releases a block returned by os_reserve_memory() (_size_ is the reserved size)
+void os_release_memory(void *ptr, s64 size);
+
 struct platform_memory_state {
   // Used to store global state (e.g. cached command-line arguments/env
   // variables or directories), a tlsf allocator
@@ -176,6 +189,116 @@ inline void platform_uninit_allocators() {
   free_mutex(&S->PersistentAllocMutex);
 }
 
+//
+// An arena on a large range of reserved address space. Memory is committed as
+// the arena grows, so it can reserve a lot up front (the default is 64 GiB)
+// and only use what's actually allocated. Allocations never move: resizing
+// the last allocation happens in place, which suits a buffer that grows
+// without a known bound, e.g. a CONTIGUOUS string_builder:
+//
+//      virtual_arena_allocator_data arena;
+//      init_virtual_arena(&arena);
+//      defer(free(arena));
+//
+//      string_builder b;
+//      b.Mode = string_builder::CONTIGUOUS;
+//      b.Alloc = {virtual_arena_allocator, &arena};
+//
+// Like the arena allocator, individual allocations aren't freed, free_all
+// resets it (the memory stays committed). Not thread-safe.
+//
+const s64 VIRTUAL_ARENA_DEFAULT_RESERVE = 64_GiB;
+
+// Committing happens in steps of this size (a multiple of the page size)
+const s64 VIRTUAL_ARENA_COMMIT_SIZE = 64_KiB;
+
+struct virtual_arena_allocator_data {
+  byte *Block = null;
+  s64 Reserved = 0;
+  s64 Committed = 0;
+
+  s64 Used = 0;
+};
+
+// Returns false if the address space couldn't be reserved
+inline bool init_virtual_arena(virtual_arena_allocator_data *data,
+                               s64 reserve = VIRTUAL_ARENA_DEFAULT_RESERVE) {
+  reserve = (reserve + VIRTUAL_ARENA_COMMIT_SIZE - 1) &
+            ~(VIRTUAL_ARENA_COMMIT_SIZE - 1);
+
+  data->Block = (byte *)os_reserve_memory(reserve);
+  if (!data->Block) {
+    platform_report_error("Couldn't reserve address space for a virtual arena");
+    return false;
+  }
+
+  data->Reserved = reserve;
+  data->Committed = 0;
+  data->Used = 0;
+  return true;
+}
+
+inline void free(virtual_arena_allocator_data ref data) {
+  if (data.Block) os_release_memory(data.Block, data.Reserved);
+  data = {};
+}
+
+namespace internal {
+// Makes sure the first _size_ bytes are committed
+inline bool virtual_arena_commit(virtual_arena_allocator_data *data, s64 size) {
+  if (size <= data->Committed) return true;
+  if (size > data->Reserved) return false;
+
+  s64 committed = (size + VIRTUAL_ARENA_COMMIT_SIZE - 1) &
+                  ~(VIRTUAL_ARENA_COMMIT_SIZE - 1);
+  committed = min(committed, data->Reserved);
+
+  if (!os_commit_memory(data->Block + data->Committed,
+                        committed - data->Committed)) {
+    return false;
+  }
+  data->Committed = committed;
+  return true;
+}
+}  // namespace internal
+
+inline void *virtual_arena_allocator(allocator_mode mode, void *context,
+                                     s64 size, void *oldMemory, s64 oldSize,
+                                     u64 options) {
+  auto *data = (virtual_arena_allocator_data *)context;
+  assert(data->Block &&
+         "Virtual arena not initialized (call init_virtual_arena)");
+
+  switch (mode) {
+    case allocator_mode::ALLOCATE: {
+      if (!internal::virtual_arena_commit(data, data->Used + size)) return null;
+
+      void *result = data->Block + data->Used;
+      data->Used += size;
+      return result;
+    }
+    case allocator_mode::RESIZE: {
+      // We can resize only if it's the last allocation
+      if (oldMemory != data->Block + data->Used - oldSize) return null;
+      if (!internal::virtual_arena_commit(data, data->Used - oldSize + size)) {
+        return null;
+      }
+
+      data->Used += size - oldSize;
+      return oldMemory;
+    }
+    case allocator_mode::FREE: {
+      // We don't free individual allocations
+      return null;
+    }
+    case allocator_mode::FREE_ALL: {
+      data->Used = 0;
+      return null;
+    }
+  }
+  return null;
+}
+
 LSTD_END_NAMESPACE
 
 #if OS == WINDOWS
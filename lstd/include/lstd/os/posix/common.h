@@ -13,6 +13,11 @@
 #include <termios.h>
 #include <limits.h>
 #include <sys/time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <libproc.h>
 #include <string.h>
@@ -278,22 +283,183 @@ inline bool os_write_to_file(string path, string contents,
     return true;
 }
 
+inline os_open_file_result os_open_file_for_reading(string path)
+{
+    FILE *file = fopen(to_c_string_temp(path), "rb");
+    if (!file)
+    {
+        platform_report_error(tprint("Failed to open file \"{}\" for reading", path));
+        return {null, false};
+    }
+
+    // The caller does its own buffering, don't copy everything twice
+    setvbuf(file, null, _IONBF, 0);
+    return {file, true};
+}
+
+inline s64 os_read_file(void *file, char *buffer, s64 size)
+{
+    size_t bytesRead = fread(buffer, 1, size, (FILE *)file);
+    if (!bytesRead && ferror((FILE *)file))
+        return -1;
+    return bytesRead;
+}
+
+namespace internal {
+// Writes all _buffers_ to _fd_, 64 at a time (one writev for each group)
+inline bool posix_write_all(int fd, const string *buffers, s64 count)
+{
+    iovec vecs[64];
+    while (count)
+    {
+        s64 n = 0;
+        for (; n < count && n < 64; ++n)
+        {
+            vecs[n].iov_base = (void *)buffers[n].Data;
+            vecs[n].iov_len = (size_t)buffers[n].Count;
+        }
+
+        // writev may write less than asked (e.g. to a pipe), continue after
+        // the last byte which made it
+        iovec *v = vecs;
+        s64 left = n;
+        while (left)
+        {
+            ssize_t written = writev(fd, v, (int)left);
+            if (written < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                return false;
+            }
+
+            while (left && (size_t)written >= v->iov_len)
+            {
+                written -= v->iov_len;
+                ++v, --left;
+            }
+
+            if (left)
+            {
+                v->iov_base = (char *)v->iov_base + written;
+                v->iov_len -= written;
+            }
+        }
+
+        buffers += n;
+        count -= n;
+    }
+    return true;
+}
+}  // namespace internal
+
+inline os_open_file_result os_open_file_for_writing(string path, file_write_mode mode)
+{
+    int flags = O_WRONLY | O_CREAT;
+    if (mode == file_write_mode::Append)
+        flags |= O_APPEND;
+    else if (mode == file_write_mode::Overwrite_Entire)
+        flags |= O_TRUNC;
+
+    int fd = open(to_c_string_temp(path), flags, 0644);
+    if (fd == -1)
+    {
+        platform_report_error(tprint("Failed to open file \"{}\" for writing", path));
+        return {null, false};
+    }
+
+    // Same handle type as os_open_file_for_reading() so os_close_file() works
+    // for both. We write to the descriptor directly, so no stdio buffering.
+    FILE *file = fdopen(fd, mode == file_write_mode::Append ? "ab" : "wb");
+    if (!file)
+    {
+        close(fd);
+        platform_report_error(tprint("Failed to open file \"{}\" for writing", path));
+        return {null, false};
+    }
+    setvbuf(file, null, _IONBF, 0);
+    return {file, true};
+}
+
+inline bool os_write_file(void *file, const string *buffers, s64 count)
+{
+    return internal::posix_write_all(fileno((FILE *)file), buffers, count);
+}
+
+inline void os_close_file(void *file)
+{
+    fclose((FILE *)file);
+}
+
+inline os_map_file_result os_map_file(string path)
+{
+    int file = open(to_c_string_temp(path), O_RDONLY);
+    if (file == -1)
+    {
+        platform_report_error(tprint("Failed to open file \"{}\" for mapping", path));
+        return {};
+    }
+    defer(close(file));  // The mapping keeps the file open
+
+    struct stat info;
+    if (fstat(file, &info) == -1)
+    {
+        platform_report_error(tprint("Failed to get the size of file \"{}\"", path));
+        return {};
+    }
+
+    // Empty files can't be mapped
+    if (!info.st_size)
+        return {{}, true};
+
+    void *data = mmap(null, info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    if (data == MAP_FAILED)
+    {
+        platform_report_error(tprint("Failed to map file \"{}\"", path));
+        return {};
+    }
+
+    return {{string((const char *)data, info.st_size), null}, true};
+}
+
+inline void os_unmap_file(os_mapped_file file)
+{
+    if (file.Contents.Count)
+        munmap(file.Contents.Data, file.Contents.Count);
+}
+
+inline void os_write_to_console(console::output_type type, const string *buffers, s64 count)
+{
+    auto target = type == console::COUT ? stdout : stderr;
+
+    // Anything written through stdio must come out first
+    fflush(target);
+
+    internal::posix_write_all(fileno(target), buffers, count);
+}
+
 inline void console::write(const char *data, s64 size)
 {
+    // The mutex is recursive, so we can flush while holding it and no other
+    // thread gets to write in between
     if (LockMutex)
         lock(&S->CoutMutex);
 
     if (size > Available)
-    {
-        if (LockMutex) unlock(&S->CoutMutex);
         flush();
-        if (LockMutex) lock(&S->CoutMutex);
-    }
 
-    memcpy(Current, data, size);
+    if (size > Available)
+    {
+        // Doesn't fit even in the empty buffer, pass it through
+        fwrite(data, sizeof(char), (size_t)size, OutputType == console::COUT ? stdout : stderr);
+    }
+    else
+    {
+        memcpy(Current, data, size);
 
-    Current += size;
-    Available -= size;
+        Current += size;
+        Available -= size;
+    }
 
     if (LockMutex)
         unlock(&S->CoutMutex);
@@ -27,4 +27,17 @@ inline void os_free_block(void *ptr) {
   }
 }
 
+mark_as_leak inline void *os_reserve_memory(s64 size) {
+  void *ptr = mmap(NULL, size, PROT_NONE, MAP_ANONYMOUS | MAP_PRIVATE | MAP_NORESERVE, -1, 0);
+  return ptr != MAP_FAILED ? ptr : nullptr;
+}
+
+inline bool os_commit_memory(void *ptr, s64 size) {
+  return mprotect(ptr, size, PROT_READ | PROT_WRITE) == 0;
+}
+
+inline void os_release_memory(void *ptr, s64 size) {
+  munmap(ptr, size);
+}
+
 LSTD_END_NAMESPACE
@@ -6,7 +6,21 @@
 #include "../../memory.h"
 
 #include <pthread.h>
-#include <unistd.h> // For usleep
+#include <unistd.h> // For usleep, syscall
+
+#if OS == LINUX
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#else
+// Private, but stable (libc++ uses these to implement std::atomic::wait)
+extern "C" int __ulock_wait(u32 operation, void *address, u64 value,
+                            u32 timeoutUs);
+extern "C" int __ulock_wake(u32 operation, void *address, u64 wakeValue);
+
+#define UL_COMPARE_AND_WAIT 1
+#define ULF_WAKE_ALL 0x00000100
+#define ULF_NO_ERRNO 0x01000000
+#endif
 
 LSTD_BEGIN_NAMESPACE
 
@@ -72,6 +86,41 @@ inline void notify_all(condition_variable *c) {
   pthread_cond_broadcast((pthread_cond_t *)c->Handle);
 }
 
+inline void wait_on_address(s32 *address, s32 expected) {
+#if OS == LINUX
+  syscall(SYS_futex, address, FUTEX_WAIT_PRIVATE, expected, null, null, 0);
+#else
+  __ulock_wait(UL_COMPARE_AND_WAIT | ULF_NO_ERRNO, address, (u64) expected, 0);
+#endif
+}
+
+inline void wait_on_address(s32 *address, s32 expected, u32 timeoutMs) {
+#if OS == LINUX
+  timespec timeout = {(time_t)(timeoutMs / 1000), (long)(timeoutMs % 1000) * 1000000};
+  syscall(SYS_futex, address, FUTEX_WAIT_PRIVATE, expected, &timeout, null, 0);
+#else
+  // The timeout is in microseconds, 0 means forever
+  u32 us = timeoutMs ? timeoutMs * 1000 : 1;
+  __ulock_wait(UL_COMPARE_AND_WAIT | ULF_NO_ERRNO, address, (u64) expected, us);
+#endif
+}
+
+inline void wake_one_on_address(s32 *address) {
+#if OS == LINUX
+  syscall(SYS_futex, address, FUTEX_WAKE_PRIVATE, 1, null, null, 0);
+#else
+  __ulock_wake(UL_COMPARE_AND_WAIT | ULF_NO_ERRNO, address, 0);
+#endif
+}
+
+inline void wake_all_on_address(s32 *address) {
+#if OS == LINUX
+  syscall(SYS_futex, address, FUTEX_WAKE_PRIVATE, numeric<s32>::max(), null, null, 0);
+#else
+  __ulock_wake(UL_COMPARE_AND_WAIT | ULF_WAKE_ALL | ULF_NO_ERRNO, address, 0);
+#endif
+}
+
 inline void *thread_wrapper_function(void *data) {
   auto *ti = (thread_start_info *)data;
 
@@ -90,6 +139,8 @@ inline void *thread_wrapper_function(void *data) {
 
   ti->Function(ti->UserData);  // <--- Call the user function with the user data
 
+  lstd_uninit_thread();
+
 #if defined DEBUG_MEMORY
   debug_memory_uninit();
 #endif
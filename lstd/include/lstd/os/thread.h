@@ -135,6 +135,83 @@ void notify_one(condition_variable *c);
 // Only threads that started waiting prior to this call will be woken up.
 void notify_all(condition_variable *c);
 
+//
+// Futex-style waiting on an address (futex on Linux, __ulock on Mac,
+// WaitOnAddress on Windows). Doesn't need any object to be created, any
+// aligned s32 can be waited on.
+//
+// wait_on_address() blocks while *address == expected (returns immediately if
+// it's not), until another thread calls wake_*_on_address() with the same
+// address. It may also return spuriously, so always re-check your condition.
+//
+// See _parker_ below for a wrapper which doesn't make a syscall when nobody
+// is waiting.
+//
+void wait_on_address(s32 *address, s32 expected);
+
+// Same as above, but returns after at most _timeoutMs_ milliseconds
+void wait_on_address(s32 *address, s32 expected, u32 timeoutMs);
+void wake_one_on_address(s32 *address);
+void wake_all_on_address(s32 *address);
+
+//
+// Parker (an event count).
+//
+// Lets threads sleep until some condition (checked without locks, e.g. "the
+// queue isn't empty") may have changed. The waiting side:
+//
+//      while (!try_pop(q, &v)) {
+//          s32 ticket = prepare_park(&p);
+//          if (try_pop(q, &v)) { cancel_park(&p); break; }  // Re-check!
+//          park(&p, ticket);
+//      }
+//
+// and the side which changes the condition calls unpark_all(&p) afterwards.
+// When nobody is parked unpark_all() is a single atomic load, so unlike a
+// condition_variable the fast path never takes a lock or goes to the kernel.
+//
+struct parker {
+  s32 Epoch = 0;    // Incremented on each wake up
+  s32 Waiters = 0;  // Threads between prepare_park() and the end of park()
+};
+
+// Returns a ticket for park(). After this call re-check the condition and
+// either call park() or cancel_park().
+inline s32 prepare_park(parker *p) {
+  atomic_inc(&p->Waiters);
+  return atomic_load(&p->Epoch);
+}
+
+inline void cancel_park(parker *p) { atomic_add(&p->Waiters, -1); }
+
+// Sleeps until unpark_all() is called after the prepare_park() which
+// returned _ticket_
+inline void park(parker *p, s32 ticket) {
+  while (atomic_load(&p->Epoch) == ticket) wait_on_address(&p->Epoch, ticket);
+  atomic_add(&p->Waiters, -1);
+}
+
+// Same as park() but gives up after _timeoutMs_ milliseconds (may also
+// return spuriously before that)
+inline void park(parker *p, s32 ticket, u32 timeoutMs) {
+  if (atomic_load(&p->Epoch) == ticket) {
+    wait_on_address(&p->Epoch, ticket, timeoutMs);
+  }
+  atomic_add(&p->Waiters, -1);
+}
+
+// Wakes all parked threads
+inline void unpark_all(parker *p) {
+  // The caller changed the condition the waiters check before this. That
+  // store must be visible before we read _Waiters_, otherwise a thread which
+  // is about to park may miss both the change and the wake up.
+  atomic_fence();
+  if (!atomic_load(&p->Waiters)) return;
+
+  atomic_inc(&p->Epoch);
+  wake_all_on_address(&p->Epoch);
+}
+
 struct thread {
   void *Handle = null;
   u32 ThreadID;
@@ -179,6 +256,43 @@ inline void lstd_init_thread() {
   const_cast<context *>(&Context)->ThreadID = os_get_current_thread_id();
 }
 
+//
+// Callbacks which run on a thread right before it exits (threads created with
+// create_and_launch_thread), latest first. Use this to give back per-thread
+// resources which other threads could reuse.
+//
+const s64 THREAD_EXIT_MAX_CALLBACKS = 16;
+
+namespace internal {
+struct thread_exit_callback {
+  delegate<void(void *)> Function;
+  void *UserData = null;
+};
+
+inline thread_local thread_exit_callback ThreadExitCallbacks[THREAD_EXIT_MAX_CALLBACKS];
+inline thread_local s64 ThreadExitCallbackCount = 0;
+}  // namespace internal
+
+// Returns false if this thread already has THREAD_EXIT_MAX_CALLBACKS
+// callbacks scheduled
+inline bool thread_exit_schedule(delegate<void(void *)> function,
+                                 void *userData = null) {
+  if (internal::ThreadExitCallbackCount == THREAD_EXIT_MAX_CALLBACKS) {
+    return false;
+  }
+  internal::ThreadExitCallbacks[internal::ThreadExitCallbackCount++] = {
+      function, userData};
+  return true;
+}
+
+// Called by the thread wrapper after the thread's function returns
+inline void lstd_uninit_thread() {
+  while (internal::ThreadExitCallbackCount) {
+    auto c = internal::ThreadExitCallbacks[--internal::ThreadExitCallbackCount];
+    c.Function(c.UserData);
+  }
+}
+
 LSTD_END_NAMESPACE
 
 #if OS == WINDOWS
@@ -1077,6 +1077,11 @@ HANDLE OpenFileMappingW(DWORD dwDesiredAccess, BOOL bInheritHandle,
 
 BOOL HeapFree(HANDLE hHeap, DWORD dwFlags, LPVOID lpMem);
 
+LPVOID VirtualAlloc(LPVOID lpAddress, SIZE_T dwSize, DWORD flAllocationType,
+                    DWORD flProtect);
+
+BOOL VirtualFree(LPVOID lpAddress, SIZE_T dwSize, DWORD dwFreeType);
+
 void ExitProcess(UINT uExitCode);
 
 BOOL SetEnvironmentVariableW(LPCWSTR lpName, LPCWSTR lpValue);
@@ -1113,8 +1118,14 @@ DWORD GetCurrentProcessId();
 #define FILE_MAP_WRITE 0x0002
 #define FILE_MAP_READ 0x0004
 
+#define PAGE_NOACCESS 0x01
+#define PAGE_READONLY 0x02
 #define PAGE_READWRITE 0x04
 
+#define MEM_COMMIT 0x00001000
+#define MEM_RESERVE 0x00002000
+#define MEM_RELEASE 0x00008000
+
 #define CF_UNICODETEXT 13
 
 #define GHND 0x0042
@@ -1492,6 +1503,7 @@ typedef struct _BY_HANDLE_FILE_INFORMATION {
 #define FILE_FLAG_OVERLAPPED 0x40000000
 
 #define FILE_FLAG_BACKUP_SEMANTICS 0x02000000
+#define FILE_FLAG_SEQUENTIAL_SCAN 0x08000000
 
 #define FILE_ATTRIBUTE_READONLY 0x00000001
 #define FILE_ATTRIBUTE_DIRECTORY 0x00000010
@@ -1865,6 +1877,12 @@ HMODULE GetModuleHandleW(LPCWSTR lpModuleName);
 
 DWORD WaitForSingleObjectEx(HANDLE hHandle, DWORD dwMilliseconds,
                             BOOL bAlertable);
+
+// Synchronization.lib
+BOOL WaitOnAddress(volatile void *Address, PVOID CompareAddress,
+                   SIZE_T AddressSize, DWORD dwMilliseconds);
+void WakeByAddressSingle(PVOID Address);
+void WakeByAddressAll(PVOID Address);
 }
 
 #define SPI_GETFOREGROUNDLOCKTIMEOUT 0x2000
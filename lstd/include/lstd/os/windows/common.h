@@ -351,6 +351,109 @@ inline bool os_write_to_file(string path, string contents,
   return true;
 }
 
+inline os_open_file_result os_open_file_for_reading(string path) {
+  CREATE_FILE_HANDLE_CHECKED(
+      file,
+      CreateFileW(utf8_to_utf16(path), GENERIC_READ, FILE_SHARE_READ, null,
+                  OPEN_EXISTING,
+                  FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, null),
+      {});
+  return {file, true};
+}
+
+inline s64 os_read_file(void *file, char *buffer, s64 size) {
+  // ReadFile takes a 32 bit size
+  if (size > (s64)1_GiB) size = 1_GiB;
+
+  DWORD bytesRead;
+  if (!ReadFile((HANDLE)file, buffer, (u32)size, &bytesRead, null)) return -1;
+  return bytesRead;
+}
+
+inline void os_close_file(void *file) { CloseHandle((HANDLE)file); }
+
+namespace internal {
+// There is no writev for file or console handles (WriteFileGather needs
+// unbuffered, page-aligned I/O), but at least we don't copy
+inline bool windows_write_all(HANDLE target, const string *buffers, s64 count) {
+  For(range(count)) {
+    const char *data = buffers[it].Data;
+    s64 size = buffers[it].Count;
+    while (size > 0) {
+      DWORD written = 0;
+      DWORD toWrite = (DWORD)(size < 1_GiB ? size : 1_GiB);
+      if (!WriteFile(target, data, toWrite, &written, null)) return false;
+      data += written;
+      size -= written;
+    }
+  }
+  return true;
+}
+}  // namespace internal
+
+inline os_open_file_result os_open_file_for_writing(string path,
+                                                    file_write_mode mode) {
+  DWORD creation =
+      mode == file_write_mode::Overwrite_Entire ? CREATE_ALWAYS : OPEN_ALWAYS;
+  CREATE_FILE_HANDLE_CHECKED(
+      file,
+      CreateFileW(utf8_to_utf16(path), GENERIC_WRITE, FILE_SHARE_READ, null,
+                  creation, FILE_ATTRIBUTE_NORMAL, null),
+      {});
+
+  if (mode == file_write_mode::Append) {
+    LARGE_INTEGER pointer = {};
+    SetFilePointerEx(file, pointer, null, FILE_END);
+  }
+  return {file, true};
+}
+
+inline bool os_write_file(void *file, const string *buffers, s64 count) {
+  return internal::windows_write_all((HANDLE)file, buffers, count);
+}
+
+inline os_map_file_result os_map_file(string path) {
+  CREATE_FILE_HANDLE_CHECKED(
+      file,
+      CreateFileW(utf8_to_utf16(path), GENERIC_READ, FILE_SHARE_READ, null,
+                  OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, null),
+      {});
+  defer(CloseHandle(file));  // The mapping keeps the file open
+
+  LARGE_INTEGER size = {0};
+  GetFileSizeEx(file, &size);
+
+  // Empty files can't be mapped
+  if (!size.QuadPart) return {{}, true};
+
+  HANDLE mapping = CreateFileMappingW(file, null, PAGE_READONLY, 0, 0, null);
+  if (!mapping) {
+    windows_report_hresult_error(HRESULT_FROM_WIN32(GetLastError()),
+                                 "CreateFileMappingW");
+    return {};
+  }
+
+  void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  if (!data) {
+    windows_report_hresult_error(HRESULT_FROM_WIN32(GetLastError()),
+                                 "MapViewOfFile");
+    CloseHandle(mapping);
+    return {};
+  }
+
+  return {{string((const char *)data, size.QuadPart), mapping}, true};
+}
+
+inline void os_unmap_file(os_mapped_file file) {
+  if (file.Contents.Data) UnmapViewOfFile(file.Contents.Data);
+  if (file.Handle) CloseHandle((HANDLE)file.Handle);
+}
+
+inline void os_write_to_console(console::output_type type, const string *buffers, s64 count) {
+  HANDLE target = type == console::COUT ? S->CoutHandle : S->CerrHandle;
+  internal::windows_write_all(target, buffers, count);
+}
+
 inline void console::write(const char *data, s64 size) {
   if (LockMutex) lock(&S->CoutMutex);
 
@@ -358,10 +461,16 @@ inline void console::write(const char *data, s64 size) {
     flush();
   }
 
-  memcpy(Current, data, size);
-
-  Current += size;
-  Available -= size;
+  if (size > Available) {
+    // Doesn't fit even in the empty buffer, pass it through
+    string s(data, size);
+    os_write_to_console(OutputType, &s, 1);
+  } else {
+    memcpy(Current, data, size);
+
+    Current += size;
+    Available -= size;
+  }
 
   if (LockMutex) unlock(&S->CoutMutex);
 }
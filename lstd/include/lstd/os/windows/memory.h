@@ -17,4 +17,16 @@ inline void os_free_block(void *ptr) {
   WIN32_CHECK_BOOL(r, HeapFree(GetProcessHeap(), 0, ptr));
 }
 
+mark_as_leak inline void *os_reserve_memory(s64 size) {
+  return VirtualAlloc(null, size, MEM_RESERVE, PAGE_NOACCESS);
+}
+
+inline bool os_commit_memory(void *ptr, s64 size) {
+  return VirtualAlloc(ptr, size, MEM_COMMIT, PAGE_READWRITE) != null;
+}
+
+inline void os_release_memory(void *ptr, s64 size) {
+  WIN32_CHECK_BOOL(r, VirtualFree(ptr, 0, MEM_RELEASE));
+}
+
 LSTD_END_NAMESPACE
@@ -119,6 +119,18 @@ inline void notify_all(condition_variable *c) {
   if (haveWaiters) SetEvent(data->Events[_CONDITION_EVENT_ALL]);
 }
 
+inline void wait_on_address(s32 *address, s32 expected) {
+  WaitOnAddress(address, &expected, sizeof(s32), INFINITE);
+}
+
+inline void wait_on_address(s32 *address, s32 expected, u32 timeoutMs) {
+  WaitOnAddress(address, &expected, sizeof(s32), timeoutMs);
+}
+
+inline void wake_one_on_address(s32 *address) { WakeByAddressSingle(address); }
+
+inline void wake_all_on_address(s32 *address) { WakeByAddressAll(address); }
+
 inline u32 __stdcall thread_wrapper_function(void *data) {
   auto *ti = (thread_start_info *)data;
 
@@ -137,6 +149,8 @@ inline u32 __stdcall thread_wrapper_function(void *data) {
 
   ti->Function(ti->UserData);  // <--- Call the user function with the user data
 
+  lstd_uninit_thread();
+
 #if defined DEBUG_MEMORY
   debug_memory_uninit();
 #endif
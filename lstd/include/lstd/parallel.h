@@ -0,0 +1,303 @@
+#pragma once
+
+#include "array_like.h"
+#include "os.h"
+
+LSTD_BEGIN_NAMESPACE
+
+//
+// Parallel algorithms: parallel_for, parallel_reduce, parallel_sort.
+//
+// The work is cut into chunks of _Grain_ elements which are run on worker
+// threads (the calling thread helps too). The chunks depend only on
+// the number of elements and the grain, never on the number of threads or
+// the scheduling, so parallel_reduce combines the same partial results in the
+// same order every time - results are deterministic (even for floats) and the
+// same as the serial version would give with that grain.
+//
+//      parallel_for(particles, [](particle ref p) { p.Position += p.Velocity; });
+//
+//      f64 sum = parallel_reduce(values, 0.0, [](f64 a, f64 b) { return a + b; });
+//
+//      parallel_sort(keys.Data, keys.Count);
+//
+// The chunks run as jobs on the job system (os/job_system.h), by default the
+// global one. The calling thread works on chunks too and while waiting it
+// runs other jobs, so calling these from inside a job (nested parallelism) is
+// fine.
+//
+struct parallel_options {
+  // Elements per chunk. 0 means pick one from the number of elements
+  // (independent of the number of cores, so the result is deterministic).
+  s64 Grain = 0;
+
+  job_system *Jobs = null;  // null means the global job system
+
+  allocator Alloc = {};  // For temporary buffers (partial results, scratch)
+};
+
+// Chunks are never smaller than this when the grain is picked automatically
+const s64 PARALLEL_MIN_GRAIN = 1024;
+
+// When the grain is picked automatically the work is cut in at most this
+// many chunks
+const s64 PARALLEL_MAX_CHUNKS = 256;
+
+// Max number of jobs a single call splits into (the chunks are handed out
+// to them dynamically)
+const s64 PARALLEL_MAX_JOBS = 64;
+
+namespace internal {
+// A bulk job: run _Task_ for chunks [0, ChunkCount)
+struct parallel_job {
+  delegate<void(s64)> Task;
+  s64 ChunkCount;
+  s64 NextChunk;  // Chunks are taken with an atomic increment
+};
+
+inline s64 parallel_grain(s64 count, parallel_options options) {
+  if (options.Grain > 0) return options.Grain;
+
+  s64 grain = (count + PARALLEL_MAX_CHUNKS - 1) / PARALLEL_MAX_CHUNKS;
+  return grain < PARALLEL_MIN_GRAIN ? PARALLEL_MIN_GRAIN : grain;
+}
+
+inline void parallel_run_chunks(void *data) {
+  auto *pj = (parallel_job *) data;
+  while (true) {
+    s64 chunk = atomic_inc(&pj->NextChunk) - 1;
+    if (chunk >= pj->ChunkCount) break;
+    pj->Task(chunk);
+  }
+}
+}  // namespace internal
+
+// Runs task(chunk) for each chunk in [0, chunkCount) and waits for all of
+// them to finish. Building block for the functions below.
+inline void parallel_run(s64 chunkCount, delegate<void(s64)> task,
+                         job_system *js = null) {
+  if (chunkCount <= 0) return;
+  if (!js) js = get_default_job_system();
+
+  internal::parallel_job pj;
+  pj.Task = task;
+  pj.ChunkCount = chunkCount;
+  pj.NextChunk = 0;
+
+  // One share of the work is done by the calling thread
+  s64 jobCount = js->WorkerCount + 1;
+  if (jobCount > chunkCount) jobCount = chunkCount;
+  if (jobCount > PARALLEL_MAX_JOBS) jobCount = PARALLEL_MAX_JOBS;
+  jobCount -= 1;
+
+  job jobs[PARALLEL_MAX_JOBS];
+  For(range(jobCount)) {
+    jobs[it].Function = &internal::parallel_run_chunks;
+    jobs[it].Data = &pj;
+  }
+
+  job_counter counter;
+  run_jobs(jobs, jobCount, &counter, js);
+  internal::parallel_run_chunks(&pj);
+  wait(&counter, js);
+}
+
+//
+// parallel_for
+//
+
+// Calls body(index) for each index in [begin, end)
+template <typename Body>
+void parallel_for(s64 begin, s64 end, Body body, parallel_options options = {}) {
+  s64 count = end - begin;
+  if (count <= 0) return;
+
+  s64 grain = internal::parallel_grain(count, options);
+  s64 chunks = (count + grain - 1) / grain;
+
+  auto task = [&](s64 chunk) {
+    s64 b = begin + chunk * grain;
+    s64 e = b + grain < end ? b + grain : end;
+    for (s64 i = b; i < e; ++i) body(i);
+  };
+  parallel_run(chunks, &task, options.Jobs);
+}
+
+// Calls body(element) for each element of the array.
+// The element is passed by reference, so it can be modified.
+template <any_array_like Arr, typename Body>
+void parallel_for(Arr ref arr, Body body, parallel_options options = {}) {
+  parallel_for(
+      0, arr.Count, [&](s64 index) { body(arr.Data[index]); }, options);
+}
+
+//
+// parallel_reduce
+//
+
+// Folds the elements of each chunk with combine(accumulator, element)
+// starting from _identity_, then combines the results of the chunks in order.
+// _combine_ should be associative and _identity_ its identity element.
+template <typename T, typename Fold, typename Combine>
+T parallel_reduce(s64 begin, s64 end, T identity, Fold fold, Combine combine,
+                  parallel_options options = {}) {
+  s64 count = end - begin;
+  if (count <= 0) return identity;
+
+  s64 grain = internal::parallel_grain(count, options);
+  s64 chunks = (count + grain - 1) / grain;
+
+  T *partials = malloc<T>({.Count = chunks, .Alloc = options.Alloc});
+  defer(free(partials));
+
+  auto task = [&](s64 chunk) {
+    s64 b = begin + chunk * grain;
+    s64 e = b + grain < end ? b + grain : end;
+
+    T acc = identity;
+    for (s64 i = b; i < e; ++i) acc = fold(acc, i);
+    partials[chunk] = acc;
+  };
+  parallel_run(chunks, &task, options.Jobs);
+
+  T result = identity;
+  For(range(chunks)) result = combine(result, partials[it]);
+  return result;
+}
+
+// Reduces the elements of an array with combine(a, b) -> T
+template <any_array_like Arr, typename T, typename Combine>
+T parallel_reduce(Arr no_copy arr, T identity, Combine combine,
+                  parallel_options options = {}) {
+  return parallel_reduce(
+      0, arr.Count, identity,
+      [&](T no_copy acc, s64 index) { return combine(acc, arr.Data[index]); },
+      combine, options);
+}
+
+//
+// parallel_sort
+//
+// Chunks are sorted in parallel with sort() (qsort.h), then merged pairwise
+// in log2(chunks) rounds. Each merge is itself split in pieces of about
+// _Grain_ elements (found with a binary search) so the last rounds, which
+// merge big runs, also use all the cores. Needs a scratch buffer with the
+// size of the array (allocated with options.Alloc).
+//
+namespace internal {
+// Returns how many elements from _a_ are among the first _k_ elements of the
+// stable merge of _a_ and _b_.
+template <typename T, typename Less>
+s64 merge_split(T *a, s64 n, T *b, s64 m, s64 k, Less &less) {
+  s64 lo = k > m ? k - m : 0;
+  s64 hi = k < n ? k : n;
+
+  // a[i] is among the first _k_ if i + (elements of b less than a[i]) < k
+  while (lo < hi) {
+    s64 i = lo + (hi - lo) / 2;
+
+    s64 bl = 0, bh = m;
+    while (bl < bh) {
+      s64 j = bl + (bh - bl) / 2;
+      if (less(b[j], a[i])) {
+        bl = j + 1;
+      } else {
+        bh = j;
+      }
+    }
+
+    if (i + bl < k) {
+      lo = i + 1;
+    } else {
+      hi = i;
+    }
+  }
+  return lo;
+}
+
+template <typename T, typename Less>
+void merge(T *a, T *aEnd, T *b, T *bEnd, T *out, Less &less) {
+  while (a != aEnd && b != bEnd) {
+    if (less(*b, *a)) {
+      *out++ = *b++;
+    } else {
+      *out++ = *a++;
+    }
+  }
+  while (a != aEnd) *out++ = *a++;
+  while (b != bEnd) *out++ = *b++;
+}
+}  // namespace internal
+
+template <typename T, typename Less>
+void parallel_sort(T *data, s64 count, Less less,
+                   parallel_options options = {}) {
+  if (count < 2) return;
+
+  s64 grain = internal::parallel_grain(count, options);
+  s64 chunks = (count + grain - 1) / grain;
+
+  auto sortTask = [&](s64 chunk) {
+    s64 b = chunk * grain;
+    s64 e = b + grain < count ? b + grain : count;
+    sort(data + b, e - b, less);
+  };
+  parallel_run(chunks, &sortTask, options.Jobs);
+
+  if (chunks == 1) return;
+
+  T *scratch = malloc<T>({.Count = count, .Alloc = options.Alloc});
+  defer(free(scratch));
+
+  T *src = data, *dest = scratch;
+  for (s64 width = grain; width < count; width *= 2) {
+    // Each output piece of _grain_ elements is a task. A piece belongs to
+    // the pair of runs which contains it, a pair has 2 * width elements.
+    s64 piecesPerPair = (2 * width + grain - 1) / grain;
+    s64 pairs = (count + 2 * width - 1) / (2 * width);
+
+    auto mergeTask = [&](s64 task) {
+      s64 pair = task / piecesPerPair;
+      s64 piece = task % piecesPerPair;
+
+      s64 pairBegin = pair * 2 * width;
+      s64 mid = pairBegin + width < count ? pairBegin + width : count;
+      s64 pairEnd = mid + width < count ? mid + width : count;
+
+      T *a = src + pairBegin, *b = src + mid;
+      s64 n = mid - pairBegin, m = pairEnd - mid;
+
+      s64 k0 = piece * grain;
+      if (k0 >= n + m) return;
+      s64 k1 = k0 + grain < n + m ? k0 + grain : n + m;
+
+      s64 i0 = internal::merge_split(a, n, b, m, k0, less);
+      s64 i1 = internal::merge_split(a, n, b, m, k1, less);
+
+      internal::merge(a + i0, a + i1, b + (k0 - i0), b + (k1 - i1),
+                      dest + pairBegin + k0, less);
+    };
+    parallel_run(pairs * piecesPerPair, &mergeTask, options.Jobs);
+
+    T *t = src;
+    src = dest;
+    dest = t;
+  }
+
+  if (src != data) {
+    auto copyTask = [&](s64 chunk) {
+      s64 b = chunk * grain;
+      s64 e = b + grain < count ? b + grain : count;
+      memcpy(data + b, src + b, (e - b) * sizeof(T));
+    };
+    parallel_run(chunks, &copyTask, options.Jobs);
+  }
+}
+
+template <typename T>
+void parallel_sort(T *data, s64 count, parallel_options options = {}) {
+  parallel_sort(
+      data, count, [](T no_copy a, T no_copy b) { return a < b; }, options);
+}
+
+LSTD_END_NAMESPACE
@@ -2,17 +2,18 @@
 
 #include "big_integer.h"
 #include "common.h"
+#include "parse/float_decimal.h"
 #include "string.h"
 
 //
-// This is a module which provides routines to parse integers and booleans.
-// As well as helper functions to treat parse status and expecting a sequence of
-// characters.
-//
-// @TODO: Floating point numbers, however we have implementations for strtod,
-// atof
-//        and sscanf in platform/windows_no_crt/common_functions.h
+// This is a module which provides routines to parse integers, floats and
+// booleans. As well as helper functions to treat parse status and expecting a
+// sequence of characters.
 //
+// Plain ASCII decimal (the common case) takes a fast path which reads 8 digits
+// at a time instead of decoding code points one by one. Floats are parsed
+// directly from a _string_ (no null terminator needed) and are correctly
+// rounded, see parse/float_eisel_lemire.h.
 //
 
 LSTD_BEGIN_NAMESPACE
@@ -197,25 +198,113 @@ struct parse_result {
 #define FAIL \
   { 0, PARSE_INVALID, p }
 
+namespace internal {
+always_inline bool parse_is_digit(char c) { return (u8) (c - '0') <= 9; }
+
+always_inline u64 parse_load_8_bytes(const char *p) {
+  u64 result;
+  memcpy(&result, p, 8);
+  return result;
+}
+
+// True if all 8 bytes (loaded little-endian) are in '0'..'9'. Adding 6 to
+// each byte carries out of the low nibble exactly when it's > 9.
+always_inline bool parse_is_8_digits(u64 chunk) {
+  return ((chunk & 0xF0F0F0F0F0F0F0F0) |
+          (((chunk + 0x0606060606060606) & 0xF0F0F0F0F0F0F0F0) >> 4)) ==
+         0x3333333333333333;
+}
+
+// Converts 8 ASCII digits (first digit in the lowest byte) with 3
+// multiplications: pairs of digits, then pairs of pairs, then the halves.
+always_inline u32 parse_8_digits(u64 chunk) {
+  const u64 MASK = 0x000000FF000000FF;
+  const u64 MUL1 = 0x000F424000000064;  // 100 + (1000000 << 32)
+  const u64 MUL2 = 0x0000271000000001;  // 1 + (10000 << 32)
+
+  chunk -= 0x3030303030303030;
+  chunk = chunk * 10 + (chunk >> 8);
+  chunk = (((chunk & MASK) * MUL1) + (((chunk >> 16) & MASK) * MUL2)) >> 32;
+  return (u32) chunk;
+}
+
+// Fast path of _parse_int_small_integer_ for base 10 with the default code
+// point to digit mapping. _p_ must start with a digit. Results (and the
+// returned rest) match the general loop.
+template <is_integral T, parse_int_options Options>
+parse_result<T> parse_int_decimal(string p, bool parsedNegative) {
+  // Accumulate the magnitude unsigned so the most negative value fits
+  u64 limit;
+  if constexpr (is_unsigned_integral<T>) {
+    limit = (u64) (numeric<T>::max)();
+  } else {
+    limit = (u64) (numeric<T>::max)() + (parsedNegative ? 1 : 0);
+  }
+
+  const char *s = p.Data, *end = p.Data + p.Count;
+
+  u64 value = 0;
+  if constexpr (sizeof(T) >= 4) {
+    u64 chunkCutOff = (limit - 99999999) / 100000000;
+    while (end - s >= 8) {
+      u64 chunk = parse_load_8_bytes(s);
+      if (!parse_is_8_digits(chunk) || value > chunkCutOff) break;
+
+      value = value * 100000000 + parse_8_digits(chunk);
+      s += 8;
+    }
+  }
+
+  u64 cutOff = limit / 10;
+  u32 cutLim = (u32) (limit % 10);
+  while (s != end) {
+    u32 digit = (u32) (u8) (*s - '0');
+    if (digit > 9) break;
+    ++s;
+
+    if (value > cutOff || value == cutOff && digit > cutLim) {
+      if constexpr (Options.ReturnLimitOnTooManyDigits) value = limit;
+      return {(T) (parsedNegative ? 0 - value : value), PARSE_TOO_MANY_DIGITS,
+              string(s, end - s)};
+    }
+    value = value * 10 + digit;
+  }
+  return {(T) (parsedNegative ? 0 - value : value), PARSE_SUCCESS,
+          string(s, end - s)};
+}
+}  // namespace internal
+
 // Parses 8, 16, 32, 64 or 128 bit numbers after sign and
 // base prefix has been handled. Called from parse_int.
 template <is_integral T, parse_int_options Options>
 parse_result<T> parse_int_small_integer(string p, u32 base,
                                         bool parsedNegative) {
-  T maxValue, cutOff;
+  constexpr cp_to_digit_t codePointToDigit = Options.CodePointToDigit;
+
+  if constexpr (codePointToDigit == cp_to_digit_default &&
+                Options.MaxDigits == -1 && Options.BailOnTooManyDigits &&
+                sizeof(T) <= 8) {
+    if (base == 10 && p.Count && internal::parse_is_digit(p.Data[0])) {
+      return internal::parse_int_decimal<T, Options>(p, parsedNegative);
+    }
+  }
+
+  // Accumulate the magnitude unsigned (like _parse_int_decimal_) so the most
+  // negative value fits
+  using U = type_select_t<(sizeof(T) > 8), u128, u64>;
+
+  U maxValue, cutOff;
   s32 cutLim;
   if constexpr (Options.BailOnTooManyDigits) {
     // Determine at what point we stop parsing because the number becomes too
     // big
     if constexpr (is_unsigned_integral<T>) {
-      maxValue = (numeric<T>::max)();
-      cutOff = maxValue / base;
+      maxValue = (U) (numeric<T>::max)();
     } else {
-      maxValue = parsedNegative ? -numeric<T>::min() : numeric<T>::max();
-      cutOff = maxValue / base;
-      cutOff = abs(cutOff);
+      maxValue = (U) (numeric<T>::max)() + (U) (parsedNegative ? 1 : 0);
     }
-    cutLim = maxValue % (T)base;
+    cutOff = maxValue / (U) base;
+    cutLim = (s32) (maxValue % (U) base);
   }
 
   s64 maxDigits = Options.MaxDigits;
@@ -225,10 +314,8 @@ parse_result<T> parse_int_small_integer(string p, u32 base,
 
   bool firstDigit = true;
 
-  constexpr cp_to_digit_t codePointToDigit = Options.CodePointToDigit;
-
   // Now start doing the real work
-  T value = 0;
+  U value = 0;
   while (true) {
     if constexpr (Options.MaxDigits != -1) {
       if (!maxDigits) break;
@@ -270,18 +357,18 @@ parse_result<T> parse_int_small_integer(string p, u32 base,
       // we bail
       if (value > cutOff || value == cutOff && digit > cutLim) {
         if constexpr (Options.ReturnLimitOnTooManyDigits) value = maxValue;
-        return {handle_negative(value, parsedNegative), PARSE_TOO_MANY_DIGITS,
-                p};
+        return {(T) (parsedNegative ? U(0) - value : value),
+                PARSE_TOO_MANY_DIGITS, p};
       }
 
       // If _BailOnTooManyDigits_ is false then we don't execute the code above
       // and continue parsing (while overflowing) until all digits have been
       // read from the buffer.
     }
-    value = value * base + digit;
+    value = value * (U) base + (U) digit;
   }
 
-  return {handle_negative(value, parsedNegative), PARSE_SUCCESS, p};
+  return {(T) (parsedNegative ? U(0) - value : value), PARSE_SUCCESS, p};
 }
 
 template <parse_int_options Options>
@@ -340,12 +427,14 @@ parse_result<T> parse_int(string buffer, u32 base = 10) {
   string p = buffer;
   if (!p.Count) return FAIL;
 
+  // Signs and base prefixes are ASCII so we compare bytes, indexing the
+  // string with [] decodes code points which is a lot slower.
   bool negative = false;
   if constexpr (Options.ParseSign) {
-    if (p[0] == '+') {
+    if (p.Data[0] == '+') {
       advance_bytes(&p, 1);
       if constexpr (!Options.AllowPlusSign) return FAIL;
-    } else if (p[0] == '-') {
+    } else if (p.Data[0] == '-') {
       negative = true;
       advance_bytes(&p, 1);
     }
@@ -353,8 +442,8 @@ parse_result<T> parse_int(string buffer, u32 base = 10) {
   }
 
   if constexpr (Options.LookForBasePrefix) {
-    if (p[0] == '0') {
-      if (p.Count - 1 && (p[1] == 'x' || p[1] == 'X')) {
+    if (p.Data[0] == '0') {
+      if (p.Count - 1 && (p.Data[1] == 'x' || p.Data[1] == 'X')) {
         base = 16;
         advance_bytes(&p, 2);
       } else {
@@ -372,6 +461,219 @@ parse_result<T> parse_int(string buffer, u32 base = 10) {
   }
 }
 
+// Similar to parse_int, these options compile different
+// versions of parse_float and turn off certain code paths.
+struct parse_float_options {
+  bool ParseSign = true;      // Looks for +/- before the number.
+  bool AllowPlusSign = true;  // If false, an explicit + fails parsing.
+
+  // Parses "inf", "infinity" and "nan" (ignoring case) like strtod does.
+  bool ParseInfAndNan = true;
+};
+
+namespace internal {
+// Compares ASCII letters ignoring case, _word_ must be lower case
+inline bool parse_float_match_word(string p, const char *word, s64 count) {
+  if (p.Count < count) return false;
+  For(range(count)) {
+    if ((p.Data[it] | 0x20) != word[it]) return false;
+  }
+  return true;
+}
+
+// Reads as many digits as possible in _w_ (wrapping on overflow, the caller
+// re-reads them if there were too many)
+always_inline const char *parse_float_digits(const char *s, const char *end,
+                                             u64 *w) {
+  u64 value = *w;
+  while (end - s >= 8) {
+    u64 chunk = parse_load_8_bytes(s);
+    if (!parse_is_8_digits(chunk)) break;
+
+    value = value * 100000000 + parse_8_digits(chunk);
+    s += 8;
+  }
+  while (s != end && parse_is_digit(*s)) {
+    value = value * 10 + (u64) (*s - '0');
+    ++s;
+  }
+  *w = value;
+  return s;
+}
+}  // namespace internal
+
+//
+// Parses a float in the form (+|-)digits(.digits)(e(+|-)digits), the digits
+// before or after the point may be omitted (but not both), e.g. "12", "-1.5",
+// ".5", "3.", "6.02e23". Also "inf", "infinity" and "nan" (see options).
+//
+// The result is correctly rounded (round to nearest, ties to even) which
+// means it's bit identical to a correct strtod. The string doesn't have to be
+// null terminated, nothing is allocated.
+//
+// We try (from fastest to slowest):
+//   * Clinger's fast path - the digits and the power of 10 are exact floats
+//     so one multiplication or division rounds correctly;
+//   * Eisel-Lemire - a 128-bit multiplication with a precomputed power of 5,
+//     handles everything with up to 19 significant digits;
+//   * a big decimal - only for longer inputs which are too close to halfway
+//     between two floats to decide with the first 19 digits.
+//
+// This function doesn't eat white space from the beginning. Hex floats aren't
+// supported. If there is an 'e' which isn't followed by a valid exponent it's
+// not consumed (like strtod): "1e+x" parses 1 and the rest is "e+x".
+//
+// Returns:
+//   * PARSE_SUCCESS          if a valid float was parsed (numbers too small
+//                            to represent round to 0).
+//
+//   * PARSE_INVALID          if there were no digits.
+//
+//   * PARSE_TOO_MANY_DIGITS  if the number is too large to be represented,
+//                            the value is +/- infinity.
+//
+template <is_floating_point T,
+          parse_float_options Options = parse_float_options{}>
+parse_result<T> parse_float(string buffer) {
+  string p = buffer;
+  if (!p.Count) return FAIL;
+
+  bool negative = false;
+  if constexpr (Options.ParseSign) {
+    if (p.Data[0] == '+') {
+      advance_bytes(&p, 1);
+      if constexpr (!Options.AllowPlusSign) return FAIL;
+    } else if (p.Data[0] == '-') {
+      negative = true;
+      advance_bytes(&p, 1);
+    }
+    if (!p.Count) return FAIL;
+  }
+
+  if constexpr (Options.ParseInfAndNan) {
+    if (internal::parse_float_match_word(p, "nan", 3)) {
+      advance_bytes(&p, 3);
+      T nan = numeric<T>::quiet_NaN();
+      return {negative ? -nan : nan, PARSE_SUCCESS, p};
+    }
+
+    if (internal::parse_float_match_word(p, "inf", 3)) {
+      bool infinity = internal::parse_float_match_word(p, "infinity", 8);
+      advance_bytes(&p, infinity ? 8 : 3);
+      T inf = numeric<T>::infinity();
+      return {negative ? -inf : inf, PARSE_SUCCESS, p};
+    }
+  }
+
+  const char *end = p.Data + p.Count;
+
+  u64 w = 0;
+
+  const char *integerBegin = p.Data;
+  const char *integerEnd =
+      internal::parse_float_digits(integerBegin, end, &w);
+  s64 digitCount = integerEnd - integerBegin;
+
+  const char *fractionBegin = integerEnd, *fractionEnd = integerEnd;
+  if (integerEnd != end && *integerEnd == '.') {
+    fractionBegin = integerEnd + 1;
+    fractionEnd = internal::parse_float_digits(fractionBegin, end, &w);
+    digitCount += fractionEnd - fractionBegin;
+  }
+
+  if (!digitCount) return FAIL;
+
+  const char *s = fractionEnd;
+
+  s64 explicitExponent = 0;
+  if (s != end && (*s == 'e' || *s == 'E')) {
+    const char *e = s + 1;
+
+    bool negativeExponent = false;
+    if (e != end && (*e == '+' || *e == '-')) {
+      negativeExponent = *e == '-';
+      ++e;
+    }
+
+    if (e != end && internal::parse_is_digit(*e)) {
+      while (e != end && internal::parse_is_digit(*e)) {
+        // Anything this big is 0 or infinity anyway
+        if (explicitExponent < 0x10000) {
+          explicitExponent = explicitExponent * 10 + (*e - '0');
+        }
+        ++e;
+      }
+      if (negativeExponent) explicitExponent = -explicitExponent;
+      s = e;
+    }
+  }
+
+  p = string(s, end - s);
+
+  s64 exponent = explicitExponent - (fractionEnd - fractionBegin);
+
+  // _w_ holds at most 19 digits. If there are more we keep the first 19 and
+  // remember that the rest were dropped.
+  bool truncated = false;
+  if (digitCount > 19) {
+    // Leading zeros don't count
+    for (const char *it = integerBegin; it != fractionEnd; ++it) {
+      if (*it == '0') {
+        --digitCount;
+      } else if (*it != '.') {
+        break;
+      }
+    }
+
+    if (digitCount > 19) {
+      truncated = true;
+
+      const u64 MIN_19_DIGITS = 1000000000000000000;
+
+      w = 0;
+      const char *it = integerBegin;
+      while (w < MIN_19_DIGITS && it != integerEnd) {
+        w = w * 10 + (u64) (*it++ - '0');
+      }
+
+      if (w >= MIN_19_DIGITS) {
+        exponent = (integerEnd - it) + explicitExponent;
+      } else {
+        it = fractionBegin;
+        while (w < MIN_19_DIGITS && it != fractionEnd) {
+          w = w * 10 + (u64) (*it++ - '0');
+        }
+        exponent = (fractionBegin - it) + explicitExponent;
+      }
+    }
+  }
+
+  T value;
+  if (!truncated &&
+      internal::parse_float_clinger(w, exponent, negative, &value)) {
+    return {value, PARSE_SUCCESS, p};
+  }
+
+  auto am = internal::parse_float_eisel_lemire<T>(exponent, w);
+
+  // The dropped digits are somewhere between w and w + 1. If both round to
+  // the same float so does the real value.
+  if (truncated &&
+      !(am == internal::parse_float_eisel_lemire<T>(exponent, w + 1))) {
+    internal::parse_float_decimal d;
+    internal::parse_float_decimal_make(
+        d, string(integerBegin, integerEnd - integerBegin),
+        string(fractionBegin, fractionEnd - fractionBegin), explicitExponent);
+    am = internal::parse_float_decimal_to_binary<T>(d);
+  }
+
+  value = internal::parse_float_assemble<T>(am, negative);
+  if (am.Power2 == internal::parse_float_format<T>::INFINITE_POWER) {
+    return {value, PARSE_TOO_MANY_DIGITS, p};
+  }
+  return {value, PARSE_SUCCESS, p};
+}
+
 template <bool IgnoreCase = false>
 bool expect_cp(string *p, code_point value) {
   if (!p->Count) return false;
@@ -0,0 +1,270 @@
+#pragma once
+
+#include "../string.h"
+#include "float_eisel_lemire.h"
+
+//
+// Slow but always correct decimal to float conversion, used by _parse_float_
+// only when the input has more than 19 significant digits and Eisel-Lemire
+// can't decide the rounding (the value is extremely close to halfway between
+// two floats).
+//
+// The digits are kept as a big decimal and shifted by powers of 2 until the
+// value is in [1/2, 1), then the mantissa is read off the top digits (the
+// "simple decimal conversion" from Go's strconv and Nigel Tao's Wuffs).
+// More than 768 digits never change the result except for rounding
+// exactly-halfway values, which is what _Truncated_ is for.
+//
+
+LSTD_BEGIN_NAMESPACE
+
+namespace internal {
+
+struct parse_float_decimal {
+  static const s32 MAX_DIGITS = 768;
+  static const s32 DECIMAL_POINT_RANGE = 2047;
+
+  // Shifting by more than this overflows the u64 accumulators
+  static const s32 MAX_SHIFT = 60;
+
+  s32 DigitCount = 0;
+  s32 DecimalPoint = 0;  // Position of the point relative to the digits
+  bool Truncated = false;
+  u8 Digits[MAX_DIGITS];  // Values 0-9, not ASCII
+};
+
+inline void parse_float_decimal_trim(parse_float_decimal ref d) {
+  while (d.DigitCount > 0 && d.Digits[d.DigitCount - 1] == 0) --d.DigitCount;
+}
+
+inline void parse_float_decimal_add_digit(parse_float_decimal ref d, u8 digit) {
+  if (d.DigitCount < parse_float_decimal::MAX_DIGITS) {
+    d.Digits[d.DigitCount++] = digit;
+  } else if (digit) {
+    d.Truncated = true;
+  }
+}
+
+// Builds the decimal from the digits before and after the point (ASCII,
+// already validated) and the explicit exponent.
+inline void parse_float_decimal_make(parse_float_decimal ref d,
+                                     string integer, string fraction,
+                                     s64 exponent) {
+  s64 point = 0;
+  For(range(integer.Count)) {
+    u8 digit = (u8) (integer.Data[it] - '0');
+    if (d.DigitCount == 0 && digit == 0) continue;
+    parse_float_decimal_add_digit(d, digit);
+    ++point;
+  }
+  For(range(fraction.Count)) {
+    u8 digit = (u8) (fraction.Data[it] - '0');
+    if (d.DigitCount == 0 && digit == 0) {
+      // Leading zeros only move the point
+      --point;
+      continue;
+    }
+    parse_float_decimal_add_digit(d, digit);
+  }
+
+  point += exponent;
+  if (point > 100000) point = 100000;
+  if (point < -100000) point = -100000;
+  d.DecimalPoint = (s32) point;
+
+  parse_float_decimal_trim(d);
+}
+
+// Multiplies by 2^shift. We write the result from the end into a temporary
+// since we don't know how many digits it has before we are done.
+inline void parse_float_decimal_left_shift(parse_float_decimal ref d,
+                                           s32 shift) {
+  if (!d.DigitCount) return;
+
+  // 2^60 has 19 digits, so we grow by at most that many
+  const s32 GROWTH = 19;
+  u8 temp[parse_float_decimal::MAX_DIGITS + GROWTH];
+
+  s32 w = d.DigitCount + GROWTH;
+  u64 n = 0;
+  for (s32 r = d.DigitCount - 1; r >= 0; --r) {
+    n += (u64) d.Digits[r] << shift;
+    u64 quotient = n / 10;
+    temp[--w] = (u8) (n - 10 * quotient);
+    n = quotient;
+  }
+  while (n > 0) {
+    u64 quotient = n / 10;
+    temp[--w] = (u8) (n - 10 * quotient);
+    n = quotient;
+  }
+
+  s32 count = d.DigitCount + GROWTH - w;
+  s32 kept = count < parse_float_decimal::MAX_DIGITS
+                 ? count
+                 : parse_float_decimal::MAX_DIGITS;
+  For(range(kept, count)) {
+    if (temp[w + it]) d.Truncated = true;
+  }
+  memcpy(d.Digits, temp + w, kept);
+
+  d.DecimalPoint += count - d.DigitCount;
+  d.DigitCount = kept;
+  if (d.DecimalPoint < -parse_float_decimal::DECIMAL_POINT_RANGE) {
+    d.DigitCount = 0;
+    d.DecimalPoint = 0;
+  }
+  parse_float_decimal_trim(d);
+}
+
+// Divides by 2^shift
+inline void parse_float_decimal_right_shift(parse_float_decimal ref d,
+                                            s32 shift) {
+  s32 r = 0, w = 0;
+
+  // Find the first digit of the result
+  u64 n = 0;
+  while ((n >> shift) == 0) {
+    if (r >= d.DigitCount) {
+      if (n == 0) {
+        // The value is zero
+        d.DigitCount = 0;
+        return;
+      }
+      while ((n >> shift) == 0) {
+        n *= 10;
+        ++r;
+      }
+      break;
+    }
+    n = n * 10 + d.Digits[r++];
+  }
+  d.DecimalPoint -= r - 1;
+
+  u64 mask = (1ull << shift) - 1;
+  while (r < d.DigitCount) {
+    u8 digit = (u8) (n >> shift);
+    n = (n & mask) * 10 + d.Digits[r++];
+    d.Digits[w++] = digit;
+  }
+  while (n > 0) {
+    u8 digit = (u8) (n >> shift);
+    n = (n & mask) * 10;
+    if (w < parse_float_decimal::MAX_DIGITS) {
+      d.Digits[w++] = digit;
+    } else if (digit) {
+      d.Truncated = true;
+    }
+  }
+  d.DigitCount = w;
+  parse_float_decimal_trim(d);
+}
+
+// The integer part of the decimal, rounded half to even
+inline u64 parse_float_decimal_round(parse_float_decimal no_copy d) {
+  if (d.DigitCount == 0 || d.DecimalPoint < 0) return 0;
+  if (d.DecimalPoint > 18) return 0xFFFFFFFFFFFFFFFFull;
+
+  s32 point = d.DecimalPoint;
+
+  u64 n = 0;
+  For(range(point)) n = n * 10 + (it < d.DigitCount ? d.Digits[it] : 0);
+
+  bool roundUp = false;
+  if (point < d.DigitCount) {
+    roundUp = d.Digits[point] >= 5;
+    if (d.Digits[point] == 5 && point + 1 == d.DigitCount) {
+      // Exactly halfway, unless digits were dropped
+      roundUp = d.Truncated || (point > 0 && (d.Digits[point - 1] & 1));
+    }
+  }
+  return n + roundUp;
+}
+
+template <typename F>
+parse_float_adjusted_mantissa parse_float_decimal_to_binary(
+    parse_float_decimal ref d) {
+  using format = parse_float_format<F>;
+
+  parse_float_adjusted_mantissa zero, infinity;
+  infinity.Power2 = format::INFINITE_POWER;
+
+  if (d.DigitCount == 0 || d.DecimalPoint < -324) return zero;
+  if (d.DecimalPoint >= 310) return infinity;
+
+  // How many bits we can shift by to move the point by n digits
+  const u8 DECIMAL_POWERS[] = {0,  3,  6,  9,  13, 16, 19, 23, 26, 29,
+                               33, 36, 39, 43, 46, 49, 53, 56, 59};
+  const s32 NUM_POWERS = (s32) (sizeof(DECIMAL_POWERS) / sizeof(u8));
+
+  s32 exp2 = 0;
+
+  // Shift right until the value is < 1
+  while (d.DecimalPoint > 0) {
+    s32 n = d.DecimalPoint;
+    s32 shift =
+        n < NUM_POWERS ? DECIMAL_POWERS[n] : parse_float_decimal::MAX_SHIFT;
+    parse_float_decimal_right_shift(d, shift);
+    if (d.DecimalPoint < -parse_float_decimal::DECIMAL_POINT_RANGE) {
+      return zero;
+    }
+    exp2 += shift;
+  }
+
+  // Shift left until the value is in [1/2, 1)
+  while (d.DecimalPoint <= 0) {
+    s32 shift;
+    if (d.DecimalPoint == 0) {
+      if (d.Digits[0] >= 5) break;
+      shift = d.Digits[0] < 2 ? 2 : 1;
+    } else {
+      s32 n = -d.DecimalPoint;
+      shift =
+          n < NUM_POWERS ? DECIMAL_POWERS[n] : parse_float_decimal::MAX_SHIFT;
+    }
+    parse_float_decimal_left_shift(d, shift);
+    if (d.DecimalPoint > parse_float_decimal::DECIMAL_POINT_RANGE) {
+      return infinity;
+    }
+    exp2 -= shift;
+  }
+
+  // Floats are in [1, 2)
+  --exp2;
+
+  // Subnormals
+  while (format::MINIMUM_EXPONENT + 1 > exp2) {
+    s32 n = format::MINIMUM_EXPONENT + 1 - exp2;
+    if (n > parse_float_decimal::MAX_SHIFT) n = parse_float_decimal::MAX_SHIFT;
+    parse_float_decimal_right_shift(d, n);
+    exp2 += n;
+  }
+
+  if (exp2 - format::MINIMUM_EXPONENT >= format::INFINITE_POWER) {
+    return infinity;
+  }
+
+  const s32 MANTISSA_SIZE = format::MANTISSA_BITS + 1;
+  parse_float_decimal_left_shift(d, MANTISSA_SIZE);
+
+  u64 mantissa = parse_float_decimal_round(d);
+  if (mantissa >= (1ull << MANTISSA_SIZE)) {
+    // Rounding carried over, shift back
+    parse_float_decimal_right_shift(d, 1);
+    exp2 += 1;
+    mantissa = parse_float_decimal_round(d);
+    if (exp2 - format::MINIMUM_EXPONENT >= format::INFINITE_POWER) {
+      return infinity;
+    }
+  }
+
+  parse_float_adjusted_mantissa answer;
+  answer.Power2 = exp2 - format::MINIMUM_EXPONENT;
+  if (mantissa < (1ull << format::MANTISSA_BITS)) answer.Power2--;
+  answer.Mantissa = mantissa & ((1ull << format::MANTISSA_BITS) - 1);
+  return answer;
+}
+
+}  // namespace internal
+
+LSTD_END_NAMESPACE
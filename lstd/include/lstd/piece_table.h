@@ -0,0 +1,573 @@
+#pragma once
+
+#include "array.h"
+#include "string.h"
+
+LSTD_BEGIN_NAMESPACE
+
+//
+// Piece table for editing large text.
+//
+// Editing a _string_ in the middle (insert_at_index, remove_range) moves all
+// the bytes after the edit, which gets slow when the text is big and the edits
+// are many (e.g. a text editor). A piece table never moves text. It keeps the
+// original text (read-only) and an append-only buffer with everything that was
+// inserted. The document is a sequence of pieces, each piece refers to a range
+// of bytes in one of the two buffers.
+//
+// The pieces are kept in a treap (a randomized balanced binary tree) ordered
+// by position, each node also stores the size of its subtree, so we find,
+// split and join pieces in O(log n) expected time. Indices are code points
+// (same as _string_), negative indices count from the end.
+//
+//      piece_table p = make_piece_table(text);
+//      defer(free(p));
+//
+//      insert_at_index(p, 5, "hello");
+//      remove_range(p, 0, 3);
+//
+//      For(p) { ... }               // Iterate code points
+//      For(pieces(p)) { ... }       // Iterate the text as string views
+//      For(slice(p, 10, 20)) { ... }  // A range, doesn't modify the table
+//
+//      string result = to_string(p);  // Flatten (allocates)
+//
+// Text inserted right after the previous insert (e.g. typing) extends the
+// last piece instead of adding a new one.
+//
+// The original text is NOT copied, it must be valid while the table is used.
+//
+struct piece_table {
+  // Pieces are limited in size so splitting one (which walks its bytes to
+  // translate a code point index) stays cheap.
+  static const s64 MAX_PIECE_SIZE = 4_KiB;
+
+  // Iterators keep the path from the root. The expected depth of a treap is
+  // O(log n), this is never reached in practice.
+  static const s64 MAX_DEPTH = 128;
+
+  struct node {
+    u32 Left, Right;
+    u32 Priority;
+
+    bool InAdded;  // Which buffer the piece points to
+    s64 Offset;    // Byte offset in that buffer
+    s64 Size;      // In bytes
+    s64 Length;    // In code points
+
+    // Totals for the subtree rooted at this node (including it)
+    s64 TreeSize, TreeLength, TreePieces;
+  };
+
+  string Original;
+  string Added;
+
+  // Index 0 is a sentinel which means "no node". Nodes refer to each other by
+  // index, so the array can grow freely.
+  array<node> Nodes;
+  u32 Root = 0;
+  u32 FreeList = 0;  // Removed nodes are chained through _Right_
+
+  u32 Seed = 0x9e3779b9;
+};
+
+namespace internal {
+inline u32 piece_table_random(piece_table ref p) {
+  // xorshift32
+  u32 x = p.Seed;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return p.Seed = x;
+}
+
+inline piece_table::node *piece_table_node(piece_table ref p, u32 n) {
+  return p.Nodes.Data + n;
+}
+
+inline const char *piece_table_piece_data(piece_table no_copy p,
+                                          piece_table::node *n) {
+  return (n->InAdded ? p.Added.Data : p.Original.Data) + n->Offset;
+}
+
+inline void piece_table_update(piece_table ref p, u32 n) {
+  auto *x = piece_table_node(p, n);
+  auto *l = piece_table_node(p, x->Left);
+  auto *r = piece_table_node(p, x->Right);
+  x->TreeSize = l->TreeSize + x->Size + r->TreeSize;
+  x->TreeLength = l->TreeLength + x->Length + r->TreeLength;
+  x->TreePieces = l->TreePieces + 1 + r->TreePieces;
+}
+
+inline u32 piece_table_new_node(piece_table ref p, bool inAdded, s64 offset,
+                                s64 size, s64 length) {
+  u32 n;
+  if (p.FreeList) {
+    n = p.FreeList;
+    p.FreeList = piece_table_node(p, n)->Right;
+  } else {
+    n = (u32)p.Nodes.Count;
+    add(p.Nodes, piece_table::node{});
+  }
+
+  auto *x = piece_table_node(p, n);
+  *x = {};
+  x->Priority = piece_table_random(p);
+  x->InAdded = inAdded;
+  x->Offset = offset;
+  x->Size = size;
+  x->Length = length;
+  piece_table_update(p, n);
+  return n;
+}
+
+inline void piece_table_free_nodes(piece_table ref p, u32 n) {
+  if (!n) return;
+  auto *x = piece_table_node(p, n);
+  piece_table_free_nodes(p, x->Left);
+  piece_table_free_nodes(p, x->Right);
+  x->Right = p.FreeList;
+  p.FreeList = n;
+}
+
+inline u32 piece_table_merge(piece_table ref p, u32 a, u32 b) {
+  if (!a) return b;
+  if (!b) return a;
+
+  auto *x = piece_table_node(p, a);
+  auto *y = piece_table_node(p, b);
+  if (x->Priority > y->Priority) {
+    x->Right = piece_table_merge(p, x->Right, b);
+    piece_table_update(p, a);
+    return a;
+  } else {
+    u32 left = piece_table_merge(p, a, y->Left);
+    piece_table_node(p, b)->Left = left;  // _y_ may be stale after a merge
+    piece_table_update(p, b);
+    return b;
+  }
+}
+
+struct piece_table_split_result {
+  u32 Left, Right;
+};
+
+// Splits the tree into the first _index_ code points and the rest.
+// A piece which contains the split point is cut in two.
+inline piece_table_split_result piece_table_split(piece_table ref p, u32 n,
+                                                  s64 index) {
+  if (!n) return {0, 0};
+
+  auto *x = piece_table_node(p, n);
+  s64 leftLength = piece_table_node(p, x->Left)->TreeLength;
+
+  if (index <= leftLength) {
+    auto [a, b] = piece_table_split(p, x->Left, index);
+    x = piece_table_node(p, n);
+    x->Left = b;
+    piece_table_update(p, n);
+    return {a, n};
+  }
+
+  if (index >= leftLength + x->Length) {
+    auto [a, b] = piece_table_split(p, x->Right, index - leftLength - x->Length);
+    x = piece_table_node(p, n);
+    x->Right = a;
+    piece_table_update(p, n);
+    return {n, b};
+  }
+
+  // The split point is inside this piece
+  s64 cut = index - leftLength;
+  auto *data = piece_table_piece_data(p, x);
+  s64 cutBytes =
+      utf8_get_pointer_to_cp_at_translated_index(data, x->Size, cut) - data;
+
+  u32 rest = piece_table_new_node(p, x->InAdded, x->Offset + cutBytes,
+                                  x->Size - cutBytes, x->Length - cut);
+
+  x = piece_table_node(p, n);  // _new_node_ may have moved the nodes
+  u32 right = x->Right;
+  x->Right = 0;
+  x->Size = cutBytes;
+  x->Length = cut;
+  piece_table_update(p, n);
+
+  return {n, piece_table_merge(p, rest, right)};
+}
+
+// Builds a tree with pieces for [offset, offset + size) of a buffer,
+// cutting it in pieces of at most MAX_PIECE_SIZE bytes (at code point
+// boundaries).
+inline u32 piece_table_make_pieces(piece_table ref p, bool inAdded, s64 offset,
+                                   s64 size) {
+  u32 result = 0;
+  while (size) {
+    string buffer = inAdded ? p.Added : p.Original;
+    auto *data = buffer.Data + offset;
+
+    s64 pieceSize = size;
+    if (pieceSize > piece_table::MAX_PIECE_SIZE) {
+      pieceSize = piece_table::MAX_PIECE_SIZE;
+
+      // Back off to the start of the code point, at most 3 bytes. Longer
+      // runs of continuation bytes are invalid UTF-8, those are just cut.
+      s64 cut = pieceSize;
+      while (cut > pieceSize - 3 && (data[cut] & 0xc0) == 0x80) --cut;
+      if ((data[cut] & 0xc0) != 0x80) pieceSize = cut;
+    }
+
+    u32 n = piece_table_new_node(p, inAdded, offset, pieceSize,
+                                 utf8_length(data, pieceSize));
+    result = piece_table_merge(p, result, n);
+
+    offset += pieceSize;
+    size -= pieceSize;
+  }
+  return result;
+}
+
+// If the piece which ends at code point _index_ is the last thing added to
+// _Added_, grows it by _size_ bytes (_length_ code points) which were just
+// appended after it. Returns false if there is no such piece or it would get
+// larger than MAX_PIECE_SIZE.
+inline bool piece_table_extend_piece(piece_table ref p, s64 index, s64 size,
+                                     s64 length) {
+  if (!index) return false;
+
+  // Find the piece with code point _index_ - 1
+  s64 target = index - 1;
+  u32 n = p.Root;
+  while (n) {
+    auto *x = piece_table_node(p, n);
+    s64 leftLength = piece_table_node(p, x->Left)->TreeLength;
+    if (target < leftLength) {
+      n = x->Left;
+    } else if (target < leftLength + x->Length) {
+      if (target != leftLength + x->Length - 1) return false;
+      if (!x->InAdded || x->Offset + x->Size != p.Added.Count - size) {
+        return false;
+      }
+      if (x->Size + size > piece_table::MAX_PIECE_SIZE) return false;
+      break;
+    } else {
+      target -= leftLength + x->Length;
+      n = x->Right;
+    }
+  }
+  if (!n) return false;
+
+  // Walk the same path again and update the totals on the way
+  target = index - 1;
+  n = p.Root;
+  while (true) {
+    auto *x = piece_table_node(p, n);
+    x->TreeSize += size;
+    x->TreeLength += length;
+
+    s64 leftLength = piece_table_node(p, x->Left)->TreeLength;
+    if (target < leftLength) {
+      n = x->Left;
+    } else if (target < leftLength + x->Length) {
+      x->Size += size;
+      x->Length += length;
+      return true;
+    } else {
+      target -= leftLength + x->Length;
+      n = x->Right;
+    }
+  }
+}
+}  // namespace internal
+
+// Makes a piece table which starts with _original_ (not copied!).
+// Uses the Context's allocator for the nodes and the inserted text,
+// unless _alloc_ is specified.
+mark_as_leak inline piece_table make_piece_table(string original = "",
+                                                 allocator alloc = {}) {
+  piece_table p;
+  p.Original = original;
+
+  reserve(p.Nodes, 64, alloc);
+  add(p.Nodes, piece_table::node{});  // The sentinel, all zeroes
+
+  reserve(p.Added, 64, alloc);
+
+  p.Root = internal::piece_table_make_pieces(p, false, 0, original.Count);
+  return p;
+}
+
+inline void free(piece_table ref p) {
+  free(p.Nodes);
+  free(p.Added);
+  p.Root = p.FreeList = 0;
+}
+
+// In code points
+inline s64 length(piece_table no_copy p) {
+  return p.Nodes.Data[p.Root].TreeLength;
+}
+
+// In bytes
+inline s64 byte_count(piece_table no_copy p) {
+  return p.Nodes.Data[p.Root].TreeSize;
+}
+
+inline void insert_at_index(piece_table ref p, s64 index, string str) {
+  if (!str.Count) return;
+
+  index = translate_negative_index(index, length(p), true);
+
+  s64 offset = p.Added.Count;
+  add(p.Added, str);
+
+  if (internal::piece_table_extend_piece(p, index, str.Count,
+                                         utf8_length(str.Data, str.Count))) {
+    return;
+  }
+
+  u32 middle = internal::piece_table_make_pieces(p, true, offset, str.Count);
+
+  auto [left, right] = internal::piece_table_split(p, p.Root, index);
+  p.Root = internal::piece_table_merge(
+      p, internal::piece_table_merge(p, left, middle), right);
+}
+
+inline void insert_at_index(piece_table ref p, s64 index, code_point cp) {
+  char encodedCp[4];
+  utf8_encode_cp(encodedCp, cp);
+  insert_at_index(p, index, string(encodedCp, utf8_get_size_of_cp(cp)));
+}
+
+inline void add(piece_table ref p, string str) {
+  insert_at_index(p, length(p), str);
+}
+
+// Removes code points in the range [begin, end).
+// Note: The removed text stays in the buffers, only the pieces are dropped.
+inline void remove_range(piece_table ref p, s64 begin, s64 end) {
+  s64 len = length(p);
+  begin = translate_negative_index(begin, len);
+  end = translate_negative_index(end, len, true);
+  if (begin >= end) return;
+
+  auto [left, rest] = internal::piece_table_split(p, p.Root, begin);
+  auto [middle, right] = internal::piece_table_split(p, rest, end - begin);
+  internal::piece_table_free_nodes(p, middle);
+  p.Root = internal::piece_table_merge(p, left, right);
+}
+
+inline void remove_at_index(piece_table ref p, s64 index) {
+  index = translate_negative_index(index, length(p));
+  remove_range(p, index, index + 1);
+}
+
+inline code_point get(piece_table no_copy p, s64 index) {
+  index = translate_negative_index(index, length(p));
+
+  u32 n = p.Root;
+  while (n) {
+    auto *x = p.Nodes.Data + n;
+    s64 leftLength = p.Nodes.Data[x->Left].TreeLength;
+    if (index < leftLength) {
+      n = x->Left;
+    } else if (index < leftLength + x->Length) {
+      auto *data = internal::piece_table_piece_data(p, x);
+      return utf8_decode_cp(utf8_get_pointer_to_cp_at_translated_index(
+          data, x->Size, index - leftLength));
+    } else {
+      index -= leftLength + x->Length;
+      n = x->Right;
+    }
+  }
+  assert(false && "Out of bounds");
+  return 0;
+}
+
+//
+// Iteration
+//
+
+// A range of code points [Begin, End) of a table. Doesn't copy or modify
+// anything, edits to the table invalidate it.
+struct piece_table_slice {
+  const piece_table *Table;
+  s64 Begin, End;
+};
+
+inline piece_table_slice slice(piece_table no_copy p, s64 begin, s64 end) {
+  s64 len = length(p);
+  begin = translate_negative_index(begin, len, true);
+  end = translate_negative_index(end, len, true);
+  return {&p, begin, max(begin, end)};
+}
+
+// Iterates the pieces of a slice in order, each one is a view into the
+// table's buffers (the first and the last are cut to the slice). Walks the
+// tree, so each step is O(1) amortized.
+struct piece_table_piece_iterator {
+  const piece_table *Table;
+  u32 Node = 0;  // The current piece
+
+  // Nodes on the path from the root we went left from, we continue with
+  // them after the current subtree
+  u32 Stack[piece_table::MAX_DEPTH];
+  s64 Depth = 0;
+
+  s64 Skip = 0;       // Code points at the start of the current piece that aren't in the slice
+  s64 Remaining = 0;  // Code points left in the slice, 0 at the end
+
+  piece_table_piece_iterator(const piece_table *table) : Table(table) {}
+
+  // Starts at code point _index_ and goes for _count_ code points
+  piece_table_piece_iterator(const piece_table *table, s64 index, s64 count)
+      : Table(table), Remaining(count) {
+    if (!count) return;
+
+    u32 n = table->Root;
+    while (n) {
+      auto *x = table->Nodes.Data + n;
+      s64 leftLength = table->Nodes.Data[x->Left].TreeLength;
+      if (index < leftLength) {
+        push(n);
+        n = x->Left;
+      } else if (index < leftLength + x->Length) {
+        Node = n;
+        Skip = index - leftLength;
+        return;
+      } else {
+        index -= leftLength + x->Length;
+        n = x->Right;
+      }
+    }
+    Remaining = 0;  // Out of bounds
+  }
+
+  void push(u32 n) {
+    assert(Depth < piece_table::MAX_DEPTH);
+    Stack[Depth++] = n;
+  }
+
+  piece_table_piece_iterator &operator++() {
+    auto *x = Table->Nodes.Data + Node;
+    Remaining -= min(x->Length - Skip, Remaining);
+    Skip = 0;
+    if (!Remaining) return *this;
+
+    // The next piece in order is the leftmost node in the right subtree,
+    // or the last ancestor we went left from
+    if (x->Right) {
+      u32 n = x->Right;
+      while (Table->Nodes.Data[n].Left) {
+        push(n);
+        n = Table->Nodes.Data[n].Left;
+      }
+      Node = n;
+    } else {
+      Node = Depth ? Stack[--Depth] : 0;
+      if (!Node) Remaining = 0;
+    }
+    return *this;
+  }
+
+  bool operator==(piece_table_piece_iterator no_copy other) const {
+    return Table == other.Table && Remaining == other.Remaining;
+  }
+  bool operator!=(piece_table_piece_iterator no_copy other) const {
+    return !(*this == other);
+  }
+
+  string operator*() const {
+    auto *x = Table->Nodes.Data + Node;
+    auto *data = internal::piece_table_piece_data(*Table, x);
+
+    const char *b = data, *e = data + x->Size;
+    if (Skip) b = utf8_get_pointer_to_cp_at_translated_index(data, x->Size, Skip);
+    if (x->Length - Skip > Remaining) {
+      e = utf8_get_pointer_to_cp_at_translated_index(b, e - b, Remaining);
+    }
+    return string(b, e - b);
+  }
+};
+
+struct piece_table_pieces {
+  piece_table_slice Slice;
+};
+
+inline piece_table_pieces pieces(piece_table_slice s) { return {s}; }
+inline piece_table_pieces pieces(piece_table no_copy p) {
+  return {slice(p, 0, length(p))};
+}
+
+inline auto begin(piece_table_pieces r) {
+  return piece_table_piece_iterator(r.Slice.Table, r.Slice.Begin,
+                                    r.Slice.End - r.Slice.Begin);
+}
+inline auto end(piece_table_pieces r) {
+  return piece_table_piece_iterator(r.Slice.Table);
+}
+
+// Iterates the code points. Uses string_iterator-like semantics, the value
+// is a code point (read-only, use insert/remove to edit).
+struct piece_table_iterator {
+  piece_table_piece_iterator Pieces;
+  string Piece;  // The current piece
+  s64 Offset = 0;  // Byte offset in _Piece_
+  s64 Remaining;
+
+  piece_table_iterator(piece_table_piece_iterator no_copy pieces)
+      : Pieces(pieces), Remaining(pieces.Remaining) {
+    if (Remaining) Piece = *Pieces;
+  }
+
+  piece_table_iterator &operator++() {
+    Offset += utf8_get_size_of_cp(Piece.Data + Offset);
+    --Remaining;
+    if (Offset >= Piece.Count && Remaining) {
+      ++Pieces;
+      Piece = *Pieces;
+      Offset = 0;
+    }
+    return *this;
+  }
+
+  bool operator==(piece_table_iterator no_copy other) const {
+    return Pieces.Table == other.Pieces.Table && Remaining == other.Remaining;
+  }
+  bool operator!=(piece_table_iterator no_copy other) const {
+    return !(*this == other);
+  }
+
+  code_point operator*() const { return utf8_decode_cp(Piece.Data + Offset); }
+};
+
+inline auto begin(piece_table_slice s) {
+  return piece_table_iterator(begin(pieces(s)));
+}
+inline auto end(piece_table_slice s) {
+  return piece_table_iterator(end(pieces(s)));
+}
+
+inline auto begin(piece_table no_copy p) { return begin(slice(p, 0, length(p))); }
+inline auto end(piece_table no_copy p) { return end(slice(p, 0, length(p))); }
+
+// Copies the code points in [begin, end) into a new string.
+// Uses the Context's allocator unless _alloc_ is specified.
+mark_as_leak inline string to_string(piece_table_slice s,
+                                     allocator alloc = {}) {
+  string result;
+  reserve(result, max<s64>(s.End - s.Begin, 8), alloc);
+  For(pieces(s)) add(result, it);
+  return result;
+}
+
+mark_as_leak inline string to_string(piece_table no_copy p, s64 begin, s64 end,
+                                     allocator alloc = {}) {
+  return to_string(slice(p, begin, end), alloc);
+}
+
+mark_as_leak inline string to_string(piece_table no_copy p, allocator alloc = {}) {
+  return to_string(p, 0, length(p), alloc);
+}
+
+LSTD_END_NAMESPACE
@@ -23,6 +23,10 @@ LSTD_BEGIN_NAMESPACE
 template <typename T>
 using quick_sort_comparison_func = delegate<s32(const T *, const T *)>;
 
+//
+// Type-erased Quicksort (the one below). Used by the qsort() replacement when
+// we don't link with the CRT, since there we only know the size of an element
+// at runtime.
 //
 // This function performs a basic Quicksort. This implementation is the
 // in-place version of the algorithm and is done in he following way:
@@ -53,22 +57,311 @@ s32 default_comparison(const T *lhs, const T *rhs) {
   return (*lhs == *rhs) ? 0 : ((*lhs < *rhs) ? -1 : 1);
 }
 
+//
+// Typed sort.
+//
+// Pattern-defeating quicksort (pdqsort, Orson Peters): median-of-3 (or
+// ninther for big ranges) pivot, partitioning which handles already
+// partitioned and many-equal ranges in linear time, insertion sort for small
+// ranges and a fall back to heap sort when the recursion gets too deep,
+// so the worst case is O(n log n). Not stable.
+//
+// _less_ is anything callable as less(a, b) -> bool (a lambda, a function,
+// a functor). It's a template argument so the comparisons get inlined,
+// unlike the delegate in the type-erased version above. Elements are
+// moved around whole (lstd types are trivially relocatable, so this is
+// just a copy).
+//
+//      sort(arr.Data, arr.Count);
+//      sort(arr.Data, arr.Count, [](auto a, auto b) { return a.Z < b.Z; });
+//
+namespace internal {
+// Ranges smaller than this are insertion sorted
+const s64 SORT_INSERTION_THRESHOLD = 24;
+
+// Use the median of 3 medians for the pivot in ranges bigger than this
+const s64 SORT_NINTHER_THRESHOLD = 128;
+
 template <typename T>
-void quick_sort(T *first, s64 count,
-                quick_sort_comparison_func<T> compare = default_comparison<T>) {
-  auto compareVoid = [&](const void *lhs, const void *rhs) {
-    return compare((const T *)lhs, (const T *)rhs);
-  };
-  auto wrapper = quick_sort_comparison_func<void>(&compareVoid);
-  quick_sort(first, count, sizeof(T), wrapper);
+always_inline void sort_swap(T *a, T *b) {
+  T t = *a;
+  *a = *b;
+  *b = t;
+}
+
+template <typename T, typename Less>
+always_inline void sort2(T *a, T *b, Less &less) {
+  if (less(*b, *a)) sort_swap(a, b);
+}
+
+template <typename T, typename Less>
+always_inline void sort3(T *a, T *b, T *c, Less &less) {
+  sort2(a, b, less);
+  sort2(b, c, less);
+  sort2(a, b, less);
+}
+
+template <typename T, typename Less>
+void insertion_sort(T *begin, T *end, Less &less) {
+  if (begin == end) return;
+
+  for (T *it = begin + 1; it != end; ++it) {
+    if (!less(*it, *(it - 1))) continue;
+
+    T t = *it;
+    T *hole = it;
+    do {
+      *hole = *(hole - 1);
+      --hole;
+    } while (hole != begin && less(t, *(hole - 1)));
+    *hole = t;
+  }
+}
+
+template <typename T, typename Less>
+void sift_down(T *first, s64 index, s64 count, Less &less) {
+  T t = first[index];
+  while (true) {
+    s64 child = 2 * index + 1;
+    if (child >= count) break;
+    if (child + 1 < count && less(first[child], first[child + 1])) ++child;
+    if (!less(t, first[child])) break;
+    first[index] = first[child];
+    index = child;
+  }
+  first[index] = t;
+}
+
+template <typename T, typename Less>
+void heap_sort(T *begin, T *end, Less &less) {
+  s64 count = end - begin;
+  for (s64 i = count / 2 - 1; i >= 0; --i) sift_down(begin, i, count, less);
+  for (s64 i = count - 1; i > 0; --i) {
+    sort_swap(begin, begin + i);
+    sift_down(begin, 0, i, less);
+  }
+}
+
+// Partitions [begin, end) around the pivot at *begin. Elements equal to the
+// pivot go to the right. Returns the pivot's final position and whether the
+// range was already partitioned (no swaps were needed).
+template <typename T, typename Less>
+T *partition_right(T *begin, T *end, Less &less, bool *alreadyPartitioned) {
+  T pivot = *begin;
+  T *first = begin;
+  T *last = end;
+
+  // The median of 3 guarantees there is an element >= pivot on the right
+  // and an element <= pivot on the left, so these loops are unguarded.
+  while (less(*++first, pivot))
+    ;
+
+  if (first - 1 == begin) {
+    while (first < last && !less(*--last, pivot))
+      ;
+  } else {
+    while (!less(*--last, pivot))
+      ;
+  }
+
+  *alreadyPartitioned = first >= last;
+
+  while (first < last) {
+    sort_swap(first, last);
+    while (less(*++first, pivot))
+      ;
+    while (!less(*--last, pivot))
+      ;
+  }
+
+  T *pivotPos = first - 1;
+  *begin = *pivotPos;
+  *pivotPos = pivot;
+  return pivotPos;
+}
+
+// Like partition_right but puts elements equal to the pivot on the left.
+// Used when the pivot is equal to the element before the range (i.e. there
+// are many equal elements), then everything on the left is equal to the pivot
+// and doesn't need sorting.
+template <typename T, typename Less>
+T *partition_left(T *begin, T *end, Less &less) {
+  T pivot = *begin;
+  T *first = begin;
+  T *last = end;
+
+  while (less(pivot, *--last))
+    ;
+
+  if (last + 1 == end) {
+    while (first < last && !less(pivot, *++first))
+      ;
+  } else {
+    while (!less(pivot, *++first))
+      ;
+  }
+
+  while (first < last) {
+    sort_swap(first, last);
+    while (less(pivot, *--last))
+      ;
+    while (!less(pivot, *++first))
+      ;
+  }
+
+  T *pivotPos = last;
+  *begin = *pivotPos;
+  *pivotPos = pivot;
+  return pivotPos;
+}
+
+// Like insertion_sort, but gives up (returns false) after moving too many
+// elements. Used to finish off ranges which look already sorted.
+template <typename T, typename Less>
+bool partial_insertion_sort(T *begin, T *end, Less &less) {
+  if (begin == end) return true;
+
+  s64 limit = 8;
+  for (T *it = begin + 1; it != end; ++it) {
+    if (!less(*it, *(it - 1))) continue;
+
+    T t = *it;
+    T *hole = it;
+    do {
+      *hole = *(hole - 1);
+      --hole;
+    } while (hole != begin && less(t, *(hole - 1)));
+    *hole = t;
+
+    limit -= it - hole;
+    if (limit < 0) return false;
+  }
+  return true;
+}
+
+template <typename T, typename Less>
+void sort_loop(T *begin, T *end, Less &less, s32 badAllowed, bool leftmost) {
+  while (true) {
+    s64 size = end - begin;
+    if (size < SORT_INSERTION_THRESHOLD) {
+      insertion_sort(begin, end, less);
+      return;
+    }
+
+    // Put the pivot at *begin
+    s64 half = size / 2;
+    if (size > SORT_NINTHER_THRESHOLD) {
+      sort3(begin, begin + half, end - 1, less);
+      sort3(begin + 1, begin + (half - 1), end - 2, less);
+      sort3(begin + 2, begin + (half + 1), end - 3, less);
+      sort3(begin + (half - 1), begin + half, begin + (half + 1), less);
+      sort_swap(begin, begin + half);
+    } else {
+      sort3(begin + half, begin, end - 1, less);
+    }
+
+    // If the element before the range is not less than the pivot, it's equal
+    // to it (it was a pivot before), so we skip all elements equal to it.
+    if (!leftmost && !less(*(begin - 1), *begin)) {
+      begin = partition_left(begin, end, less) + 1;
+      continue;
+    }
+
+    bool alreadyPartitioned;
+    T *pivotPos = partition_right(begin, end, less, &alreadyPartitioned);
+
+    s64 leftSize = pivotPos - begin;
+    s64 rightSize = end - (pivotPos + 1);
+
+    // A very unbalanced partition, shuffle some elements around to break
+    // patterns, and if this happens too many times switch to heap sort.
+    if (leftSize < size / 8 || rightSize < size / 8) {
+      if (--badAllowed == 0) {
+        heap_sort(begin, end, less);
+        return;
+      }
+
+      if (leftSize >= SORT_INSERTION_THRESHOLD) {
+        sort_swap(begin, begin + leftSize / 4);
+        sort_swap(pivotPos - 1, pivotPos - leftSize / 4);
+        if (leftSize > SORT_NINTHER_THRESHOLD) {
+          sort_swap(begin + 1, begin + (leftSize / 4 + 1));
+          sort_swap(begin + 2, begin + (leftSize / 4 + 2));
+          sort_swap(pivotPos - 2, pivotPos - (leftSize / 4 + 1));
+          sort_swap(pivotPos - 3, pivotPos - (leftSize / 4 + 2));
+        }
+      }
+
+      if (rightSize >= SORT_INSERTION_THRESHOLD) {
+        sort_swap(pivotPos + 1, pivotPos + (1 + rightSize / 4));
+        sort_swap(end - 1, end - rightSize / 4);
+        if (rightSize > SORT_NINTHER_THRESHOLD) {
+          sort_swap(pivotPos + 2, pivotPos + (2 + rightSize / 4));
+          sort_swap(pivotPos + 3, pivotPos + (3 + rightSize / 4));
+          sort_swap(end - 2, end - (1 + rightSize / 4));
+          sort_swap(end - 3, end - (2 + rightSize / 4));
+        }
+      }
+    } else if (alreadyPartitioned &&
+               partial_insertion_sort(begin, pivotPos, less) &&
+               partial_insertion_sort(pivotPos + 1, end, less)) {
+      // The input was (almost) sorted, we're done
+      return;
+    }
+
+    // Recurse into the smaller side, loop on the bigger one,
+    // so the stack depth is O(log n).
+    if (leftSize < rightSize) {
+      sort_loop(begin, pivotPos, less, badAllowed, leftmost);
+      begin = pivotPos + 1;
+      leftmost = false;
+    } else {
+      sort_loop(pivotPos + 1, end, less, badAllowed, false);
+      end = pivotPos;
+    }
+  }
+}
+}  // namespace internal
+
+template <typename T, typename Less>
+void sort(T *first, s64 count, Less less) {
+  if (count < 2) return;
+
+  // log2(count)
+  s32 badAllowed = 0;
+  for (s64 n = count; n; n >>= 1) ++badAllowed;
+
+  internal::sort_loop(first, first + count, less, badAllowed, true);
 }
 
 template <typename T>
-void quick_sort(T *first, T *last,
-                quick_sort_comparison_func<T> compare = default_comparison<T>) {
+void sort(T *first, s64 count) {
+  sort(first, count, [](T no_copy a, T no_copy b) { return a < b; });
+}
+
+// These take a comparison function which returns -1, 0 or 1 (like the
+// type-erased version) and use the typed sort.
+template <typename T, typename Compare>
+void quick_sort(T *first, s64 count, Compare compare) {
+  sort(first, count,
+       [&](T no_copy a, T no_copy b) { return compare(&a, &b) < 0; });
+}
+
+template <typename T>
+void quick_sort(T *first, s64 count) {
+  sort(first, count);
+}
+
+template <typename T, typename Compare>
+void quick_sort(T *first, T *last, Compare compare) {
   quick_sort(first, last - first + 1, compare);
 }
 
+template <typename T>
+void quick_sort(T *first, T *last) {
+  sort(first, last - first + 1);
+}
+
 // Swaps the elements of two arrays.
 //
 // The length of the swap is determined by the value of "SIZE".  While both
@@ -0,0 +1,159 @@
+#pragma once
+
+#include "memory.h"
+#include "qsort.h"
+#include "type_info.h"
+
+LSTD_BEGIN_NAMESPACE
+
+//
+// LSD radix sort.
+//
+// Sorts integers and floats (or structs by an integer/float key) in linear
+// time. Faster than sort() (qsort.h) for big arrays of numeric keys, e.g.
+// hashes, chunk coordinates, depth keys for draw ordering.
+// The sort is stable.
+//
+//      radix_sort(depths.Data, depths.Count);
+//      radix_sort(draws.Data, draws.Count, [](draw no_copy d) { return d.Depth; });
+//
+// Keys are turned into unsigned integers which sort in the same order
+// (see radix_key()), then sorted one digit at a time, starting from the least
+// significant digit. Digits of 8, 11 or 16 bits are supported, more bits
+// means fewer passes over the data but bigger histograms. Passes in which all
+// keys have the same digit are skipped (e.g. small values in a 64 bit key).
+//
+// Needs a scratch buffer the size of the array. Pass one in _Scratch_ to reuse
+// it between calls, otherwise it's allocated with _Alloc_ (or the Context's
+// allocator) and freed before returning.
+//
+struct radix_sort_options {
+  // 8, 11 or 16. 0 means pick based on the number of elements.
+  s32 DigitBits = 0;
+
+  // At least count * sizeof(T) bytes, optional
+  void *Scratch = null;
+
+  allocator Alloc = {};
+};
+
+// Arrays smaller than this are insertion sorted (which is also stable)
+const s64 RADIX_SORT_THRESHOLD = 256;
+
+// Maps a key to an unsigned integer with the same ordering
+template <is_unsigned_integral T>
+always_inline auto radix_key(T x) {
+  if constexpr (sizeof(T) <= 4) {
+    return (u32)x;
+  } else {
+    return (u64)x;
+  }
+}
+
+template <is_signed_integral T>
+always_inline auto radix_key(T x) {
+  // Flip the sign bit so negative numbers go first
+  if constexpr (sizeof(T) <= 4) {
+    return (u32)(s32)x ^ 0x80000000u;
+  } else {
+    return (u64)x ^ 0x8000000000000000ull;
+  }
+}
+
+always_inline u32 radix_key(f32 x) {
+  // Negative floats have their order reversed, so flip all bits,
+  // positive floats just need the sign bit set.
+  u32 w = ieee754_f32{x}.W;
+  return w & 0x80000000u ? ~w : w | 0x80000000u;
+}
+
+always_inline u64 radix_key(f64 x) {
+  u64 w = ieee754_f64{x}.DW;
+  return w & 0x8000000000000000ull ? ~w : w | 0x8000000000000000ull;
+}
+
+namespace internal {
+template <typename T, typename Key>
+void radix_sort_impl(T *data, s64 count, Key key, radix_sort_options options) {
+  using radix_t = decltype(radix_key(key(*data)));
+
+  if (count < RADIX_SORT_THRESHOLD) {
+    auto less = [&](T no_copy a, T no_copy b) {
+      return radix_key(key(a)) < radix_key(key(b));
+    };
+    insertion_sort(data, data + count, less);
+    return;
+  }
+
+  s32 digitBits = options.DigitBits;
+  if (!digitBits) digitBits = count < 64 * 1024 ? 8 : 11;
+  assert((digitBits == 8 || digitBits == 11 || digitBits == 16) &&
+         "Unsupported digit size");
+
+  s64 buckets = 1ll << digitBits;
+  radix_t mask = (radix_t)(buckets - 1);
+  s32 passes = (s32)((sizeof(radix_t) * 8 + digitBits - 1) / digitBits);
+
+  T *scratch = (T *)options.Scratch;
+  if (!scratch) scratch = malloc<T>({.Count = count, .Alloc = options.Alloc});
+
+  // Histograms for all passes are built in a single pass over the data
+  s64 *histograms =
+      malloc<s64>({.Count = buckets * passes, .Alloc = options.Alloc});
+  memset(histograms, 0, buckets * passes * sizeof(s64));
+
+  For(range(count)) {
+    radix_t k = radix_key(key(data[it]));
+    For_as(p, range(passes)) {
+      ++histograms[p * buckets + ((k >> (p * digitBits)) & mask)];
+    }
+  }
+
+  T *src = data, *dest = scratch;
+  For_as(p, range(passes)) {
+    s64 *histogram = histograms + p * buckets;
+
+    // Skip passes in which every key has the same digit
+    radix_t digit = (radix_key(key(src[0])) >> (p * digitBits)) & mask;
+    if (histogram[digit] == count) continue;
+
+    // Counts to starting offsets
+    s64 sum = 0;
+    For(range(buckets)) {
+      s64 c = histogram[it];
+      histogram[it] = sum;
+      sum += c;
+    }
+
+    For(range(count)) {
+      radix_t k = radix_key(key(src[it]));
+      dest[histogram[(k >> (p * digitBits)) & mask]++] = src[it];
+    }
+
+    T *t = src;
+    src = dest;
+    dest = t;
+  }
+
+  if (src != data) memcpy(data, src, count * sizeof(T));
+
+  free(histograms);
+  if (!options.Scratch) free(scratch);
+}
+}  // namespace internal
+
+// Sorts integers or floats
+template <typename T>
+  requires(is_integral<T> || is_floating_point<T>)
+void radix_sort(T *data, s64 count, radix_sort_options options = {}) {
+  internal::radix_sort_impl(
+      data, count, [](T x) { return x; }, options);
+}
+
+// _key_ takes an element and returns an integer or a float to sort by
+template <typename T, typename Key>
+void radix_sort(T *data, s64 count, Key key, radix_sort_options options = {}) {
+  internal::radix_sort_impl(data, count, key, options);
+}
+
+LSTD_END_NAMESPACE
@@ -0,0 +1,234 @@
+#pragma once
+
+#include "os.h"
+
+LSTD_BEGIN_NAMESPACE
+
+//
+// The input counterpart of _writer_. Parsers read from a reader incrementally
+// instead of needing the whole input in one string, so large inputs (logs,
+// data files) can be processed in constant memory as they stream in.
+//
+// A reader keeps a window of bytes which are available but not consumed yet
+// (_Data_ and _Count_). Subclasses override _refill_ which brings more bytes
+// in the window. Looking at the window doesn't copy anything:
+//
+//      file_reader r;
+//      if (!open_file_reader(r, "data.csv")) return;
+//      defer(free(r));
+//
+//      while (true) {
+//          auto [line, complete] = read_until(&r, '\n');
+//          if (!line.Count && at_end(&r)) break;
+//          ...
+//      }
+//
+//      // Numbers (or anything returning a parse_result) can be parsed
+//      // straight from the window:
+//      auto [value, status, rest] = parse(&r, parse_float<f64>);
+//
+// Views returned by _peek_, _buffered_, _read_until_ point in the window and
+// are valid until the next call which refills it. Copy them if you need them
+// for longer.
+//
+// Backends:
+//   memory_reader      - reads from a string which is already in memory
+//   file_reader        - reads a file in chunks through a fixed buffer
+//   mapped_file_reader - maps the whole file in memory, the window is the
+//                        entire file and refilling is free
+//
+struct reader {
+  const char *Data = null;  // The first unconsumed byte
+  s64 Count = 0;            // How many bytes are available after _Data_
+
+  // Set when there is nothing left to read from the source (the window may
+  // still have bytes)
+  bool Exhausted = false;
+
+  // Tries to make at least _n_ bytes available in the window (may move the
+  // window). Returns false if the input ended or the window can't hold _n_
+  // bytes, in which case it contains as many bytes as possible.
+  virtual bool refill(s64 n) = 0;
+};
+
+// Returns the bytes which are available right now without reading more
+inline string buffered(reader *r) { return string(r->Data, r->Count); }
+
+// Returns a view of the next _n_ bytes (fewer at the end of the input)
+// without consuming them.
+inline string peek(reader *r, s64 n) {
+  if (r->Count < n) r->refill(n);
+  return string(r->Data, r->Count < n ? r->Count : n);
+}
+
+// Skips _n_ bytes which must be available (see _peek_)
+inline void consume(reader *r, s64 n) {
+  assert(n >= 0 && n <= r->Count);
+  r->Data += n;
+  r->Count -= n;
+}
+
+// True if everything has been consumed and there is nothing left to read
+inline bool at_end(reader *r) { return !r->Count && !r->refill(1); }
+
+// Copies (and consumes) at most _size_ bytes, returns how many were copied
+inline s64 read(reader *r, char *out, s64 size) {
+  s64 copied = 0;
+  while (copied < size) {
+    if (!r->Count && !r->refill(1)) break;
+
+    s64 n = min(size - copied, r->Count);
+    memcpy(out + copied, r->Data, n);
+    consume(r, n);
+    copied += n;
+  }
+  return copied;
+}
+
+struct read_until_result {
+  string Text;
+
+  // False if the window filled up before we found the delimiter. _Text_ has
+  // as many bytes as fit, call again to get the rest.
+  bool Complete;
+};
+
+// Returns a view of the bytes up to (not including) _delimiter_ and consumes
+// them and the delimiter. At the end of the input returns what's left.
+inline read_until_result read_until(reader *r, char delimiter) {
+  s64 searched = 0;
+  while (true) {
+    For(range(searched, r->Count)) {
+      if (r->Data[it] == delimiter) {
+        string text(r->Data, it);
+        consume(r, it + 1);
+        return {text, true};
+      }
+    }
+    searched = r->Count;
+
+    if (!r->refill(r->Count + 1)) {
+      // Either the input ended or the delimiter is further than the window
+      // can hold
+      string text = buffered(r);
+      consume(r, text.Count);
+      return {text, r->Exhausted};
+    }
+  }
+}
+
+// Runs a parse function (parse_int, parse_float, parse_bool, ...) on the
+// window and consumes what it ate. Makes sure at least _lookahead_ bytes are
+// available first so a number isn't cut at the end of the window.
+template <typename F>
+auto parse(reader *r, F parser, s64 lookahead = 64) {
+  if (r->Count < lookahead) r->refill(lookahead);
+
+  auto result = parser(buffered(r));
+  consume(r, result.Rest.Data - r->Data);
+  return result;
+}
+
+//
+// Reads from a string which is already in memory. Doesn't copy it.
+//
+struct memory_reader : reader {
+  memory_reader(string s) {
+    Data = s.Data;
+    Count = s.Count;
+    Exhausted = true;
+  }
+
+  bool refill(s64 n) override { return Count >= n; }
+};
+
+//
+// Reads a file in chunks through a buffer of fixed size. When refilling, the
+// unconsumed bytes are moved to the start of the buffer and the rest of it is
+// filled from the file, so it does as few reads as possible.
+//
+const s64 FILE_READER_BUFFER_SIZE = 64_KiB;
+
+struct file_reader : reader {
+  void *File = null;
+
+  char *Buffer = null;
+  s64 BufferSize = 0;
+
+  bool refill(s64 n) override {
+    if (Count >= n) return true;
+    if (!Buffer) return false;
+
+    if (Data != Buffer) {
+      memmove(Buffer, Data, Count);
+      Data = Buffer;
+    }
+
+    while (Count < n && Count < BufferSize && !Exhausted) {
+      s64 bytesRead = os_read_file(File, Buffer + Count, BufferSize - Count);
+      if (bytesRead <= 0) {
+        Exhausted = true;
+        break;
+      }
+      Count += bytesRead;
+    }
+    return Count >= n;
+  }
+};
+
+// Returns false (and reports an error) if the file couldn't be opened
+inline bool open_file_reader(file_reader ref r, string path,
+                             s64 bufferSize = FILE_READER_BUFFER_SIZE) {
+  auto [file, success] = os_open_file_for_reading(path);
+  if (!success) return false;
+
+  r.File = file;
+  r.Buffer = malloc<char>({.Count = bufferSize});
+  r.BufferSize = bufferSize;
+  r.Data = r.Buffer;
+  r.Count = 0;
+  r.Exhausted = false;
+  return true;
+}
+
+inline void free(file_reader ref r) {
+  if (r.File) os_close_file(r.File);
+  if (r.Buffer) free(r.Buffer);
+
+  r.File = null;
+  r.Buffer = null;
+  r.BufferSize = 0;
+  r.Data = null;
+  r.Count = 0;
+}
+
+//
+// Maps the whole file in memory. Nothing is read until it's accessed and
+// nothing is ever copied.
+//
+struct mapped_file_reader : reader {
+  os_mapped_file File;
+
+  bool refill(s64 n) override { return Count >= n; }
+};
+
+// Returns false (and reports an error) if the file couldn't be mapped
+inline bool open_mapped_file_reader(mapped_file_reader ref r, string path) {
+  auto [file, success] = os_map_file(path);
+  if (!success) return false;
+
+  r.File = file;
+  r.Data = file.Contents.Data;
+  r.Count = file.Contents.Count;
+  r.Exhausted = true;
+  return true;
+}
+
+inline void free(mapped_file_reader ref r) {
+  os_unmap_file(r.File);
+  r.File = {};
+  r.Data = null;
+  r.Count = 0;
+}
+
+LSTD_END_NAMESPACE
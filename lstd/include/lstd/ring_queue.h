@@ -0,0 +1,322 @@
+#pragma once
+
+#include "os.h"
+
+LSTD_BEGIN_NAMESPACE
+
+//
+// Bounded lock-free queues for passing data between threads.
+//
+//   spsc_queue<T, Capacity> - exactly one producer thread and one consumer
+//                             thread (e.g. window thread -> main thread events)
+//   mpmc_queue<T, Capacity> - any number of producers and consumers
+//                             (e.g. log messages, results from workers)
+//
+// Both are ring buffers with a power of 2 capacity which never allocate.
+// Elements are copied in and out. The indices which are written by different
+// threads live on separate cache lines so producers and consumers don't
+// fight over them.
+//
+//      mpmc_queue<event, 1024> events;
+//
+//      // Producer                        // Consumer
+//      if (!try_push(events, e)) { ... }  event e;
+//      push(events, e);  // Blocks        while (try_pop(events, &e)) { ... }
+//                        // when full     e = pop(events);  // Blocks when empty
+//
+// The batch versions push or pop as many elements as possible in one go (one
+// atomic operation for the whole batch instead of one per element) and
+// return how many that was.
+//
+// Blocking operations spin for a bit and then sleep on a _parker_ (see
+// os/thread.h), the other side wakes them. When nobody is sleeping waking is
+// just an atomic load, so the non-blocking path never makes a syscall.
+//
+// The queue objects contain the elements, with a big capacity they should be
+// globals or allocated (not on the stack).
+//
+
+// How many times blocking operations retry before going to sleep
+const s64 RING_QUEUE_SPIN_COUNT = 64;
+
+//
+// Single producer, single consumer.
+// Each side only writes its own index and keeps a cached copy of the other
+// side's index, so it touches the other side's cache line only when the
+// queue looks full (or empty).
+//
+template <typename T, s64 Capacity>
+struct spsc_queue {
+  static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0,
+                "Capacity must be a power of 2");
+
+  using value_t = T;
+
+  static const s64 CAPACITY = Capacity;
+  static const s64 MASK = Capacity - 1;
+
+  // Written by the consumer
+  alignas(64) s64 Head = 0;
+  s64 CachedTail = 0;
+
+  // Written by the producer
+  alignas(64) s64 Tail = 0;
+  s64 CachedHead = 0;
+
+  alignas(64) parker NotEmpty;
+  alignas(64) parker NotFull;
+
+  alignas(64) T Slots[Capacity];
+};
+
+// Pushes as many of the values as fit, returns how many were pushed.
+// Only the producer thread may call this.
+template <typename T, s64 C>
+s64 push_batch(spsc_queue<T, C> ref q, const T *values, s64 count) {
+  if (count <= 0) return 0;
+
+  s64 tail = q.Tail;
+  s64 space = C - (tail - q.CachedHead);
+  if (space < count) {
+    q.CachedHead = atomic_load(&q.Head);
+    space = C - (tail - q.CachedHead);
+  }
+
+  s64 n = count < space ? count : space;
+  if (!n) return 0;
+
+  For(range(n)) q.Slots[(tail + it) & spsc_queue<T, C>::MASK] = values[it];
+  atomic_store(&q.Tail, tail + n);
+
+  unpark_all(&q.NotEmpty);
+  return n;
+}
+
+// Pops up to _maxCount_ values in _out_, returns how many were popped.
+// Only the consumer thread may call this.
+template <typename T, s64 C>
+s64 pop_batch(spsc_queue<T, C> ref q, T *out, s64 maxCount) {
+  if (maxCount <= 0) return 0;
+
+  s64 head = q.Head;
+  s64 available = q.CachedTail - head;
+  if (available < maxCount) {
+    q.CachedTail = atomic_load(&q.Tail);
+    available = q.CachedTail - head;
+  }
+
+  s64 n = maxCount < available ? maxCount : available;
+  if (!n) return 0;
+
+  For(range(n)) out[it] = q.Slots[(head + it) & spsc_queue<T, C>::MASK];
+  atomic_store(&q.Head, head + n);
+
+  unpark_all(&q.NotFull);
+  return n;
+}
+
+// Approximate when other threads are pushing or popping
+template <typename T, s64 C>
+s64 approx_count(spsc_queue<T, C> ref q) {
+  return atomic_load(&q.Tail) - atomic_load(&q.Head);
+}
+
+//
+// Multiple producers, multiple consumers.
+// Each slot has a sequence number which says whether it's ready to be
+// written or read in the current lap around the ring (D. Vyukov's bounded
+// queue), so producers and consumers only contend on their own index.
+//
+template <typename T, s64 Capacity>
+struct mpmc_queue {
+  static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0,
+                "Capacity must be a power of 2");
+
+  using value_t = T;
+
+  static const s64 CAPACITY = Capacity;
+  static const s64 MASK = Capacity - 1;
+
+  struct cell {
+    s64 Sequence;
+    T Value;
+  };
+
+  alignas(64) s64 Head = 0;  // Next position to pop
+  alignas(64) s64 Tail = 0;  // Next position to push
+
+  alignas(64) parker NotEmpty;
+  alignas(64) parker NotFull;
+
+  alignas(64) cell Cells[Capacity];
+
+  mpmc_queue() { For(range(Capacity)) Cells[it].Sequence = it; }
+};
+
+// Pushes as many of the values as fit, returns how many were pushed.
+// The values pushed by one call are consecutive in the queue.
+template <typename T, s64 C>
+s64 push_batch(mpmc_queue<T, C> ref q, const T *values, s64 count) {
+  if (count <= 0) return 0;
+
+  using queue = mpmc_queue<T, C>;
+
+  s64 pos = atomic_load(&q.Tail);
+  while (true) {
+    // Count the free cells starting at _pos_. A cell is free in this lap
+    // when its sequence is equal to its position.
+    s64 n = 0;
+    while (n < count && n < C) {
+      auto *cell = q.Cells + ((pos + n) & queue::MASK);
+      if (atomic_load(&cell->Sequence) != pos + n) break;
+      ++n;
+    }
+
+    if (!n) {
+      // Either full, or another producer took _pos_
+      s64 tail = atomic_load(&q.Tail);
+      if (tail == pos) return 0;
+      pos = tail;
+      continue;
+    }
+
+    // Claim the cells. Nobody else can write them after this succeeds and
+    // consumers won't read them until their sequence is bumped.
+    s64 old = atomic_compare_and_swap(&q.Tail, pos, pos + n);
+    if (old != pos) {
+      pos = old;
+      continue;
+    }
+
+    For(range(n)) {
+      auto *cell = q.Cells + ((pos + it) & queue::MASK);
+      cell->Value = values[it];
+      atomic_store(&cell->Sequence, pos + it + 1);
+    }
+
+    unpark_all(&q.NotEmpty);
+    return n;
+  }
+}
+
+// Pops up to _maxCount_ values in _out_, returns how many were popped.
+template <typename T, s64 C>
+s64 pop_batch(mpmc_queue<T, C> ref q, T *out, s64 maxCount) {
+  if (maxCount <= 0) return 0;
+
+  using queue = mpmc_queue<T, C>;
+
+  s64 pos = atomic_load(&q.Head);
+  while (true) {
+    // A cell is ready to be read when its sequence is its position + 1
+    s64 n = 0;
+    while (n < maxCount && n < C) {
+      auto *cell = q.Cells + ((pos + n) & queue::MASK);
+      if (atomic_load(&cell->Sequence) != pos + n + 1) break;
+      ++n;
+    }
+
+    if (!n) {
+      // Either empty, or another consumer took _pos_
+      s64 head = atomic_load(&q.Head);
+      if (head == pos) return 0;
+      pos = head;
+      continue;
+    }
+
+    s64 old = atomic_compare_and_swap(&q.Head, pos, pos + n);
+    if (old != pos) {
+      pos = old;
+      continue;
+    }
+
+    For(range(n)) {
+      auto *cell = q.Cells + ((pos + it) & queue::MASK);
+      out[it] = cell->Value;
+
+      // Free for the next lap
+      atomic_store(&cell->Sequence, pos + it + C);
+    }
+
+    unpark_all(&q.NotFull);
+    return n;
+  }
+}
+
+// Approximate when other threads are pushing or popping
+template <typename T, s64 C>
+s64 approx_count(mpmc_queue<T, C> ref q) {
+  s64 count = atomic_load(&q.Tail) - atomic_load(&q.Head);
+  return count < 0 ? 0 : (count > C ? C : count);
+}
+
+//
+// Operations which work on both queues
+//
+namespace internal {
+template <typename Q>
+concept ring_queue = requires(Q q) {
+  q.NotEmpty;
+  q.NotFull;
+  q.CAPACITY;
+  typename Q::value_t;
+};
+
+// Retries _op_ until it succeeds, sleeps on _p_ after spinning for a while
+template <typename Op>
+void ring_queue_wait(parker *p, Op ref op) {
+  For(range(RING_QUEUE_SPIN_COUNT)) {
+    if (op()) return;
+  }
+
+  while (true) {
+    s32 ticket = prepare_park(p);
+    if (op()) {
+      cancel_park(p);
+      return;
+    }
+    park(p, ticket);
+    if (op()) return;
+  }
+}
+}  // namespace internal
+
+// Returns false if the queue is full
+template <internal::ring_queue Q, typename T>
+bool try_push(Q ref q, T no_copy value) {
+  return push_batch(q, &value, 1) == 1;
+}
+
+// Returns false if the queue is empty
+template <internal::ring_queue Q, typename T>
+bool try_pop(Q ref q, T *out) {
+  return pop_batch(q, out, 1) == 1;
+}
+
+// Blocks while the queue is full
+template <internal::ring_queue Q, typename T>
+void push(Q ref q, T no_copy value) {
+  auto op = [&]() { return try_push(q, value); };
+  internal::ring_queue_wait(&q.NotFull, op);
+}
+
+// Blocks while the queue is empty
+template <internal::ring_queue Q>
+auto pop(Q ref q) {
+  typename Q::value_t result;
+  auto op = [&]() { return try_pop(q, &result); };
+  internal::ring_queue_wait(&q.NotEmpty, op);
+  return result;
+}
+
+// Blocks while the queue is empty, then pops up to _maxCount_ values.
+// Useful for consumer threads which process everything that has queued up.
+template <internal::ring_queue Q>
+s64 pop_batch_wait(Q ref q, typename Q::value_t *out, s64 maxCount) {
+  s64 n = 0;
+  auto op = [&]() { return (n = pop_batch(q, out, maxCount)) != 0; };
+  internal::ring_queue_wait(&q.NotEmpty, op);
+  return n;
+}
+
+LSTD_END_NAMESPACE
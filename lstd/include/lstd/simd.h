@@ -0,0 +1,492 @@
+#pragma once
+
+#include "bits.h"
+#include "common.h"
+
+//
+// Byte kernels which back the hot routines in "string.h" (c_string_length,
+// utf8_length, compare_string, search, ...) and the mem* replacements we
+// provide when building without the CRT (see memory.cpp).
+//
+// * bytes_find_zero          - strlen
+// * bytes_find               - memchr
+// * bytes_mismatch           - memcmp (returns the index of the difference)
+// * bytes_c_string_prefix    - length of the common prefix of two
+//                              null-terminated strings
+// * bytes_search             - memmem (first/last byte filter)
+// * bytes_count_utf8_cps     - number of utf-8 code points in a buffer
+// * bytes_skip_utf8_cps      - pointer to the n-th code point in a buffer
+// * bytes_move               - memmove
+//
+// On x86-64 we always have SSE2, so the 16 byte kernels are the baseline.
+// AVX2 versions are picked at runtime (see cpu_has) for larger inputs.
+// On other architectures we fall back to plain loops, which the compiler is
+// free to auto-vectorize.
+//
+// Define LSTD_NO_SIMD to force the plain loops everywhere (useful when
+// chasing a bug which you suspect is in here).
+//
+// Note: Some kernels read whole aligned 16/32 byte blocks around the
+// requested range (e.g. when looking for a null terminator). An aligned block
+// never crosses a page boundary so this is safe, but tools like ASAN may
+// complain about it.
+//
+
+#if ARCH == X86 && BITS == 64 && !defined LSTD_NO_SIMD
+#define LSTD_SIMD_X86 1
+#else
+#define LSTD_SIMD_X86 0
+#endif
+
+#if LSTD_SIMD_X86
+#include <immintrin.h>
+#if COMPILER == MSVC
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+#if COMPILER == MSVC
+#define LSTD_TARGET_AVX2
+#else
+#define LSTD_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+LSTD_BEGIN_NAMESPACE
+
+enum cpu_feature : u32 {
+  CPU_SSE4_2 = BIT(0),
+  CPU_POPCNT = BIT(1),
+  CPU_AVX2 = BIT(2),
+  CPU_BMI2 = BIT(3),
+
+  // Set after the first query so we don't run cpuid again.
+  CPU_FEATURES_DETECTED = 0x80000000,
+};
+
+// Zero-initialized before any global constructor runs, so it's safe to query
+// features from static initialization code. Multiple threads racing on the
+// first query is harmless since they all write the same value.
+inline u32 CpuFeatures;
+
+namespace internal {
+inline u32 detect_cpu_features() {
+  u32 result = CPU_FEATURES_DETECTED;
+#if LSTD_SIMD_X86
+  u32 regs[4] = {};  // eax, ebx, ecx, edx
+
+#if COMPILER == MSVC
+  __cpuid((int *)regs, 0);
+#else
+  __cpuid(0, regs[0], regs[1], regs[2], regs[3]);
+#endif
+  u32 maxLeaf = regs[0];
+
+#if COMPILER == MSVC
+  __cpuid((int *)regs, 1);
+#else
+  __cpuid(1, regs[0], regs[1], regs[2], regs[3]);
+#endif
+  if (regs[2] & BIT(20)) result |= CPU_SSE4_2;
+  if (regs[2] & BIT(23)) result |= CPU_POPCNT;
+
+  // AVX2 also requires the OS to save the YMM registers on context switches,
+  // we check that with XGETBV (bits 1 and 2 of XCR0).
+  bool osSavesYmm = false;
+  if (regs[2] & BIT(27)) {
+#if COMPILER == MSVC
+    u64 xcr0 = _xgetbv(0);
+#else
+    u32 lo, hi;
+    __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    u64 xcr0 = ((u64)hi << 32) | lo;
+#endif
+    osSavesYmm = (xcr0 & 6) == 6;
+  }
+
+  if (maxLeaf >= 7) {
+#if COMPILER == MSVC
+    __cpuidex((int *)regs, 7, 0);
+#else
+    __cpuid_count(7, 0, regs[0], regs[1], regs[2], regs[3]);
+#endif
+    if ((regs[1] & BIT(5)) && osSavesYmm) result |= CPU_AVX2;
+    if (regs[1] & BIT(8)) result |= CPU_BMI2;
+  }
+#endif
+  return result;
+}
+}  // namespace internal
+
+// Returns true if the CPU we are running on supports _feature_.
+inline bool cpu_has(cpu_feature feature) {
+  if (!CpuFeatures) CpuFeatures = internal::detect_cpu_features();
+  return CpuFeatures & feature;
+}
+
+// Below this many bytes the AVX2 kernels don't pay for the dispatch.
+inline const s64 SIMD_AVX2_THRESHOLD = 64;
+
+#if LSTD_SIMD_X86
+namespace internal {
+always_inline u32 sse2_eq_mask(__m128i a, __m128i b) {
+  return (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(a, b));
+}
+
+LSTD_TARGET_AVX2 inline u32 avx2_eq_mask(__m256i a, __m256i b) {
+  return (u32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b));
+}
+
+// A byte is a continuation byte if it matches 10xxxxxx,
+// that is, when treated as signed, it's less than -64.
+always_inline u32 sse2_utf8_continuation_mask(__m128i v) {
+  return (u32)_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_set1_epi8(-64), v));
+}
+
+LSTD_TARGET_AVX2 inline const char *avx2_find_zero(const char *p) {
+  // Align down so we never cross a page boundary, then ignore the bytes
+  // which come before _p_.
+  auto *aligned = (const char *)((u64)p & ~(u64)31);
+  u32 mask = avx2_eq_mask(_mm256_load_si256((const __m256i *)aligned),
+                          _mm256_setzero_si256());
+  mask &= ~0u << (p - aligned);
+  while (!mask) {
+    aligned += 32;
+    mask = avx2_eq_mask(_mm256_load_si256((const __m256i *)aligned),
+                        _mm256_setzero_si256());
+  }
+  return aligned + lsb(mask);
+}
+
+LSTD_TARGET_AVX2 inline const char *avx2_find(const char *p, const char *end,
+                                              char c) {
+  __m256i needle = _mm256_set1_epi8(c);
+  for (; end - p >= 32; p += 32) {
+    u32 mask = avx2_eq_mask(_mm256_loadu_si256((const __m256i *)p), needle);
+    if (mask) return p + lsb(mask);
+  }
+  __m128i needle16 = _mm_set1_epi8(c);
+  for (; end - p >= 16; p += 16) {
+    u32 mask = sse2_eq_mask(_mm_loadu_si128((const __m128i *)p), needle16);
+    if (mask) return p + lsb(mask);
+  }
+  for (; p != end; ++p)
+    if (*p == c) return p;
+  return null;
+}
+
+LSTD_TARGET_AVX2 inline s64 avx2_mismatch(const byte *a, const byte *b,
+                                          s64 size) {
+  s64 i = 0;
+  for (; size - i >= 32; i += 32) {
+    u32 mask = avx2_eq_mask(_mm256_loadu_si256((const __m256i *)(a + i)),
+                            _mm256_loadu_si256((const __m256i *)(b + i)));
+    if (mask != 0xFFFFFFFF) return i + lsb(~mask);
+  }
+  for (; size - i >= 16; i += 16) {
+    u32 mask = sse2_eq_mask(_mm_loadu_si128((const __m128i *)(a + i)),
+                            _mm_loadu_si128((const __m128i *)(b + i)));
+    if (mask != 0xFFFF) return i + lsb(~mask & 0xFFFF);
+  }
+  for (; i < size; ++i)
+    if (a[i] != b[i]) return i;
+  return -1;
+}
+
+LSTD_TARGET_AVX2 inline s64 avx2_count_utf8_continuations(const char *p,
+                                                          s64 size) {
+  s64 result = 0;
+  s64 i = 0;
+
+  // Each lane of _acc_ can count up to 255 continuation bytes before
+  // overflowing, so every 255 iterations we sum the lanes with SAD.
+  while (size - i >= 32) {
+    __m256i acc = _mm256_setzero_si256();
+    s64 iterations = (size - i) / 32;
+    if (iterations > 255) iterations = 255;
+    For(range(iterations)) {
+      __m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+      acc = _mm256_sub_epi8(acc, _mm256_cmpgt_epi8(_mm256_set1_epi8(-64), v));
+      i += 32;
+    }
+    __m256i sums = _mm256_sad_epu8(acc, _mm256_setzero_si256());
+    result += _mm256_extract_epi64(sums, 0) + _mm256_extract_epi64(sums, 1) +
+              _mm256_extract_epi64(sums, 2) + _mm256_extract_epi64(sums, 3);
+  }
+  for (; size - i >= 16; i += 16) {
+    result += pop_count(sse2_utf8_continuation_mask(
+        _mm_loadu_si128((const __m128i *)(p + i))));
+  }
+  for (; i < size; ++i) result += (p[i] & 0xc0) == 0x80;
+  return result;
+}
+
+// Advances _p_ past the blocks it checked, the caller finishes the tail.
+LSTD_TARGET_AVX2 inline const char *avx2_search(const char *&p, const char *end,
+                                                const char *needle, s64 n) {
+  __m256i first = _mm256_set1_epi8(needle[0]);
+  __m256i last = _mm256_set1_epi8(needle[n - 1]);
+
+  // We need n - 1 + 32 bytes available to load the "last" block.
+  for (; end - p >= n - 1 + 32; p += 32) {
+    __m256i blockFirst = _mm256_loadu_si256((const __m256i *)p);
+    __m256i blockLast = _mm256_loadu_si256((const __m256i *)(p + n - 1));
+    u32 mask = (u32)_mm256_movemask_epi8(
+        _mm256_and_si256(_mm256_cmpeq_epi8(blockFirst, first),
+                         _mm256_cmpeq_epi8(blockLast, last)));
+    while (mask) {
+      s32 bit = lsb(mask);
+      if (avx2_mismatch((const byte *)p + bit + 1, (const byte *)needle + 1,
+                        n - 2) == -1) {
+        return p + bit;
+      }
+      mask &= mask - 1;
+    }
+  }
+  return null;
+}
+
+LSTD_TARGET_AVX2 inline void avx2_move_forward(byte *dst, const byte *src,
+                                               s64 size) {
+  for (; size >= 32; size -= 32, dst += 32, src += 32) {
+    _mm256_storeu_si256((__m256i *)dst,
+                        _mm256_loadu_si256((const __m256i *)src));
+  }
+  while (size--) *dst++ = *src++;
+}
+
+LSTD_TARGET_AVX2 inline void avx2_move_backward(byte *dst, const byte *src,
+                                                s64 size) {
+  for (; size >= 32; size -= 32) {
+    _mm256_storeu_si256((__m256i *)(dst + size - 32),
+                        _mm256_loadu_si256((const __m256i *)(src + size - 32)));
+  }
+  while (size--) dst[size] = src[size];
+}
+}  // namespace internal
+#endif
+
+// Returns a pointer to the null terminator of _p_.
+inline const char *bytes_find_zero(const char *p) {
+#if LSTD_SIMD_X86
+  if (cpu_has(CPU_AVX2)) return internal::avx2_find_zero(p);
+
+  auto *aligned = (const char *)((u64)p & ~(u64)15);
+  u32 mask = internal::sse2_eq_mask(_mm_load_si128((const __m128i *)aligned),
+                                    _mm_setzero_si128());
+  mask &= ~0u << (p - aligned);
+  while (!mask) {
+    aligned += 16;
+    mask = internal::sse2_eq_mask(_mm_load_si128((const __m128i *)aligned),
+                                  _mm_setzero_si128());
+  }
+  return aligned + lsb(mask);
+#else
+  while (*p) ++p;
+  return p;
+#endif
+}
+
+// Returns a pointer to the first occurence of _c_ in [p, end) or null.
+inline const char *bytes_find(const char *p, const char *end, char c) {
+#if LSTD_SIMD_X86
+  if (end - p >= SIMD_AVX2_THRESHOLD && cpu_has(CPU_AVX2)) {
+    return internal::avx2_find(p, end, c);
+  }
+
+  __m128i needle = _mm_set1_epi8(c);
+  for (; end - p >= 16; p += 16) {
+    u32 mask =
+        internal::sse2_eq_mask(_mm_loadu_si128((const __m128i *)p), needle);
+    if (mask) return p + lsb(mask);
+  }
+#endif
+  for (; p < end; ++p)
+    if (*p == c) return p;
+  return null;
+}
+
+// Returns the index of the first byte which differs in _a_ and _b_,
+// or -1 if the two blocks are the same.
+inline s64 bytes_mismatch(const void *a, const void *b, s64 size) {
+  auto *p1 = (const byte *)a;
+  auto *p2 = (const byte *)b;
+
+  s64 i = 0;
+#if LSTD_SIMD_X86
+  if (size >= SIMD_AVX2_THRESHOLD && cpu_has(CPU_AVX2)) {
+    return internal::avx2_mismatch(p1, p2, size);
+  }
+
+  for (; size - i >= 16; i += 16) {
+    u32 mask =
+        internal::sse2_eq_mask(_mm_loadu_si128((const __m128i *)(p1 + i)),
+                               _mm_loadu_si128((const __m128i *)(p2 + i)));
+    if (mask != 0xFFFF) return i + lsb(~mask & 0xFFFF);
+  }
+#endif
+  for (; i < size; ++i)
+    if (p1[i] != p2[i]) return i;
+  return -1;
+}
+
+// Returns the amount of bytes at the beginning of two null-terminated strings
+// which are equal (not counting the terminator).
+inline s64 bytes_c_string_prefix(const char *a, const char *b) {
+  s64 i = 0;
+#if LSTD_SIMD_X86
+  while (true) {
+    // We can only load a whole block when it doesn't cross into the next
+    // page, since we don't know where the strings end.
+    bool canLoadA = ((u64)(a + i) & 4095) <= 4096 - 16;
+    bool canLoadB = ((u64)(b + i) & 4095) <= 4096 - 16;
+    if (!canLoadA || !canLoadB) {
+      if (a[i] != b[i] || !a[i]) return i;
+      ++i;
+      continue;
+    }
+
+    __m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+    __m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+
+    // Stop at the first difference or at the first terminator.
+    u32 differentOrZero =
+        (~internal::sse2_eq_mask(va, vb) & 0xFFFF) |
+        internal::sse2_eq_mask(va, _mm_setzero_si128());
+    if (differentOrZero) return i + lsb(differentOrZero);
+    i += 16;
+  }
+#else
+  while (a[i] == b[i] && a[i]) ++i;
+  return i;
+#endif
+}
+
+// Returns the number of code points in a utf-8 encoded buffer (the number of
+// bytes which don't match 10xxxxxx).
+inline s64 bytes_count_utf8_cps(const char *p, s64 size) {
+#if LSTD_SIMD_X86
+  if (size >= SIMD_AVX2_THRESHOLD && cpu_has(CPU_AVX2)) {
+    return size - internal::avx2_count_utf8_continuations(p, size);
+  }
+
+  s64 continuations = 0;
+  s64 i = 0;
+  for (; size - i >= 16; i += 16) {
+    continuations += pop_count(internal::sse2_utf8_continuation_mask(
+        _mm_loadu_si128((const __m128i *)(p + i))));
+  }
+  for (; i < size; ++i) continuations += (p[i] & 0xc0) == 0x80;
+  return size - continuations;
+#else
+  s64 length = 0;
+  For(range(size)) length += (p[it] & 0xc0) != 0x80;
+  return length;
+#endif
+}
+
+// Returns a pointer to the beginning of the _n_-th code point in [p, end).
+// Returns _end_ if the buffer contains exactly _n_ code points and null if it
+// contains less.
+inline const char *bytes_skip_utf8_cps(const char *p, const char *end, s64 n) {
+#if LSTD_SIMD_X86
+  // Skip whole blocks while the code point we want is not inside them.
+  for (; end - p >= 16; p += 16) {
+    u32 continuations = internal::sse2_utf8_continuation_mask(
+        _mm_loadu_si128((const __m128i *)p));
+    s64 starts = 16 - pop_count(continuations);
+    if (starts > n) break;
+    n -= starts;
+  }
+#endif
+  for (; p < end; ++p) {
+    if ((*p & 0xc0) == 0x80) continue;
+    if (!n) return p;
+    --n;
+  }
+  return n ? null : end;
+}
+
+// Returns a pointer to the first occurence of [needle, needle + n) in
+// [p, end) or null. Uses the first/last byte filter (compare the first and
+// the last byte of the needle against a whole block of candidates and only
+// then check the bytes in the middle).
+inline const char *bytes_search(const char *p, const char *end,
+                                const char *needle, s64 n) {
+  if (n <= 0 || end - p < n) return null;
+  if (n == 1) return bytes_find(p, end, *needle);
+
+#if LSTD_SIMD_X86
+  if (end - p >= SIMD_AVX2_THRESHOLD && cpu_has(CPU_AVX2)) {
+    auto *r = internal::avx2_search(p, end, needle, n);
+    if (r) return r;
+  }
+
+  __m128i first = _mm_set1_epi8(needle[0]);
+  __m128i last = _mm_set1_epi8(needle[n - 1]);
+  for (; end - p >= n - 1 + 16; p += 16) {
+    __m128i blockFirst = _mm_loadu_si128((const __m128i *)p);
+    __m128i blockLast = _mm_loadu_si128((const __m128i *)(p + n - 1));
+    u32 mask = (u32)_mm_movemask_epi8(
+        _mm_and_si128(_mm_cmpeq_epi8(blockFirst, first),
+                      _mm_cmpeq_epi8(blockLast, last)));
+    while (mask) {
+      s32 bit = lsb(mask);
+      if (bytes_mismatch(p + bit + 1, needle + 1, n - 2) == -1) return p + bit;
+      mask &= mask - 1;
+    }
+  }
+#endif
+
+  for (; end - p >= n; ++p) {
+    if (*p == *needle && p[n - 1] == needle[n - 1] &&
+        bytes_mismatch(p + 1, needle + 1, n - 2) == -1) {
+      return p;
+    }
+  }
+  return null;
+}
+
+// Copies _size_ bytes from _src_ to _dst_, the two blocks may overlap.
+inline void bytes_move(void *dst, const void *src, s64 size) {
+  auto *d = (byte *)dst;
+  auto *s = (const byte *)src;
+  if (d == s || size <= 0) return;
+
+  // Copying forward is safe when the destination is before the source
+  // (we always load a block before storing it), backwards otherwise.
+  bool forward = d < s || d >= s + size;
+
+#if LSTD_SIMD_X86
+  if (size >= SIMD_AVX2_THRESHOLD && cpu_has(CPU_AVX2)) {
+    if (forward) {
+      internal::avx2_move_forward(d, s, size);
+    } else {
+      internal::avx2_move_backward(d, s, size);
+    }
+    return;
+  }
+
+  if (forward) {
+    for (; size >= 16; size -= 16, d += 16, s += 16) {
+      _mm_storeu_si128((__m128i *)d, _mm_loadu_si128((const __m128i *)s));
+    }
+    while (size--) *d++ = *s++;
+  } else {
+    for (; size >= 16; size -= 16) {
+      _mm_storeu_si128((__m128i *)(d + size - 16),
+                       _mm_loadu_si128((const __m128i *)(s + size - 16)));
+    }
+    while (size--) d[size] = s[size];
+  }
+#else
+  if (forward) {
+    while (size--) *d++ = *s++;
+  } else {
+    while (size--) d[size] = s[size];
+  }
+#endif
+}
+
+LSTD_END_NAMESPACE
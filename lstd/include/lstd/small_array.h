@@ -0,0 +1,86 @@
+#pragma once
+
+#include "array.h"
+
+LSTD_BEGIN_NAMESPACE
+
+//
+// A dynamic array which keeps the first N elements inside the object and
+// allocates only when it grows past that. Use it for short lived, usually
+// short arrays (token lists, path components, a couple of render targets)
+// to avoid going to the allocator at all.
+//
+//      small_array<string, 8> components;
+//      add(components, "data");       // No allocation
+//      ...                            // The 9th element moves everything to
+//                                     // the Context's allocator
+//      free(components);
+//
+// :CodeReusability: This is considered a dynamic array-like (take a look at
+// "array_like.h"), so add, insert_at_index, remove_*, search, etc. all work.
+// reserve() knows about the inline buffer and only allocates when the
+// requested size doesn't fit in it.
+//
+// Unlike other arrays this object points into itself while the elements are
+// inline, so copying it must go through the copy constructor (which rebinds
+// _Data_). Don't memcpy it around (e.g. don't keep small_arrays as elements
+// of a growing array<>). Copying a small_array which has moved to the heap is
+// shallow, like with array<T> (see :TypePolicy in "common.h").
+//
+template <typename T, s64 N>
+struct small_array {
+  static const s64 INLINE_CAPACITY = N;
+
+  T *Data = (T *) Inline;
+  s64 Count = 0;
+  s64 Allocated = N;
+
+  alignas(T) char Inline[N * sizeof(T)];
+
+  small_array() {}
+
+  small_array(initializer_list<T> items) { add(*this, items); }
+
+  small_array(const small_array &other) { *this = other; }
+
+  small_array &operator=(const small_array &other) {
+    if (this == &other) return *this;
+
+    Count = other.Count;
+    if ((void *) other.Data == (void *) other.Inline) {
+      Data = (T *) Inline;
+      Allocated = N;
+      memcpy(Inline, other.Inline, other.Count * sizeof(T));
+    } else {
+      Data = other.Data;
+      Allocated = other.Allocated;
+    }
+    return *this;
+  }
+
+  auto operator[](s64 index) {
+    return Data[translate_negative_index(index, Count)];
+  }
+  auto operator[](s64 index) const {
+    return Data[translate_negative_index(index, Count)];
+  }
+
+  operator array<T>() { return array<T>(Data, Count); }
+};
+
+template <typename T, s64 N>
+bool is_inline(small_array<T, N> no_copy arr) {
+  return (void *) arr.Data == (void *) arr.Inline;
+}
+
+// Frees the heap buffer (if the array ever moved there) and goes back to
+// using the inline buffer.
+template <typename T, s64 N>
+void free(small_array<T, N> ref arr) {
+  if (!is_inline(arr)) free(arr.Data);
+  arr.Data = (T *) arr.Inline;
+  arr.Count = 0;
+  arr.Allocated = N;
+}
+
+LSTD_END_NAMESPACE
@@ -0,0 +1,216 @@
+#pragma once
+
+#include "array.h"
+
+LSTD_BEGIN_NAMESPACE
+
+//
+// Struct-of-arrays container.
+//
+// Stores each field in its own contiguous array instead of an array of
+// structs, so a pass which touches one field only pulls that field into
+// cache (and can be vectorized). All columns share _Count_ and live in a
+// single allocation, each column starts on a SIMD_ALIGNMENT boundary.
+//
+//      // Instead of array<particle> with {Position, Velocity, Life}
+//      soa_array<v3, v3, f32> particles;
+//
+//      add(particles, position, velocity, 1.0f);
+//
+//      auto lifes = column<2>(particles);  // array<f32> view
+//      For(range(lifes.Count)) lifes.Data[it] -= dt;
+//
+//      for_each(particles, [](v3 ref p, v3 ref v, f32 ref life) { p += v; });
+//
+//      remove_unordered_at_index(particles, 3);
+//      free(particles);
+//
+// Column views are invalidated when the array grows (like array<T>).
+//
+template <typename... Fields>
+struct soa_array {
+  static const s64 FIELD_COUNT = sizeof...(Fields);
+  static_assert(FIELD_COUNT > 0);
+
+  static const s64 SIMD_ALIGNMENT = 64;
+
+  void *Columns[FIELD_COUNT] = {};
+  s64 Count = 0;
+  s64 Allocated = 0;
+
+  // Used when growing, if null the Context's allocator is used
+  allocator Alloc;
+};
+
+namespace internal {
+template <s64 I, typename First, typename... Rest>
+struct soa_field {
+  using type = typename soa_field<I - 1, Rest...>::type;
+};
+
+template <typename First, typename... Rest>
+struct soa_field<0, First, Rest...> {
+  using type = First;
+};
+
+template <s64... I>
+struct soa_indices {};
+
+template <s64 N, s64... I>
+struct make_soa_indices : make_soa_indices<N - 1, N - 1, I...> {};
+
+template <s64... I>
+struct make_soa_indices<0, I...> {
+  using type = soa_indices<I...>;
+};
+
+template <typename... Fields>
+using soa_indices_for = typename make_soa_indices<sizeof...(Fields)>::type;
+
+inline s64 soa_align(s64 size) {
+  return (size + soa_array<char>::SIMD_ALIGNMENT - 1) &
+         ~(soa_array<char>::SIMD_ALIGNMENT - 1);
+}
+}  // namespace internal
+
+// The type of the I-th field
+template <s64 I, typename... Fields>
+using soa_field_t = typename internal::soa_field<I, Fields...>::type;
+
+// Returns a view to the I-th column
+template <s64 I, typename... Fields>
+auto column(soa_array<Fields...> no_copy arr) {
+  using T = soa_field_t<I, Fields...>;
+  return array<T>((T *) arr.Columns[I], arr.Count);
+}
+
+template <typename... Fields>
+void reserve(soa_array<Fields...> ref arr, s64 n = -1, allocator alloc = {}) {
+  if (n <= 0) n = max(arr.Count, 8);
+  if (n <= arr.Allocated) return;
+
+  if (alloc) arr.Alloc = alloc;
+  if (!arr.Alloc) arr.Alloc = Context.Alloc;
+
+  s64 sizes[] = {internal::soa_align(n * (s64) sizeof(Fields))...};
+  s64 total = 0;
+  for (s64 s : sizes) total += s;
+
+  auto *block = malloc<char>({.Count = total,
+                              .Alloc = arr.Alloc,
+                              .Alignment = soa_array<Fields...>::SIMD_ALIGNMENT});
+
+  s64 elementSizes[] = {(s64) sizeof(Fields)...};
+
+  s64 offset = 0;
+  For(range(soa_array<Fields...>::FIELD_COUNT)) {
+    if (arr.Columns[it]) {
+      memcpy(block + offset, arr.Columns[it], arr.Count * elementSizes[it]);
+    }
+    offset += sizes[it];
+  }
+
+  // All columns are in one block which starts at the first one
+  if (arr.Columns[0]) free((char *) arr.Columns[0]);
+
+  offset = 0;
+  For(range(soa_array<Fields...>::FIELD_COUNT)) {
+    arr.Columns[it] = block + offset;
+    offset += sizes[it];
+  }
+  arr.Allocated = n;
+}
+
+template <typename... Fields>
+void free(soa_array<Fields...> ref arr) {
+  if (arr.Columns[0]) free((char *) arr.Columns[0]);
+  For(range(soa_array<Fields...>::FIELD_COUNT)) arr.Columns[it] = null;
+  arr.Count = arr.Allocated = 0;
+}
+
+namespace internal {
+template <typename... Fields, s64... I>
+void soa_set(soa_array<Fields...> ref arr, s64 index, soa_indices<I...>,
+             Fields no_copy... values) {
+  ((((Fields *) arr.Columns[I])[index] = values), ...);
+}
+
+template <typename... Fields, s64... I>
+void soa_move(soa_array<Fields...> ref arr, s64 dest, s64 src, s64 count,
+              soa_indices<I...>) {
+  (memmove((Fields *) arr.Columns[I] + dest, (Fields *) arr.Columns[I] + src,
+           count * sizeof(Fields)),
+   ...);
+}
+
+template <typename... Fields, typename F, s64... I>
+void soa_for_each(soa_array<Fields...> ref arr, F ref f, soa_indices<I...>) {
+  For(range(arr.Count)) f(((Fields *) arr.Columns[I])[it]...);
+}
+}  // namespace internal
+
+// Sets all fields of the element at _index_
+template <typename... Fields>
+void set(soa_array<Fields...> ref arr, s64 index,
+         type_identity_t<Fields> no_copy... values) {
+  index = translate_negative_index(index, arr.Count);
+  internal::soa_set(arr, index, internal::soa_indices_for<Fields...>{},
+                    values...);
+}
+
+// Appends an element, returns its index
+template <typename... Fields>
+s64 add(soa_array<Fields...> ref arr, type_identity_t<Fields> no_copy... values) {
+  if (arr.Count + 1 > arr.Allocated) {
+    reserve(arr, max(ceil_pow_of_2(arr.Count + 2), 8));
+  }
+
+  s64 index = arr.Count++;
+  internal::soa_set(arr, index, internal::soa_indices_for<Fields...>{},
+                    values...);
+  return index;
+}
+
+template <typename... Fields>
+void insert_at_index(soa_array<Fields...> ref arr, s64 index,
+                     type_identity_t<Fields> no_copy... values) {
+  if (arr.Count + 1 > arr.Allocated) {
+    reserve(arr, max(ceil_pow_of_2(arr.Count + 2), 8));
+  }
+
+  index = translate_negative_index(index, arr.Count, true);
+  internal::soa_move(arr, index + 1, index, arr.Count - index,
+                     internal::soa_indices_for<Fields...>{});
+  arr.Count += 1;
+  internal::soa_set(arr, index, internal::soa_indices_for<Fields...>{},
+                    values...);
+}
+
+// Moves the last element in the place of the removed one
+template <typename... Fields>
+void remove_unordered_at_index(soa_array<Fields...> ref arr, s64 index) {
+  index = translate_negative_index(index, arr.Count);
+  if (index != arr.Count - 1) {
+    internal::soa_move(arr, index, arr.Count - 1, 1,
+                       internal::soa_indices_for<Fields...>{});
+  }
+  arr.Count -= 1;
+}
+
+// Keeps the order of the elements (moves everything after _index_)
+template <typename... Fields>
+void remove_ordered_at_index(soa_array<Fields...> ref arr, s64 index) {
+  index = translate_negative_index(index, arr.Count);
+  internal::soa_move(arr, index, index + 1, arr.Count - index - 1,
+                     internal::soa_indices_for<Fields...>{});
+  arr.Count -= 1;
+}
+
+// Calls f(field0, field1, ...) for each element, fields are passed by
+// reference so they can be modified.
+template <typename... Fields, typename F>
+void for_each(soa_array<Fields...> ref arr, F f) {
+  internal::soa_for_each(arr, f, internal::soa_indices_for<Fields...>{});
+}
+
+LSTD_END_NAMESPACE
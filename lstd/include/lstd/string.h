@@ -2,6 +2,7 @@
 
 #include "delegate.h"
 #include "memory.h"
+#include "simd.h"
 #include "stack_array.h"
 
 LSTD_BEGIN_NAMESPACE
@@ -62,31 +63,42 @@ char *, char8_t *, unsigned char *, s8 *, u8 *, byte * > ;
 
 // The length of a null-terminated string. Doesn't care about encoding.
 // Note that this calculation does not include the null byte.
-// @Speed @TODO Vectorize
 s64 c_string_length(any_c_string auto str) {
   if (!str) return 0;
 
+  if constexpr (sizeof(*str) == 1) {
+    return bytes_find_zero((const char *)str) - (const char *)str;
+  }
+
   s64 length = 0;
   while (*str++) ++length;
   return length;
 }
 
 // The length (in code points) of a utf-8 string
-// @Speed @TODO Vectorize
 inline s64 utf8_length(const char *str, s64 size) {
   if (!str || size == 0) return 0;
 
   // Count all first-bytes (the ones that don't match 10xxxxxx).
-  s64 length = 0;
-  while (size--) {
-    if (!((*str++ & 0xc0) == 0x80)) ++length;
+  return bytes_count_utf8_cps(str, size);
+}
+
+namespace internal {
+// Returns the amount of equal (non-null) characters at the beginning
+// of two null-terminated strings. Only looks at byte strings, for wider
+// strings this returns 0 and the caller does the work.
+template <any_c_string C>
+s64 c_string_equal_prefix(C one, C other) {
+  if constexpr (sizeof(*one) == 1) {
+    return bytes_c_string_prefix((const char *)one, (const char *)other);
+  } else {
+    return 0;
   }
-  return length;
 }
+}  // namespace internal
 
 // Returns -1 if strings match, else returns the index of the first different
 // byte
-// @Speed @TODO Vectorize
 template <any_c_string C>
 s64 compare_string(C one, C other) {
   assert(one);
@@ -94,7 +106,14 @@ s64 compare_string(C one, C other) {
 
   if (!*one && !*other) return -1;
 
-  s64 index = 0;
+  s64 index = internal::c_string_equal_prefix(one, other);
+  if (index) {
+    // Same results as the loop below would produce.
+    if (!one[index] && !other[index]) return -1;
+    if (!one[index] || !other[index]) return index - 1;
+    return index;
+  }
+
   while (*one == *other) {
     ++one, ++other;
     if (!*one && !*other) return -1;
@@ -106,12 +125,14 @@ s64 compare_string(C one, C other) {
 
 // Return -1 if one < other, 0 if one == other and 1 if one > other (not the
 // pointers)
-// @Speed @TODO Vectorize
 template <any_c_string C>
 s32 compare_string_lexicographically(C one, C other) {
   assert(one);
   assert(other);
 
+  s64 prefix = internal::c_string_equal_prefix(one, other);
+  one += prefix, other += prefix;
+
   while (*one && (*one == *other)) ++one, ++other;
   return (*one > *other) - (*other > *one);
 }
@@ -309,7 +330,6 @@ inline bool is_lower(code_point ch) { return ch != to_upper(ch); }
 
 // Returns -1 if strings match, else returns the index of the first different
 // byte. Ignores the case of the characters.
-// @Speed @TODO Vectorize
 template <any_c_string C>
 s64 compare_string_ignore_case(C one, C other) {
   assert(one);
@@ -317,7 +337,14 @@ s64 compare_string_ignore_case(C one, C other) {
 
   if (!*one && !*other) return -1;
 
-  s64 index = 0;
+  // Bytes which are exactly the same are also the same when ignoring case.
+  s64 index = internal::c_string_equal_prefix(one, other);
+  if (index) {
+    if (!one[index] && !other[index]) return -1;
+    if (!one[index] || !other[index]) return index - 1;
+    one += index, other += index;
+  }
+
   while (to_lower(*one) == to_lower(*other)) {
     ++one, ++other;
     if (!*one && !*other) return -1;
@@ -329,12 +356,14 @@ s64 compare_string_ignore_case(C one, C other) {
 
 // Return -1 if one < other, 0 if one == other and 1 if one > other (not the
 // pointers). Ignores the case of the characters.
-// @Speed @TODO Vectorize
 template <any_c_string C>
 s32 compare_string_lexicographically_ignore_case(C one, C other) {
   assert(one);
   assert(other);
 
+  s64 prefix = internal::c_string_equal_prefix(one, other);
+  one += prefix, other += prefix;
+
   while (*one && (to_lower(*one) == to_lower(*other))) ++one, ++other;
   return (*one > *other) - (*other > *one);
 }
@@ -486,13 +515,19 @@ inline bool utf8_is_valid_cp(const char *data) {
 // which handles out of bounds indexing.
 //
 // If LSTD_ARRAY_BOUNDS_CHECK is defined this fails if we go out of bounds.
-//
-// @Speed @TODO Vectorize for large strings
 inline const char *utf8_get_pointer_to_cp_at_translated_index(const char *str,
                                                               s64 byteLength,
                                                               s64 index) {
   auto *end = str + byteLength;
 
+  // For large strings skip whole blocks by counting the code points in them.
+  // Assumes valid utf-8, which we assume in most places anyway.
+  if (byteLength >= 64) {
+    auto *result = bytes_skip_utf8_cps(str, end, index);
+    assert(result && "Out of bounds");
+    return result;
+  }
+
   For(range(index)) {
     // Danger danger. If the string contains invalid utf8, then we might bypass
     // str == end. That's why we check with >=.
@@ -506,6 +541,34 @@ inline const char *utf8_get_pointer_to_cp_at_translated_index(const char *str,
   return str;
 }
 
+// Like the function above but also accepts negative (python-style) indices.
+// Those are handled by walking backwards from the end, so s[-1] costs as much
+// as s[0] and neither has to calculate the length of the string first.
+//
+// If _toleratePastLast_ is true, an index equal to the length of the string
+// is valid and returns a pointer to the end.
+inline const char *utf8_get_pointer_to_cp_at_index(
+    const char *str, s64 byteLength, s64 index, bool toleratePastLast = false) {
+  if (index >= 0) {
+    auto *result =
+        utf8_get_pointer_to_cp_at_translated_index(str, byteLength, index);
+#if defined LSTD_ARRAY_BOUNDS_CHECK
+    if (!toleratePastLast) assert(result < str + byteLength && "Out of bounds");
+#endif
+    return result;
+  }
+
+  auto *p = str + byteLength;
+  For(range(-index)) {
+#if defined LSTD_ARRAY_BOUNDS_CHECK
+    assert(p > str && "Out of bounds");
+#endif
+    --p;
+    while (p > str && (*p & 0xc0) == 0x80) --p;
+  }
+  return p;
+}
+
 // Converts utf-8 to utf-16 and stores in _out_ (assumes there is enough space).
 // Also adds a null-terminator at the end.
 inline void utf8_to_utf16(const char *str, s64 length, wchar *out) {
@@ -645,9 +708,13 @@ struct string {
     string ref String;
     s64 Index;
 
-    code_point_ref(string ref s, s64 index) : String(s) {
-      Index = translate_negative_index(index, length(s));
-    }
+    // Byte offset of the code point if the caller already knows it
+    // (e.g. string_iterator), so we don't translate _Index_ again.
+    s64 Offset = -1;
+
+    // Negative indices are translated when accessing, see get().
+    code_point_ref(string ref s, s64 index, s64 offset = -1)
+        : String(s), Index(index), Offset(offset) {}
 
     code_point_ref &operator=(code_point other) {
       set(String, Index, other);
@@ -655,8 +722,8 @@ struct string {
     }
 
     operator code_point() const {
-      return utf8_decode_cp(utf8_get_pointer_to_cp_at_translated_index(
-          String.Data, length(String), Index));
+      if (Offset >= 0) return utf8_decode_cp(String.Data + Offset);
+      return get(String, Index);
     }
   };
 
@@ -679,10 +746,7 @@ struct string {
   //
   //
   code_point_ref operator[](s64 index) { return code_point_ref(*this, index); }
-  code_point operator[](s64 index) const {
-    return utf8_decode_cp(
-        utf8_get_pointer_to_cp_at_translated_index(Data, length(*this), index));
-  }
+  code_point operator[](s64 index) const { return get(*this, index); }
 };
 
 inline void reserve(string ref s, s64 n = -1, allocator alloc = {}) {
@@ -867,21 +931,28 @@ inline void maybe_grow(string ref s, s64 fit) {
   reserve(s, target);
 }
 
-inline void insert_at_index(string ref s, s64 index, const char *str,
-                            s64 size) {
+namespace internal {
+// Inserts _size_ bytes at byte _offset_.
+inline void string_insert_bytes(string ref s, s64 offset, const char *str,
+                                s64 size) {
   maybe_grow(s, size);
 
-  index = translate_negative_index(index, length(s), true);
-  auto *t = utf8_get_pointer_to_cp_at_translated_index(s.Data, s.Count, index);
-
-  s64 offset = translate_negative_index(t - s.Data, s.Count, true);
   auto *where = s.Data + offset;
   if (offset < s.Count) {
-    memcpy(where + size, where, (s.Count - offset) * sizeof(*where));
+    memmove(where + size, where, (s.Count - offset) * sizeof(*where));
   }
   memcpy(where, str, size * sizeof(*where));
   s.Count += size;
 }
+}  // namespace internal
+
+inline void insert_at_index(string ref s, s64 index, const char *str,
+                            s64 size) {
+  // Translate before growing since _s_ might be a view.
+  s64 offset =
+      utf8_get_pointer_to_cp_at_index(s.Data, s.Count, index, true) - s.Data;
+  internal::string_insert_bytes(s, offset, str, size);
+}
 
 inline void insert_at_index(string ref s, s64 index, string str) {
   insert_at_index(s, index, str.Data, str.Count);
@@ -893,14 +964,17 @@ inline void insert_at_index(string ref s, s64 index, code_point cp) {
   insert_at_index(s, index, encodedCp, utf8_get_size_of_cp(cp));
 }
 
+// Appending doesn't need to translate a code point index.
 inline void add(string ref s, const char *ptr, s64 size) {
-  insert_at_index(s, length(s), ptr, size);
+  internal::string_insert_bytes(s, s.Count, ptr, size);
 }
 inline void add(string ref s, string b) {
-  insert_at_index(s, length(s), b.Data, b.Count);
+  internal::string_insert_bytes(s, s.Count, b.Data, b.Count);
 }
 inline void add(string ref s, code_point cp) {
-  insert_at_index(s, length(s), cp);
+  char encodedCp[4];
+  utf8_encode_cp(encodedCp, cp);
+  internal::string_insert_bytes(s, s.Count, encodedCp, utf8_get_size_of_cp(cp));
 }
 
 inline string ref operator+=(string ref s, code_point cp) {
@@ -961,9 +1035,17 @@ struct string_iterator {
   string_t ref String;
   s64 Index;
 
-  string_iterator(string_t ref s, s64 index = 0) : String(s), Index(index) {}
+  // Byte offset of the code point at _Index_. We keep it along the index
+  // so iterating doesn't translate the index from the start each step.
+  s64 Offset;
+
+  string_iterator(string_t ref s, s64 index = 0, s64 offset = 0)
+      : String(s), Index(index), Offset(offset) {}
 
   string_iterator &operator++() {
+    // Note: If the code point was changed through operator* the new one
+    // is at the same offset, so this is still correct.
+    Offset += utf8_get_size_of_cp(String.Data + Offset);
     Index += 1;
     return *this;
   }
@@ -974,96 +1056,131 @@ struct string_iterator {
     return temp;
   }
 
+  // The end iterator doesn't know the length in code points (counting them
+  // would be O(n) before the first step), so it's marked with _Index_ = -1
+  // and compares equal to any iterator which reached the end of the bytes.
+  // The check is on the current Count, in case a code point changed size
+  // through operator*.
+  bool at_end() const { return Index == -1 || Offset >= String.Count; }
+
   auto operator==(string_iterator other) const {
-    return &String == &other.String && Index == other.Index;
+    if (&String != &other.String) return false;
+    if (Index == -1 || other.Index == -1) return at_end() == other.at_end();
+    return Index == other.Index;
   }
   auto operator!=(string_iterator other) const { return !(*this == other); }
 
-  auto operator*() { return String[Index]; }
+  auto operator*() {
+    if constexpr (Const) {
+      return utf8_decode_cp(String.Data + Offset);
+    } else {
+      return string::code_point_ref(String, Index, Offset);
+    }
+  }
 };
 
 inline auto begin(string ref str) { return string_iterator<false>(str, 0); }
 inline auto begin(string no_copy str) { return string_iterator<true>(str, 0); }
 inline auto end(string ref str) {
-  return string_iterator<false>(str, length(str));
+  return string_iterator<false>(str, -1, str.Count);
 }
 inline auto end(string no_copy str) {
-  return string_iterator<true>(str, length(str));
+  return string_iterator<true>(str, -1, str.Count);
 }
 
+// Negative indices walk from the end, so this is O(|index|) and doesn't
+// need the length of the string. For repeated random access build a
+// string_index (see below).
 inline code_point get(string str, s64 index) {
-  if (index < 0) {
-    // @Speed... should we cache this in _string_?
-    // We need to calculate the total length (in code points)
-    // in order for the negative index to be converted properly.
-    s64 len = length(str);
-    index = translate_negative_index(index, len);
-
-    // If LSTD_ARRAY_BOUNDS_CHECK is defined:
-    // _utf8_get_pointer_to_cp_at_translated_index()_ also checks for out of
-    // bounds but we are sure the index is valid (since translate_index also
-    // checks for out of bounds) so we can get away with the unsafe version
-    // here.
-    auto *s = str.Data;
-    For(range(index)) s += utf8_get_size_of_cp(s);
-    return utf8_decode_cp(s);
-  } else {
-    auto *s =
-        utf8_get_pointer_to_cp_at_translated_index(str.Data, str.Count, index);
-    return utf8_decode_cp(s);
-  }
+  return utf8_decode_cp(
+      utf8_get_pointer_to_cp_at_index(str.Data, str.Count, index));
 }
 
 inline string slice(string str, s64 begin, s64 end) {
-  s64 len = length(str);
-  s64 beginIndex = translate_negative_index(begin, len, true);
-  s64 endIndex = translate_negative_index(end, len, true);
-
-  const char *beginPtr = utf8_get_pointer_to_cp_at_translated_index(
-      str.Data, str.Count, beginIndex);
-  const char *endPtr = beginPtr;
-
-  // @Speed
-  For(range(beginIndex, endIndex)) endPtr += utf8_get_size_of_cp(endPtr);
+  const char *beginPtr =
+      utf8_get_pointer_to_cp_at_index(str.Data, str.Count, begin, true);
+
+  const char *endPtr;
+  if (begin >= 0 && end >= begin) {
+    // Continue from _beginPtr_ instead of walking from the start again.
+    s64 rest = str.Count - (beginPtr - str.Data);
+    endPtr = utf8_get_pointer_to_cp_at_translated_index(beginPtr, rest,
+                                                        end - begin);
+  } else {
+    endPtr = utf8_get_pointer_to_cp_at_index(str.Data, str.Count, end, true);
+  }
 
+  // _end_ resolved before _begin_, the slice is empty
+  if (endPtr < beginPtr) endPtr = beginPtr;
   return string((char *)beginPtr, (s64)(endPtr - beginPtr));
 }
 
 inline s64 search(string str, delegate<bool(code_point)> predicate,
                   search_options options) {
   if (!str.Data || str.Count == 0) return -1;
-  s64 len = length(str);
-  options.Start = translate_negative_index(options.Start, len, true);
-  For(range(options.Start, options.Reversed ? -1 : len,
-            options.Reversed ? -1 : 1)) if (predicate(get(str, it))) return it;
+
+  auto *start = str.Data;
+  auto *end = str.Data + str.Count;
+
+  auto *p = utf8_get_pointer_to_cp_at_index(str.Data, str.Count, options.Start,
+                                            true);
+  s64 index = options.Start >= 0 ? options.Start : utf8_length(start, p - start);
+
+  // Decode code points one after another instead of calling get() with
+  // each index, which walks from the beginning every time.
+  if (!options.Reversed) {
+    for (; p < end; p += utf8_get_size_of_cp(p), ++index) {
+      if (predicate(utf8_decode_cp(p))) return index;
+    }
+  } else {
+    if (p == end) {
+      if (p == start) return -1;
+      --index;
+      --p;
+      while (p > start && (*p & 0xc0) == 0x80) --p;
+    }
+    while (true) {
+      if (predicate(utf8_decode_cp(p))) return index;
+      if (p == start) break;
+      --index;
+      --p;
+      while (p > start && (*p & 0xc0) == 0x80) --p;
+    }
+  }
   return -1;
 }
 
 inline s64 search(string str, code_point search, search_options options) {
-  if (!str.Data || str.Count == 0) return -1;
-  s64 len = length(str);
-  options.Start = translate_negative_index(options.Start, len, true);
-  For(range(options.Start, options.Reversed ? -1 : len,
-            options.Reversed ? -1 : 1)) if (get(str, it) == search) return it;
-  return -1;
+  char encodedCp[4];
+  utf8_encode_cp(encodedCp, search);
+  return LSTD_NAMESPACE::search(
+      str, string(encodedCp, utf8_get_size_of_cp(search)), options);
 }
 
+// Valid utf-8 is self-synchronizing, a byte match of a valid needle always
+// starts at a code point boundary, so we can search bytes and convert
+// the result to a code point index at the end.
 inline s64 search(string str, string search, search_options options) {
   if (!str.Data || str.Count == 0) return -1;
   if (!search.Data || search.Count == 0) return -1;
 
-  s64 len = length(str);
-  options.Start = translate_negative_index(options.Start, len, true);
+  const char *end = str.Data + str.Count;
+  const char *p = utf8_get_pointer_to_cp_at_index(str.Data, str.Count,
+                                                  options.Start, true);
 
-  s64 searchLength = length(search);
+  if (!options.Reversed) {
+    auto *found = bytes_search(p, end, search.Data, search.Count);
+    if (!found) return -1;
+    if (options.Start < 0) return utf8_length(str.Data, found - str.Data);
+    return options.Start + utf8_length(p, found - p);
+  }
 
-  For(range(options.Start, options.Reversed ? -1 : len,
-            options.Reversed ? -1 : 1)) {
-    s64 progress = 0;
-    for (s64 s = it; progress != searchLength; ++s, ++progress) {
-      if (!(get(str, s) == get(search, progress))) break;
+  for (; p >= str.Data; --p) {
+    if (end - p < search.Count) continue;
+    if (*p != *search.Data) continue;
+    if (bytes_mismatch(p, search.Data, search.Count) == -1) {
+      return utf8_length(str.Data, p - str.Data);
     }
-    if (progress == searchLength) return it;
   }
   return -1;
 }
@@ -1076,14 +1193,35 @@ inline bool has(string str, code_point cp) {
   return search(str, string(encodedCp, utf8_get_size_of_cp(cp))) != -1;
 }
 
+namespace internal {
+// Returns the byte offset of the first code point at which _a_ and _b_ differ
+// or -1 if the shorter string is a prefix of the other (or they are equal).
+inline s64 utf8_mismatch_cp(string a, string b) {
+  s64 m = bytes_mismatch(a.Data, b.Data, a.Count < b.Count ? a.Count : b.Count);
+  if (m == -1) return -1;
+
+  // Go back to the beginning of the code point
+  while (m > 0 && (a.Data[m] & 0xc0) == 0x80) --m;
+  return m;
+}
+}  // namespace internal
+
 inline s64 compare(string s, string other) {
   if (!s.Count && !other.Count) return -1;
   if (!s.Count || !other.Count) return 0;
 
-  auto *p1 = s.Data, *p2 = other.Data;
-  auto *e1 = p1 + s.Count, *e2 = p2 + other.Count;
+  s64 m = internal::utf8_mismatch_cp(s, other);
+  if (m == -1) {
+    if (s.Count == other.Count) return -1;
+    return length(s.Count < other.Count ? s : other) - 1;
+  }
 
-  s64 index = 0;
+  // Both strings continue after _m_, so the loop below can't hit the end
+  // before it finds the difference.
+  auto *p1 = s.Data + m, *p2 = other.Data + m;
+  auto *e1 = s.Data + s.Count, *e2 = other.Data + other.Count;
+
+  s64 index = utf8_length(s.Data, m);
   while (utf8_decode_cp(p1) == utf8_decode_cp(p2)) {
     p1 += utf8_get_size_of_cp(p1);
     p2 += utf8_get_size_of_cp(p2);
@@ -1117,8 +1255,14 @@ inline s32 compare_lexicographically(string a, string b) {
   if (!a.Count) return -1;
   if (!b.Count) return 1;
 
-  auto *p1 = a.Data, *p2 = b.Data;
-  auto *e1 = p1 + a.Count, *e2 = p2 + b.Count;
+  s64 m = internal::utf8_mismatch_cp(a, b);
+  if (m == -1) {
+    if (a.Count == b.Count) return 0;
+    return a.Count < b.Count ? -1 : 1;
+  }
+
+  auto *p1 = a.Data + m, *p2 = b.Data + m;
+  auto *e1 = a.Data + a.Count, *e2 = b.Data + b.Count;
 
   s64 index = 0;
   while (utf8_decode_cp(p1) == utf8_decode_cp(p2)) {
@@ -1182,10 +1326,8 @@ inline void replace_range(string ref str, s64 begin, s64 end, string replace) {
 inline void set(string ref str, s64 index, code_point cp) {
   check_debug_memory(str);
 
-  index = translate_negative_index(index, length(str));
-
   const char *target =
-      utf8_get_pointer_to_cp_at_translated_index(str.Data, str.Count, index);
+      utf8_get_pointer_to_cp_at_index(str.Data, str.Count, index);
 
   char encodedCp[4];
   utf8_encode_cp(encodedCp, cp);
@@ -1210,44 +1352,36 @@ inline bool remove(string ref s, code_point cp) {
   s64 index = search(s, string(encodedCp, utf8_get_size_of_cp(cp)));
   if (index == -1) return false;
 
-  remove_range(s, index, index + utf8_get_size_of_cp(cp));
+  remove_range(s, index, index + 1);
 
   return true;
 }
 
-inline void remove_at_index(string ref s, s64 index) {
-  index = translate_negative_index(index, length(s));
-
-  auto *t = utf8_get_pointer_to_cp_at_translated_index(s.Data, s.Count, index);
-
-  s64 b = t - s.Data;
-  remove_range(s, b, b + utf8_get_size_of_cp(t));
-}
-
-inline void remove_range(string ref s, s64 begin, s64 end) {
+namespace internal {
+// Removes the bytes in [begin, end).
+inline void string_remove_bytes(string ref s, s64 begin, s64 end) {
   check_debug_memory(s);
 
-  s64 len = length(s);
-
-  begin = translate_negative_index(begin, len);
-  end = translate_negative_index(end, len, true);
-
-  auto *tbp =
-      utf8_get_pointer_to_cp_at_translated_index(s.Data, s.Count, begin);
-  auto *tep = utf8_get_pointer_to_cp_at_translated_index(s.Data, s.Count, end);
+  auto where = s.Data + begin;
+  auto whereEnd = s.Data + end;
 
-  begin = (s64)(tbp - s.Data);
-  end = (s64)(tep - s.Data);
+  s64 elementCount = whereEnd - where;
+  memmove(where, whereEnd, (s.Count - begin - elementCount) * sizeof(*where));
+  s.Count -= elementCount;
+}
+}  // namespace internal
 
-  s64 tp = translate_negative_index(begin, s.Count);
-  s64 te = translate_negative_index(end, s.Count, true);
+inline void remove_at_index(string ref s, s64 index) {
+  auto *t = utf8_get_pointer_to_cp_at_index(s.Data, s.Count, index);
 
-  auto where = s.Data + tp;
-  auto whereEnd = s.Data + te;
+  s64 b = t - s.Data;
+  internal::string_remove_bytes(s, b, b + utf8_get_size_of_cp(t));
+}
 
-  s64 elementCount = whereEnd - where;
-  memcpy(where, whereEnd, (s.Count - tp - elementCount) * sizeof(*where));
-  s.Count -= elementCount;
+inline void remove_range(string ref s, s64 begin, s64 end) {
+  auto *tbp = utf8_get_pointer_to_cp_at_index(s.Data, s.Count, begin);
+  auto *tep = utf8_get_pointer_to_cp_at_index(s.Data, s.Count, end, true);
+  internal::string_remove_bytes(s, tbp - s.Data, tep - s.Data);
 }
 
 inline void replace_all(string ref s, string what, string replace) {
@@ -1352,4 +1486,86 @@ inline void replace_all(string ref s, string what, code_point replace) {
   replace_all(s, what, string(encodedCp, utf8_get_size_of_cp(encodedCp)));
 }
 
+//
+// Code point indexing walks the utf-8 bytes, which makes loops that access
+// a string by index quadratic. For strings which are indexed a lot you can
+// build a string_index once and pass it along: access becomes O(1) for ascii
+// strings and O(STRING_INDEX_STRIDE) otherwise.
+//
+//      string_index index = make_string_index(s);
+//      defer(free(index));
+//      For(range(index.Length)) { code_point cp = get(s, index, it); ... }
+//
+// The index is a side table, it doesn't own or track the string. If you
+// modify the string (in a way that changes the byte layout), you must build
+// the index again.
+//
+inline const s64 STRING_INDEX_STRIDE = 64;
+
+struct string_index {
+  s64 Length = 0;  // In code points
+  bool IsAscii = false;
+
+  // Byte offsets of the code points at 0, STRIDE, 2 * STRIDE, etc.
+  // Not allocated for ascii strings (the index is the offset).
+  s64 *Checkpoints = null;
+  s64 CheckpointsCount = 0;
+};
+
+mark_as_leak inline string_index make_string_index(string s,
+                                                   allocator alloc = {}) {
+  string_index result;
+  result.Length = utf8_length(s.Data, s.Count);
+
+  // For valid utf-8 the two are equal only if there are no multi-byte
+  // code points.
+  result.IsAscii = result.Length == s.Count;
+  if (result.IsAscii) return result;
+
+  result.CheckpointsCount = (result.Length - 1) / STRING_INDEX_STRIDE + 1;
+  result.Checkpoints =
+      malloc<s64>({.Count = result.CheckpointsCount, .Alloc = alloc});
+
+  const char *end = s.Data + s.Count;
+  const char *p = s.Data;
+  For(range(result.CheckpointsCount)) {
+    result.Checkpoints[it] = p - s.Data;
+    if (it + 1 < result.CheckpointsCount) {
+      p = bytes_skip_utf8_cps(p, end, STRING_INDEX_STRIDE);
+    }
+  }
+  return result;
+}
+
+inline void free(string_index ref index) {
+  if (index.Checkpoints) free(index.Checkpoints);
+  index = {};
+}
+
+// Returns a pointer to the code point at _index_ (which can be negative).
+// If _toleratePastLast_ is true, an index equal to the length of the string
+// returns a pointer to the end.
+inline const char *get_pointer_to_cp(string s, string_index no_copy index,
+                                     s64 i, bool toleratePastLast = false) {
+  i = translate_negative_index(i, index.Length, toleratePastLast);
+  if (index.IsAscii) return s.Data + i;
+  if (i == index.Length) return s.Data + s.Count;
+
+  auto *p = s.Data + index.Checkpoints[i / STRING_INDEX_STRIDE];
+  For(range(i % STRING_INDEX_STRIDE)) p += utf8_get_size_of_cp(p);
+  return p;
+}
+
+inline code_point get(string s, string_index no_copy index, s64 i) {
+  return utf8_decode_cp(get_pointer_to_cp(s, index, i));
+}
+
+inline string slice(string s, string_index no_copy index, s64 begin,
+                    s64 end) {
+  auto *b = get_pointer_to_cp(s, index, begin, true);
+  auto *e = get_pointer_to_cp(s, index, end, true);
+  if (e < b) e = b;  // Empty, like slice() without an index
+  return string((char *)b, (s64)(e - b));
+}
+
 LSTD_END_NAMESPACE
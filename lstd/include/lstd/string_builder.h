@@ -10,30 +10,76 @@ LSTD_BEGIN_NAMESPACE
 //
 // String builder is good for building large strings without having to
 // constantly reallocate. Starts with a 1_KiB buffer on the stack, if that fills
-// up, allocates on the heap using _Alloc_. It maintains a linked list of 1_KiB
-// buckets, which get allocated on the go as needed.
+// up, allocates on the heap using _Alloc_.
+//
+// There are two modes:
+//   CHUNKED    - (default) keeps a linked list of heap buffers. Each buffer is
+//                twice as large as the one before it (the first one is
+//                BUFFER_SIZE) up to _MaxChunkSize_, so building megabytes of
+//                text takes a handful of allocations. Text already added is
+//                never moved. Set _MaxChunkSize_ to BUFFER_SIZE to get buckets
+//                of fixed size.
+//   CONTIGUOUS - once the stack buffer fills up, everything is kept in one
+//                heap block (_Block_) which grows geometrically. The result
+//                can be taken out as a string without copying (take_string).
+//                With a virtual memory arena as _Alloc_ (see
+//                virtual_arena_allocator in os/memory.h) the block grows in
+//                place and is never copied at all.
+//
+// Set _Mode_ (and _Alloc_) before adding anything.
+//
+// Reading the contents doesn't require merging the buffers. builder_view
+// iterates over them as strings:
+//
+//      For(builder_view(&b)) write(&someWriter, it);
+//
+// ... and os_write_file() (os/common.h) hands all of them to the OS in one
+// gather write (writev on posix).
 //
 // We provide an explicit allocator so you can set it in the beginning, before
 // it ever allocates. If it's still null when we require a new buffer we use the
 // Context's one.
 //
+const s64 STRING_BUILDER_MAX_CHUNK_SIZE = 1_MiB;
+
 struct string_builder {
   static const s64 BUFFER_SIZE = 1_KiB;
 
+  enum mode { CHUNKED, CONTIGUOUS };
+
   struct buffer {
     char Data[BUFFER_SIZE]{};
     s64 Occupied = 0;
-    buffer *Next = null;
   };
 
+  // A heap buffer, the data follows the header in the same allocation
+  struct chunk {
+    chunk *Next = null;
+    s64 Occupied = 0;
+    s64 Size = 0;
+  };
+
+  mode Mode = CHUNKED;
+
   buffer BaseBuffer;
-  buffer *CurrentBuffer =
-      null;  // null means BaseBuffer. We don't point to BaseBuffer because
-             // pointers to other members are dangerous when copying.
+
+  // Chunks are kept after reset() and reused
+  chunk *FirstChunk = null;
+  chunk *CurrentChunk = null;  // null means BaseBuffer. We don't point to
+                               // BaseBuffer because pointers to other members
+                               // are dangerous when copying.
 
   // Counts how many buffers have been dynamically allocated.
   s64 IndirectionCount = 0;
 
+  s64 MaxChunkSize = STRING_BUILDER_MAX_CHUNK_SIZE;
+
+  // Used in CONTIGUOUS mode. While this is set _BaseBuffer_ is empty (its
+  // contents are moved here when it fills up).
+  char *Block = null;
+  s64 BlockOccupied = 0;
+  s64 BlockSize = 0;
+
   // The allocator used for allocating new buffers past the first one (which is
   // stack allocated). This value is null until this object allocates memory (in
   // which case it sets it to the Context's allocator) or the user sets it
@@ -47,8 +93,6 @@ void reset(string_builder *builder);
 // Free any memory allocated by this object and reset cursor
 void free_buffers(string_builder *builder);
 
-string_builder::buffer *get_current_buffer(string_builder *builder);
-
 // Append _size_ bytes from _data_ to the builder
 void add(string_builder *builder, const char *data, s64 size);
 
@@ -64,79 +108,266 @@ inline void add(string_builder *builder, string str) {
   add(builder, str.Data, str.Count);
 }
 
+// Returns how many bytes have been added
+s64 builder_size(const string_builder *builder);
+
 // Merges all buffers in one string.
-// Maybe release the buffers as well?
-// The most common use case is builder_to_string() and then free_buffers() --
-// the builder is not needed anymore.
+// The builder keeps its buffers, if you don't need it anymore take_string()
+// avoids the copy in CONTIGUOUS mode.
 mark_as_leak string builder_to_string(string_builder *builder);
 
-inline void reset(string_builder *builder) {
-  builder->CurrentBuffer = null;  // null means BaseBuffer
-
-  auto *b = &builder->BaseBuffer;
-  while (b) {
-    b->Occupied = 0;
+// Returns the contents and leaves the builder empty. In CONTIGUOUS mode this
+// doesn't copy, the string takes the block (allocated with the builder's
+// _Alloc_). Otherwise it's builder_to_string() followed by free_buffers().
+mark_as_leak string take_string(string_builder *builder);
 
-    b = b->Next;
-  }
+namespace internal {
+inline char *string_builder_chunk_data(const string_builder::chunk *c) {
+  return (char *)(c + 1);
 }
 
-inline void add(string_builder *builder, const char *data, s64 size) {
-  auto *currentBuffer = get_current_buffer(builder);
+inline string_builder::chunk *string_builder_new_chunk(string_builder *builder,
+                                                       s64 minSize) {
+  auto *last = builder->CurrentChunk;
+
+  s64 size = last ? last->Size * 2 : string_builder::BUFFER_SIZE;
+  size = min(size, builder->MaxChunkSize);
+  size = max(size, minSize);
 
-  s64 availableSpace = builder->BUFFER_SIZE - currentBuffer->Occupied;
-  if (availableSpace >= size) {
-    memcpy(currentBuffer->Data + currentBuffer->Occupied, data, size);
-    currentBuffer->Occupied += size;
+  if (!builder->Alloc) builder->Alloc = Context.Alloc;
+  auto *c = (string_builder::chunk *)malloc<byte>(
+      {.Count = (s64)sizeof(string_builder::chunk) + size,
+       .Alloc = builder->Alloc});
+  *c = {null, 0, size};
+
+  if (last) {
+    last->Next = c;
   } else {
-    memcpy(currentBuffer->Data + currentBuffer->Occupied, data, availableSpace);
-    currentBuffer->Occupied += availableSpace;
+    builder->FirstChunk = c;
+  }
 
-    // If the entire string doesn't fit inside the available space,
-    // allocate the next buffer and continue appending.
-    if (!builder->Alloc) builder->Alloc = Context.Alloc;
-    auto *b = malloc<string_builder::buffer>({.Alloc = builder->Alloc});
+  builder->IndirectionCount++;
+  return c;
+}
 
-    currentBuffer->Next = b;
-    builder->CurrentBuffer = b;
+inline void string_builder_grow_block(string_builder *builder, s64 size) {
+  s64 newSize = max(builder->BlockSize * 2, size);
+  newSize = max(newSize, 4 * string_builder::BUFFER_SIZE);
 
+  if (builder->Block) {
+    builder->Block = realloc(builder->Block, {.NewCount = newSize});
+  } else {
+    if (!builder->Alloc) builder->Alloc = Context.Alloc;
+    builder->Block = malloc<char>({.Count = newSize, .Alloc = builder->Alloc});
     builder->IndirectionCount++;
+  }
+  builder->BlockSize = newSize;
+}
 
-    add(builder, data + availableSpace, size - availableSpace);
+inline void string_builder_add_to_block(string_builder *builder,
+                                        const char *data, s64 size) {
+  if (builder->BlockOccupied + size > builder->BlockSize) {
+    string_builder_grow_block(builder, builder->BlockOccupied + size);
   }
+  memcpy(builder->Block + builder->BlockOccupied, data, size);
+  builder->BlockOccupied += size;
 }
+}  // namespace internal
 
-mark_as_leak inline string builder_to_string(string_builder *builder) {
-  string result;
-  reserve(result, (builder->IndirectionCount + 1) * builder->BUFFER_SIZE);
+inline void reset(string_builder *builder) {
+  builder->BaseBuffer.Occupied = 0;
 
-  auto *b = &builder->BaseBuffer;
-  while (b) {
-    add(result, b->Data, b->Occupied);
-    b = b->Next;
+  auto *c = builder->FirstChunk;
+  while (c) {
+    c->Occupied = 0;
+    c = c->Next;
   }
-  return result;
+  builder->CurrentChunk = null;  // null means BaseBuffer
+
+  builder->BlockOccupied = 0;
 }
 
-inline string_builder::buffer *get_current_buffer(string_builder *builder) {
-  if (builder->CurrentBuffer == null) return &builder->BaseBuffer;
-  return builder->CurrentBuffer;
+inline void add(string_builder *builder, const char *data, s64 size) {
+  if (builder->Block) {
+    internal::string_builder_add_to_block(builder, data, size);
+    return;
+  }
+
+  if (!builder->CurrentChunk) {
+    auto *b = &builder->BaseBuffer;
+
+    s64 n = min(size, builder->BUFFER_SIZE - b->Occupied);
+    memcpy(b->Data + b->Occupied, data, n);
+    b->Occupied += n;
+
+    data += n;
+    size -= n;
+    if (!size) return;
+
+    if (builder->Mode == string_builder::CONTIGUOUS) {
+      internal::string_builder_grow_block(builder, b->Occupied + size);
+      internal::string_builder_add_to_block(builder, b->Data, b->Occupied);
+      internal::string_builder_add_to_block(builder, data, size);
+      b->Occupied = 0;
+      return;
+    }
+  }
+
+  while (true) {
+    auto *c = builder->CurrentChunk;
+    if (c) {
+      s64 n = min(size, c->Size - c->Occupied);
+      memcpy(internal::string_builder_chunk_data(c) + c->Occupied, data, n);
+      c->Occupied += n;
+
+      data += n;
+      size -= n;
+      if (!size) return;
+    }
+
+    // Move to the next chunk (left from before a reset) or allocate one which
+    // fits the rest of the data
+    auto *next = c ? c->Next : builder->FirstChunk;
+    if (!next) next = internal::string_builder_new_chunk(builder, size);
+    builder->CurrentChunk = next;
+  }
 }
 
 inline void free_buffers(string_builder *builder) {
   // We don't need to free the base buffer, it is allocated on the stack
-  auto *b = builder->BaseBuffer.Next;
-  while (b) {
-    auto *old = b;
+  auto *c = builder->FirstChunk;
+  while (c) {
+    auto *old = c;
 
-    b = b->Next;
-    free(old);
+    c = c->Next;
+    free((byte *)old);
   }
 
-  builder->CurrentBuffer = null;  // null means BaseBuffer
+  if (builder->Block) free(builder->Block);
+
+  builder->FirstChunk = null;
+  builder->CurrentChunk = null;  // null means BaseBuffer
+  builder->IndirectionCount = 0;
+
+  builder->Block = null;
+  builder->BlockOccupied = 0;
+  builder->BlockSize = 0;
+
   builder->BaseBuffer.Occupied = 0;
 }
 
+//
+// Iterates the builder's buffers in order (skips empty ones), each one as a
+// string which points in the builder. Views are invalidated by adding more
+// text in CONTIGUOUS mode (the block may be moved).
+//
+struct string_builder_iterator {
+  enum stage { BASE, CHUNKS, BLOCK, END };
+
+  const string_builder *Builder;
+  stage Stage;
+  const string_builder::chunk *Chunk;
+
+  string_builder_iterator(const string_builder *builder, stage s)
+      : Builder(builder), Stage(s), Chunk(null) {
+    skip_empty();
+  }
+
+  void skip_empty() {
+    while (Stage != END) {
+      if (Stage == BASE && Builder->BaseBuffer.Occupied) return;
+      if (Stage == CHUNKS && Chunk && Chunk->Occupied) return;
+      if (Stage == BLOCK && Builder->BlockOccupied) return;
+      next();
+    }
+  }
+
+  void next() {
+    if (Stage == BASE) {
+      Stage = CHUNKS;
+      Chunk = Builder->FirstChunk;
+    } else if (Stage == CHUNKS && Chunk) {
+      Chunk = Chunk->Next;
+    } else {
+      Stage = (stage)(Stage + 1);
+    }
+  }
+
+  string_builder_iterator &operator++() {
+    next();
+    skip_empty();
+    return *this;
+  }
+
+  bool operator==(string_builder_iterator other) const {
+    return Builder == other.Builder && Stage == other.Stage &&
+           Chunk == other.Chunk;
+  }
+  bool operator!=(string_builder_iterator other) const {
+    return !(*this == other);
+  }
+
+  string operator*() {
+    if (Stage == BASE) {
+      return string(Builder->BaseBuffer.Data, Builder->BaseBuffer.Occupied);
+    }
+    if (Stage == CHUNKS) {
+      return string(internal::string_builder_chunk_data(Chunk),
+                    Chunk->Occupied);
+    }
+    return string(Builder->Block, Builder->BlockOccupied);
+  }
+};
+
+struct builder_view {
+  const string_builder *Builder;
+
+  builder_view(const string_builder *builder) : Builder(builder) {}
+};
+
+inline auto begin(builder_view v) {
+  return string_builder_iterator(v.Builder, string_builder_iterator::BASE);
+}
+inline auto end(builder_view v) {
+  return string_builder_iterator(v.Builder, string_builder_iterator::END);
+}
+
+inline s64 builder_size(const string_builder *builder) {
+  s64 result = 0;
+  For(builder_view(builder)) result += it.Count;
+  return result;
+}
+
+mark_as_leak inline string builder_to_string(string_builder *builder) {
+  string result;
+  reserve(result, builder_size(builder));
+
+  For(builder_view(builder)) add(result, it);
+  return result;
+}
+
+mark_as_leak inline string take_string(string_builder *builder) {
+  if (!builder->Block) {
+    string result = builder_to_string(builder);
+    free_buffers(builder);
+    return result;
+  }
+
+  string result;
+  result.Data = builder->Block;
+  result.Count = builder->BlockOccupied;
+  result.Allocated = builder->BlockSize;
+
+  builder->Block = null;
+  free_buffers(builder);
+  return result;
+}
+
+// Writes the contents to _w_ without merging the buffers first
+inline void write(writer *w, const string_builder *builder) {
+  For(builder_view(builder)) w->write(it.Data, it.Count);
+}
+
 //
 // A writer to output to a string
 //
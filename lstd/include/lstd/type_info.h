@@ -122,6 +122,24 @@ template <bool Condition, typename ConditionIsTrueType,
 using type_select_t = typename type_select<Condition, ConditionIsTrueType,
                                            ConditionIsFalseType>::type;
 
+/**
+ * @brief A type alias that is just T, but blocks template argument deduction.
+ *
+ * Use it for parameters whose type should come from the other arguments.
+ *
+ * Example usage:
+ * @code
+ *    template <typename T>
+ *    void fill(array<T> ref arr, type_identity_t<T> value);
+ *
+ *    fill(floats, 0);  // T is f32, 0 is converted
+ * @endcode
+ *
+ * @tparam T The type.
+ */
+template <typename T>
+using type_identity_t = typename internal::type_identity<T>::type;
+
 template <typename T, typename = unused, typename = unused>
 struct first_type_select {
   using type = T;
@@ -42,6 +42,41 @@ struct counting_writer : writer {
   void flush() override {}
 };
 
+//
+// Writes to a fixed caller-provided buffer and never allocates.
+// Bytes which don't fit are dropped but still counted, so after writing
+// _Count_ is the full length of the output (like snprintf's return value)
+// and the output was truncated if Count > Size.
+//
+struct buffer_writer : writer {
+  char *Data;
+  s64 Size;
+  s64 Count = 0;
+
+  buffer_writer(char *data, s64 size) : Data(data), Size(size) {}
+
+  void write(const char *data, s64 count) override {
+    s64 space = Size - Count;
+    if (space > 0) memcpy(Data + Count, data, count < space ? count : space);
+    Count += count;
+  }
+  void flush() override {}
+};
+
+//
+// Appends to a string, growing it as needed.
+//
+struct string_writer : writer {
+  string *String;
+
+  string_writer(string *s) : String(s) {}
+
+  void write(const char *data, s64 count) override {
+    add(*String, data, count);
+  }
+  void flush() override {}
+};
+
 //
 // Output to the console (this might be OS-specific)
 //
@@ -74,7 +74,7 @@ function link_lstd()
         -- We need _CRT_SUPPRESS_RESTRICT for some reason
         defines { "NOMINMAX", "WIN32_LEAN_AND_MEAN", "_CRT_SUPPRESS_RESTRICT" }
         
-        links { "dbghelp" }
+        links { "dbghelp", "Synchronization" }
 
         -- FreeType
 	    includedirs { "vendor/Windows/freetype/include" }
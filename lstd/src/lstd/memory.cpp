@@ -3,18 +3,16 @@
 #include "lstd/atomic.h"
 #include "lstd/fmt.h"
 #include "lstd/os.h"
+#include "lstd/simd.h"
 
 LSTD_USING_NAMESPACE;
 
 extern "C" {
 #if defined LSTD_NO_CRT
 int memcmp(void const *_Buf1, void const *_Buf2, size_t _Size) {
-  auto *p1 = (byte *)_Buf1;
-  auto *p2 = (byte *)_Buf2;
-  For(range(_Size)) {
-    if (p1[it] != p2[it]) return p1[it] - p2[it];
-  }
-  return 0;
+  s64 index = bytes_mismatch(_Buf1, _Buf2, _Size);
+  if (index == -1) return 0;
+  return ((byte *)_Buf1)[index] - ((byte *)_Buf2)[index];
 }
 
 void *__cdecl memcpy(void *_Dst, void const *_Src, size_t _Size) {
@@ -32,19 +30,15 @@ void *__cdecl memcpy(void *_Dst, void const *_Src, size_t _Size) {
     // I'm ok with that.
     return memmove(_Dst, _Src, _Size);
   } else {
-    auto *dst = (byte *)_Dst;
-    auto *src = (byte *)_Src;
-    while (_Size--) *dst++ = *src++;
+    bytes_move(_Dst, _Src, _Size);
   }
   return _Dst;
 }
 
 void *memmove(void *_Dst, void const *_Src, size_t _Size) {
-  auto *dst = (byte *)_Dst;
-  auto *src = (byte *)_Src;
-  if (_Size == 0) return _Dst;
-  For(range(_Size - 1, -1, -1)) dst[it] = src[it];
-  return dst;
+  // Picks the direction based on how the buffers overlap.
+  bytes_move(_Dst, _Src, _Size);
+  return _Dst;
 }
 
 void *memset(void *_Dst, int _Val, size_t _Size) {
@@ -650,7 +644,19 @@ void *general_reallocate(void *ptr, s64 newUserSize, u64 options,
     auto rid = node->RID;
     bool wasMarkedAsLeak = node->MarkedAsLeak;
 
-    node = list_add(header);
+    // The allocator may hand us a block which was freed before (pools do that
+    // all the time), in that case reuse its node (same as in general_allocate).
+    auto *existing = list_search(header);
+    if (existing->Header == header) {
+      assert(existing->Freed &&
+             "Allocator implementation returning a pointer which is "
+             "still live and wasn't freed yet");
+      node = existing;
+    } else {
+      node = list_add(header);
+    }
+    node->Freed = false;
+    node->FreedAt = {};
 #endif
 
     // Copy old state